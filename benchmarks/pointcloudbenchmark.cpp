@@ -0,0 +1,477 @@
+// Headless micro-benchmarks of the .pts loader and exporter and of the
+// geometry kernels the viewer runs over every cloud. Synthetic files are
+// generated in each line format, then every stage is run a few times and its
+// best and median wall time, throughput and heap allocations per point reported.
+//
+//   pointcloudbenchmark --points 5000000 --runs 5 --format xyzrgb,xyzirgb
+
+#include "lasformat.h"
+#include "plyformat.h"
+#include "pointcloud.h"
+#include "pointkdtree.h"
+#include "pointstatistics.h"
+#include "ptsparser.h"
+#include "ptswriter.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QDir>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+
+// Heap allocations are counted process wide. With glibc every allocation,
+// including Qt's container storage, goes through malloc and is counted there;
+// elsewhere only operator new can be replaced portably, which misses Qt containers.
+namespace {
+std::atomic<qint64> g_allocations { 0 };
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+}
+static const char *const AllocationCounter = "malloc";
+#else
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+static const char *const AllocationCounter = "operator new";
+#endif
+
+namespace {
+
+// The line layouts PtsParser accepts
+enum class Variant {
+    Xyz,
+    XyzIntensity,
+    XyzRgb,
+    XyzIntensityRgb
+};
+
+struct VariantInfo {
+    Variant variant;
+    const char *name;
+    bool intensity;
+    bool color;
+};
+
+const VariantInfo Variants[] = {
+    { Variant::Xyz, "xyz", false, false },
+    { Variant::XyzIntensity, "xyzi", true, false },
+    { Variant::XyzRgb, "xyzrgb", false, true },
+    { Variant::XyzIntensityRgb, "xyzirgb", true, true },
+};
+
+struct Measurement {
+    QString name;
+    qint64 points = 0;
+    qint64 bytes = 0;           // Bytes read or written per run; 0 when not meaningful
+    QVector<double> runsMs;
+    qint64 allocations = 0;     // Fewest seen in a run
+
+    double bestMs() const { return *std::min_element(runsMs.begin(), runsMs.end()); }
+
+    double medianMs() const
+    {
+        QVector<double> sorted = runsMs;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+template <typename Function>
+Measurement measure(const QString &name, qint64 points, int runs, Function &&function)
+{
+    Measurement measurement;
+    measurement.name = name;
+    measurement.points = points;
+    measurement.allocations = std::numeric_limits<qint64>::max();
+
+    for (int run = 0; run < runs; ++run) {
+        const qint64 allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+        QElapsedTimer timer;
+        timer.start();
+        measurement.bytes = function();
+        const qint64 nanoseconds = timer.nsecsElapsed();
+        const qint64 allocations = g_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+
+        measurement.runsMs.append(double(nanoseconds) / 1.0e6);
+        measurement.allocations = qMin(measurement.allocations, allocations);
+    }
+    return measurement;
+}
+
+void printHeader(QTextStream &out)
+{
+    out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+               .arg(QStringLiteral("stage"), -34)
+               .arg(QStringLiteral("best ms"), 10)
+               .arg(QStringLiteral("median ms"), 10)
+               .arg(QStringLiteral("Mpts/s"), 9)
+               .arg(QStringLiteral("MB/s"), 9)
+               .arg(QStringLiteral("allocs/pt"), 10);
+}
+
+void printMeasurement(QTextStream &out, const Measurement &m)
+{
+    const double seconds = m.bestMs() / 1000.0;
+    const double pointsPerSecond = seconds > 0.0 ? m.points / seconds / 1.0e6 : 0.0;
+    const double bytesPerSecond = seconds > 0.0 && m.bytes > 0 ? m.bytes / seconds / (1024.0 * 1024.0) : 0.0;
+    const double allocationsPerPoint = m.points > 0 ? double(m.allocations) / double(m.points) : 0.0;
+
+    out << QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+               .arg(m.name, -34)
+               .arg(m.bestMs(), 10, 'f', 2)
+               .arg(m.medianMs(), 10, 'f', 2)
+               .arg(pointsPerSecond, 9, 'f', 2)
+               .arg(m.bytes > 0 ? QString::number(bytesPerSecond, 'f', 1) : QStringLiteral("-"), 9)
+               .arg(allocationsPerPoint, 10, 'f', 4);
+    out.flush();
+}
+
+// Writes a scan-like cloud: a noisy sphere shell over a ground plane, with a
+// point count header, in the given line layout. The seed makes runs comparable.
+bool generateFile(const QString &filename, const VariantInfo &variant, qint64 pointCount, QString *errorMessage)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *errorMessage = file.errorString();
+        return false;
+    }
+
+    QRandomGenerator random(20240601);
+    QByteArray block;
+    block.reserve(4 * 1024 * 1024 + 256);
+    block.append(QByteArray::number(pointCount)).append('\n');
+
+    char number[64];
+    auto appendFloat = [&](float value) {
+        const auto result = std::to_chars(number, number + sizeof(number), value, std::chars_format::fixed, 4);
+        block.append(number, int(result.ptr - number));
+    };
+    auto appendInt = [&](int value) {
+        const auto result = std::to_chars(number, number + sizeof(number), value);
+        block.append(number, int(result.ptr - number));
+    };
+
+    for (qint64 i = 0; i < pointCount; ++i) {
+        float x, y, z;
+        if (i % 4 == 0) {
+            x = float(random.bounded(200.0) - 100.0);
+            y = float(random.bounded(200.0) - 100.0);
+            z = float(random.bounded(0.05));
+        } else {
+            const double theta = random.bounded(2.0 * M_PI);
+            const double phi = std::acos(random.bounded(2.0) - 1.0);
+            const double radius = 40.0 + random.bounded(0.5);
+            x = float(radius * std::sin(phi) * std::cos(theta));
+            y = float(radius * std::sin(phi) * std::sin(theta));
+            z = float(50.0 + radius * std::cos(phi));
+        }
+
+        appendFloat(x);
+        block.append(' ');
+        appendFloat(y);
+        block.append(' ');
+        appendFloat(z);
+        if (variant.intensity) {
+            block.append(' ');
+            appendInt(int(random.bounded(2048)) - 1024);
+        }
+        if (variant.color) {
+            const quint32 rgb = random.generate();
+            block.append(' ');
+            appendInt(int(rgb & 0xFF));
+            block.append(' ');
+            appendInt(int((rgb >> 8) & 0xFF));
+            block.append(' ');
+            appendInt(int((rgb >> 16) & 0xFF));
+        }
+        block.append('\n');
+
+        if (block.size() >= 4 * 1024 * 1024) {
+            if (file.write(block) != block.size()) {
+                *errorMessage = file.errorString();
+                return false;
+            }
+            block.clear();
+        }
+    }
+
+    if (file.write(block) != block.size()) {
+        *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Lays positions and colours out as uploadPointCloud() does: all positions,
+// then all colours, in one buffer sized for the cloud
+qint64 packVertexBuffer(const PointAttributes &cloud, QByteArray &buffer)
+{
+    const qsizetype count = cloud.size();
+    const qsizetype positionBytes = count * qsizetype(sizeof(QVector3D));
+    const qsizetype colorBytes = count * qsizetype(sizeof(PointColor));
+    buffer.resize(positionBytes + colorBytes);
+
+    char *out = buffer.data();
+    std::memcpy(out, cloud.points.constData(), size_t(positionBytes));
+    std::memcpy(out + positionBytes, cloud.colors.constData(), size_t(colorBytes));
+    return positionBytes + colorBytes;
+}
+
+// Writes the positions alone as PLY and LAS and reads them back; the viewer
+// uploads one colour per point, so colourless files must still come back with them
+bool checkColorlessLoad(const QString &directory, const PointAttributes &cloud, QTextStream &err)
+{
+    PointAttributes colorless;
+    colorless.points = cloud.points;
+
+    const struct {
+        const char *suffix;
+        bool (*write)(const QString &, const PointAttributes &, const PtsWriter::ProgressCallback &, PtsWriteStats *, QString *);
+        bool (*read)(const QString &, PointAttributes &, const PtsParser::ProgressCallback &, PtsParseStats *, QString *);
+    } formats[] = {
+        { "ply", &PlyWriter::writeFile, &PlyReader::readFile },
+        { "las", &LasWriter::writeFile, &LasReader::readFile },
+    };
+
+    for (const auto &format : formats) {
+        const QString filename = QDir(directory).filePath(QStringLiteral("colorless.%1").arg(QLatin1String(format.suffix)));
+        QString errorMessage;
+        PointAttributes loaded;
+        const bool ok = format.write(filename, colorless, PtsWriter::ProgressCallback(), nullptr, &errorMessage)
+                        && format.read(filename, loaded, PtsParser::ProgressCallback(), nullptr, &errorMessage);
+        QFile::remove(filename);
+        if (!ok) {
+            err << "Colourless " << format.suffix << " round trip failed: " << errorMessage << '\n';
+            return false;
+        }
+
+        const bool allWhite = std::all_of(loaded.colors.cbegin(), loaded.colors.cend(), [](const PointColor &c) {
+            return c.r == 255 && c.g == 255 && c.b == 255 && c.a == 255;
+        });
+        if (loaded.size() != cloud.size() || loaded.colors.size() != loaded.size() || !allWhite) {
+            err << "Colourless " << format.suffix << " loaded " << loaded.size() << " points and "
+                << loaded.colors.size() << " colours, expected " << cloud.size() << " white\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("pointcloudbenchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmarks the .pts loader, exporter and geometry kernels without a display."));
+    parser.addHelpOption();
+    const QCommandLineOption pointsOption(QStringLiteral("points"), QStringLiteral("Points per generated file."), QStringLiteral("count"), QStringLiteral("2000000"));
+    const QCommandLineOption runsOption(QStringLiteral("runs"), QStringLiteral("Timed runs of each stage."), QStringLiteral("count"), QStringLiteral("5"));
+    const QCommandLineOption formatOption(QStringLiteral("format"), QStringLiteral("Comma-separated line layouts: xyz, xyzi, xyzrgb, xyzirgb."), QStringLiteral("list"), QStringLiteral("xyz,xyzi,xyzrgb,xyzirgb"));
+    const QCommandLineOption queriesOption(QStringLiteral("queries"), QStringLiteral("Nearest-neighbour queries against the k-d tree."), QStringLiteral("count"), QStringLiteral("100000"));
+    const QCommandLineOption directoryOption(QStringLiteral("dir"), QStringLiteral("Directory for the generated files, which are then kept; a temporary one otherwise."), QStringLiteral("path"));
+    parser.addOptions({ pointsOption, runsOption, formatOption, queriesOption, directoryOption });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const qint64 pointCount = parser.value(pointsOption).toLongLong();
+    const int runs = qMax(1, parser.value(runsOption).toInt());
+    const int queryCount = qMax(1, parser.value(queriesOption).toInt());
+    if (pointCount <= 0) {
+        err << "--points must be positive\n";
+        return 1;
+    }
+
+    QVector<VariantInfo> variants;
+    for (const QString &name : parser.value(formatOption).split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        auto it = std::find_if(std::begin(Variants), std::end(Variants),
+                               [&name](const VariantInfo &v) { return name.trimmed() == QLatin1String(v.name); });
+        if (it == std::end(Variants)) {
+            err << "Unknown format " << name << '\n';
+            return 1;
+        }
+        variants.append(*it);
+    }
+
+    QTemporaryDir temporaryDir;
+    const QString directory = parser.isSet(directoryOption) ? parser.value(directoryOption) : temporaryDir.path();
+    if (!QDir().mkpath(directory)) {
+        err << "Cannot create " << directory << '\n';
+        return 1;
+    }
+
+    out << "Points per file: " << pointCount << ", runs: " << runs
+        << ", threads: " << QThreadPool::globalInstance()->maxThreadCount()
+        << ", allocations counted through " << AllocationCounter << "\n\n";
+    printHeader(out);
+
+    PointAttributes lastCloud;
+
+    for (const VariantInfo &variant : variants) {
+        const QString source = QDir(directory).filePath(QStringLiteral("synthetic-%1.pts").arg(QLatin1String(variant.name)));
+        QString errorMessage;
+
+        QElapsedTimer generateTimer;
+        generateTimer.start();
+        if (!generateFile(source, variant, pointCount, &errorMessage)) {
+            err << "Cannot write " << source << ": " << errorMessage << '\n';
+            return 1;
+        }
+        const qint64 fileBytes = QFileInfo(source).size();
+        out << "\n" << variant.name << ": " << fileBytes / (1024 * 1024) << " MB generated in "
+            << generateTimer.elapsed() << " ms\n";
+
+        // Parsing as the loader does it, into one result and as a stream of batches
+        PtsParser::Result parsed;
+        printMeasurement(out, measure(QStringLiteral("parse %1").arg(QLatin1String(variant.name)), pointCount, runs, [&]() {
+            parsed = PtsParser::Result();
+            if (!PtsParser::parseFile(source, parsed, PtsParser::ProgressCallback(), &errorMessage))
+                err << "Parse failed: " << errorMessage << '\n';
+            return fileBytes;
+        }));
+
+        if (parsed.size() != pointCount) {
+            err << "Parsed " << parsed.size() << " points, expected " << pointCount << '\n';
+            return 1;
+        }
+
+        printMeasurement(out, measure(QStringLiteral("parse %1 streamed").arg(QLatin1String(variant.name)), pointCount, runs, [&]() {
+            // Batches are dropped as they arrive, as the viewer hands them on
+            PtsParser::parseFile(source, [](PointBatch &&) {});
+            return fileBytes;
+        }));
+
+        // Export in both layouts the viewer offers
+        const QString exported = QDir(directory).filePath(QStringLiteral("export-%1.pts").arg(QLatin1String(variant.name)));
+        const struct { PtsWriter::Format format; const char *name; } formats[] = {
+            { PtsWriter::Format::Compact, "compact" },
+            { PtsWriter::Format::Legacy, "legacy" },
+        };
+        for (const auto &format : formats) {
+            printMeasurement(out, measure(QStringLiteral("export %1 %2").arg(QLatin1String(variant.name), QLatin1String(format.name)), pointCount, runs, [&]() {
+                PtsWriteStats stats;
+                if (!PtsWriter::writeFile(exported, parsed, format.format, PtsWriter::ProgressCallback(), &stats, &errorMessage))
+                    err << "Export failed: " << errorMessage << '\n';
+                return stats.bytes;
+            }));
+        }
+        QFile::remove(exported);
+
+        if (!parser.isSet(directoryOption))
+            QFile::remove(source);
+
+        lastCloud = parsed;
+    }
+
+    if (lastCloud.size() == 0)
+        return 0;
+
+    if (!checkColorlessLoad(directory, lastCloud, err))
+        return 1;
+
+    // The geometry kernels depend on the positions alone, so they run once over the last cloud
+    out << "\nGeometry over " << lastCloud.size() << " points\n";
+    const qint64 positionBytes = lastCloud.size() * qint64(sizeof(QVector3D));
+
+    printMeasurement(out, measure(QStringLiteral("bounds"), lastCloud.size(), runs, [&]() {
+        QVector3D boundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        QVector3D boundsMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+        PointStatistics::growBounds(lastCloud.points.constData(), lastCloud.size(), boundsMin, boundsMax);
+        return positionBytes;
+    }));
+
+    printMeasurement(out, measure(QStringLiteral("bounds, centroid and variance"), lastCloud.size(), runs, [&]() {
+        PointStatistics::compute(lastCloud.points);
+        return positionBytes;
+    }));
+
+    QByteArray vertexBuffer;
+    printMeasurement(out, measure(QStringLiteral("vertex buffer packing"), lastCloud.size(), runs, [&]() {
+        vertexBuffer = QByteArray();
+        return packVertexBuffer(lastCloud, vertexBuffer);
+    }));
+    vertexBuffer = QByteArray();
+
+    PointKdTree tree;
+    printMeasurement(out, measure(QStringLiteral("k-d tree build"), lastCloud.size(), runs, [&]() {
+        tree = PointKdTree::build(lastCloud.points);
+        return positionBytes;
+    }));
+
+    // Queries jittered around cloud points, so most land where the data is
+    QVector<QVector3D> queries(queryCount);
+    QRandomGenerator random(7);
+    for (QVector3D &query : queries) {
+        const QVector3D &p = lastCloud.points[qsizetype(random.bounded(quint64(lastCloud.size())))];
+        query = p + QVector3D(float(random.bounded(0.2) - 0.1), float(random.bounded(0.2) - 0.1), float(random.bounded(0.2) - 0.1));
+    }
+
+    printMeasurement(out, measure(QStringLiteral("k-d tree 8-nearest x%1").arg(queryCount), queryCount, runs, [&]() {
+        QVector<PointKdTree::Neighbour> neighbours;
+        for (const QVector3D &query : queries)
+            tree.nearest(query, 8, neighbours);
+        return qint64(0);
+    }));
+
+    printMeasurement(out, measure(QStringLiteral("k-d tree radius 0.5 x%1").arg(queryCount), queryCount, runs, [&]() {
+        for (const QVector3D &query : queries)
+            tree.withinRadius(query, 0.5f);
+        return qint64(0);
+    }));
+
+    return 0;
+}
@@ -0,0 +1,319 @@
+// Frame-time regression harness. Loads a scene the way the viewer does,
+// renders it with the viewer's own widget into its offscreen framebuffer and
+// replays a camera path, either one saved from the Viewport menu or a turntable
+// orbit. Reports CPU and GPU frame-time percentiles and, given a baseline,
+// exits with status 2 when a percentile exceeds it by more than the margin.
+//
+//   renderbenchmark scan.pts --path orbit.json --baseline baseline.json --margin 0.15
+//
+// Runs on any display, or with QT_QPA_PLATFORM=offscreen where a desktop
+// OpenGL 3.3 context is available without one; Mesa's llvmpipe
+// (LIBGL_ALWAYS_SOFTWARE=1) serves as a software renderer.
+
+#include "camerapath.h"
+#include "mainwindow.h"
+#include "pointcloudloader.h"
+#include "scenestore.h"
+#include "viewportobject.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QSaveFile>
+#include <QSurfaceFormat>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double Percentiles[] = { 50.0, 90.0, 95.0, 99.0 };
+
+// Percentiles checked against a baseline; the tail above p95 is too noisy to gate on
+const double GatedPercentiles[] = { 50.0, 95.0 };
+
+// Nearest-rank percentile of sorted samples
+double percentile(const QVector<double> &sorted, double p)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    const qsizetype rank = qsizetype(std::ceil(p / 100.0 * double(sorted.size())));
+    return sorted[qBound<qsizetype>(0, rank - 1, sorted.size() - 1)];
+}
+
+QString percentileKey(double p)
+{
+    return QStringLiteral("p%1").arg(p, 0, 'f', 0);
+}
+
+QJsonObject summarize(QVector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    QJsonObject summary;
+    summary.insert("frames", int(samples.size()));
+    for (double p : Percentiles)
+        summary.insert(percentileKey(p), percentile(samples, p));
+    summary.insert("max", samples.isEmpty() ? 0.0 : samples.last());
+    return summary;
+}
+
+void printSummary(QTextStream &out, const char *name, const QJsonObject &summary)
+{
+    out << QStringLiteral("%1").arg(QLatin1String(name), -4);
+    for (double p : Percentiles)
+        out << QStringLiteral("  %1 %2 ms").arg(percentileKey(p)).arg(summary.value(percentileKey(p)).toDouble(), 7, 'f', 3);
+    out << QStringLiteral("  max %1 ms  (%2 frames)\n").arg(summary.value("max").toDouble(), 7, 'f', 3).arg(summary.value("frames").toInt());
+}
+
+// Loads every file into the store, then waits for their octrees so the
+// replay draws what the viewer would once loading has settled
+bool loadScene(SceneStore &scene, const QStringList &files, QString *errorMessage)
+{
+    PointCloudLoader loader;
+    QHash<int, EntityId> jobs;
+    QEventLoop loop;
+
+    QObject::connect(&loader, &PointCloudLoader::batchReady, [&](int jobId, const PointBatch &batch) {
+        scene.appendPoints(jobs.value(jobId), batch);
+    });
+    QObject::connect(&loader, &PointCloudLoader::meshReady, [&](int jobId, const MeshPart &mesh) {
+        scene.appendMesh(jobs.value(jobId), mesh);
+    });
+    QObject::connect(&loader, &PointCloudLoader::loadFinished, [&](int jobId, const LoadSummary &summary) {
+        const EntityId id = jobs.take(jobId);
+        scene.setSourceFormat(id, summary.sourceFormat);
+        scene.buildLevelOfDetail(id);
+        if (jobs.isEmpty())
+            loop.quit();
+    });
+    QObject::connect(&loader, &PointCloudLoader::loadFailed, [&](int jobId, const QString &message) {
+        *errorMessage = QStringLiteral("%1: %2").arg(scene.name(jobs.value(jobId)), message);
+        loop.exit(1);
+    });
+
+    for (const QString &file : files) {
+        PointCloud pc;
+        pc.sourceFormat = QFileInfo(file).suffix().toUpper();
+        const EntityId id = scene.addEntity(QFileInfo(file).fileName(), pc);
+        jobs.insert(loader.load(file), id);
+    }
+
+    if (loop.exec() != 0)
+        return false;
+
+    for (EntityId id : scene.entityIds()) {
+        while (!scene.cloud(id)->points.isEmpty() && !scene.levelOfDetail(id))
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // The viewer's format, without multisampling, which an offscreen framebuffer does not need
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    QApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("renderbenchmark"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a camera path offscreen and reports frame-time percentiles."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("files"), QStringLiteral("Point cloud or model files making up the scene."));
+    const QCommandLineOption pathOption(QStringLiteral("path"), QStringLiteral("Camera path saved from the Viewport menu; a turntable orbit otherwise."), QStringLiteral("file"));
+    const QCommandLineOption turntableOption(QStringLiteral("turntable-frames"), QStringLiteral("Frames of the turntable orbit."), QStringLiteral("count"), QStringLiteral("120"));
+    const QCommandLineOption sizeOption(QStringLiteral("size"), QStringLiteral("Framebuffer size."), QStringLiteral("WxH"), QStringLiteral("1280x720"));
+    const QCommandLineOption warmupOption(QStringLiteral("warmup"), QStringLiteral("Untimed frames drawn first, which also upload the buffers."), QStringLiteral("count"), QStringLiteral("10"));
+    const QCommandLineOption repeatOption(QStringLiteral("repeat"), QStringLiteral("Times the path is replayed."), QStringLiteral("count"), QStringLiteral("3"));
+    const QCommandLineOption budgetOption(QStringLiteral("point-budget"), QStringLiteral("Points drawn per frame at most; 0 draws everything."), QStringLiteral("points"), QStringLiteral("0"));
+    const QCommandLineOption baselineOption(QStringLiteral("baseline"), QStringLiteral("Results of an earlier run to compare against."), QStringLiteral("file"));
+    const QCommandLineOption marginOption(QStringLiteral("margin"), QStringLiteral("Fraction a percentile may exceed the baseline by."), QStringLiteral("fraction"), QStringLiteral("0.10"));
+    const QCommandLineOption writeOption(QStringLiteral("write-baseline"), QStringLiteral("Writes this run's results for later comparisons."), QStringLiteral("file"));
+    parser.addOptions({ pathOption, turntableOption, sizeOption, warmupOption, repeatOption, budgetOption,
+                        baselineOption, marginOption, writeOption });
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        err << "No scene files given\n";
+        return 1;
+    }
+
+    const QStringList size = parser.value(sizeOption).split(QLatin1Char('x'));
+    const int width = size.value(0).toInt();
+    const int height = size.value(1).toInt();
+    if (width <= 0 || height <= 0) {
+        err << "Invalid --size " << parser.value(sizeOption) << '\n';
+        return 1;
+    }
+
+    CameraPath path;
+    QString errorMessage;
+    if (parser.isSet(pathOption)) {
+        if (!CameraPath::load(parser.value(pathOption), path, &errorMessage)) {
+            err << "Cannot read " << parser.value(pathOption) << ": " << errorMessage << '\n';
+            return 1;
+        }
+    } else {
+        path = CameraPath::turntable(parser.value(turntableOption).toInt());
+    }
+    if (path.frameCount() == 0) {
+        err << "The camera path has no frames\n";
+        return 1;
+    }
+
+    SceneStore scene;
+    if (!loadScene(scene, files, &errorMessage)) {
+        err << "Cannot load " << errorMessage << '\n';
+        return 1;
+    }
+
+    // Shown off screen, so the widget gets the framebuffer and context it would in the viewer
+    PointCloudGLWidget widget;
+    widget.setAttribute(Qt::WA_DontShowOnScreen);
+    widget.resize(width, height);
+    widget.setScene(&scene);
+    widget.setPointBudget(parser.value(budgetOption).toLongLong());
+    widget.show();
+    widget.resetView();
+
+    // Drawing through grabFramebuffer() waits for the frame, so each one is timed on its own
+    auto renderFrame = [&widget]() {
+        widget.grabFramebuffer();
+        return widget.renderStats();
+    };
+
+    // The first frame creates the context
+    renderFrame();
+
+    const QSurfaceFormat contextFormat = widget.context() ? widget.context()->format() : QSurfaceFormat();
+    widget.makeCurrent();
+    const QString renderer = widget.context()
+        ? QString::fromLatin1(reinterpret_cast<const char *>(widget.context()->functions()->glGetString(GL_RENDERER)))
+        : QString();
+    widget.doneCurrent();
+
+    qint64 points = 0;
+    for (EntityId id : scene.entityIds())
+        points += scene.cloud(id)->points.size();
+    out << "Scene: " << scene.count() << " entities, " << points << " points\n"
+        << "Renderer: " << renderer << " (OpenGL " << contextFormat.majorVersion() << '.' << contextFormat.minorVersion() << ")\n"
+        << "Path: " << path.frameCount() << " frames x " << parser.value(repeatOption) << ", "
+        << width << 'x' << height << "\n\n";
+    out.flush();
+
+    for (int i = 0; i < parser.value(warmupOption).toInt(); ++i)
+        renderFrame();
+
+    QVector<double> cpuTimes;
+    QVector<double> gpuTimes;
+    auto record = [&](const PointCloudGLWidget::RenderStats &stats) {
+        cpuTimes.append(stats.cpuTimeMs);
+        if (stats.gpuTimeMs >= 0.0)
+            gpuTimes.append(stats.gpuTimeMs);
+    };
+
+    const int repeats = qMax(1, parser.value(repeatOption).toInt());
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        widget.resetView();
+        for (const CameraPath::Step &step : path.steps) {
+            if (step.kind == CameraPath::Step::Viewport) {
+                ViewportObject viewport(step.name);
+                viewport.setParameters(step.viewport);
+                viewport.applyViewport(&widget);
+                for (int frame = 0; frame < step.frames; ++frame)
+                    record(renderFrame());
+            } else {
+                for (const CameraPath::Move &move : step.moves) {
+                    widget.dragCamera(move.delta, move.buttons);
+                    record(renderFrame());
+                }
+            }
+        }
+    }
+
+    // GPU times arrive a frame or more late; a few more frames collect the last ones
+    for (int i = 0; i < 8 && !gpuTimes.isEmpty() && gpuTimes.size() < cpuTimes.size(); ++i) {
+        const PointCloudGLWidget::RenderStats stats = renderFrame();
+        if (stats.gpuTimeMs >= 0.0)
+            gpuTimes.append(stats.gpuTimeMs);
+    }
+
+    QJsonObject results;
+    results.insert("renderer", renderer);
+    results.insert("size", parser.value(sizeOption));
+    results.insert("points", double(points));
+    results.insert("cpu", summarize(cpuTimes));
+    if (!gpuTimes.isEmpty())
+        results.insert("gpu", summarize(gpuTimes));
+
+    printSummary(out, "CPU", results.value("cpu").toObject());
+    if (results.contains("gpu"))
+        printSummary(out, "GPU", results.value("gpu").toObject());
+    else
+        out << "GPU  not measured: the context has no timer queries\n";
+
+    if (parser.isSet(writeOption)) {
+        QSaveFile file(parser.value(writeOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(results).toJson()) < 0 || !file.commit()) {
+            err << "Cannot write " << parser.value(writeOption) << ": " << file.errorString() << '\n';
+            return 1;
+        }
+    }
+
+    if (!parser.isSet(baselineOption))
+        return 0;
+
+    QFile baselineFile(parser.value(baselineOption));
+    if (!baselineFile.open(QIODevice::ReadOnly)) {
+        err << "Cannot read " << parser.value(baselineOption) << ": " << baselineFile.errorString() << '\n';
+        return 1;
+    }
+    const QJsonObject baseline = QJsonDocument::fromJson(baselineFile.readAll()).object();
+    const double margin = parser.value(marginOption).toDouble();
+
+    out << "\nBaseline " << parser.value(baselineOption) << ", margin " << margin * 100.0 << "%\n";
+    if (baseline.value("renderer").toString() != renderer || baseline.value("size").toString() != parser.value(sizeOption))
+        out << "Warning: the baseline was taken with " << baseline.value("renderer").toString()
+            << " at " << baseline.value("size").toString() << '\n';
+
+    bool regressed = false;
+    for (const char *clock : { "cpu", "gpu" }) {
+        const QJsonObject current = results.value(clock).toObject();
+        const QJsonObject reference = baseline.value(clock).toObject();
+        if (current.isEmpty() || reference.isEmpty())
+            continue;
+
+        for (double p : GatedPercentiles) {
+            const QString key = percentileKey(p);
+            const double now = current.value(key).toDouble();
+            const double before = reference.value(key).toDouble();
+            const bool failed = before > 0.0 && now > before * (1.0 + margin);
+            regressed |= failed;
+            out << QStringLiteral("%1 %2 %3  %4 ms, baseline %5 ms (%6%7%)\n")
+                       .arg(QString::fromLatin1(clock).toUpper(), -4)
+                       .arg(key, -4)
+                       .arg(failed ? QStringLiteral("FAIL") : QStringLiteral("ok  "))
+                       .arg(now, 0, 'f', 3)
+                       .arg(before, 0, 'f', 3)
+                       .arg(now >= before ? QStringLiteral("+") : QString())
+                       .arg(before > 0.0 ? (now / before - 1.0) * 100.0 : 0.0, 0, 'f', 1);
+        }
+    }
+
+    return regressed ? 2 : 0;
+}
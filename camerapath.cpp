@@ -0,0 +1,183 @@
+#include "camerapath.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+
+QJsonArray matrixToJson(const QMatrix4x4 &matrix)
+{
+    QJsonArray values;
+    const float *data = matrix.constData();
+    for (int i = 0; i < 16; ++i)
+        values.append(double(data[i]));
+    return values;
+}
+
+QMatrix4x4 matrixFromJson(const QJsonValue &value)
+{
+    const QJsonArray values = value.toArray();
+    if (values.size() != 16)
+        return QMatrix4x4();
+
+    // constData() is column-major, as is the array written above
+    float data[16];
+    for (int i = 0; i < 16; ++i)
+        data[i] = float(values[i].toDouble());
+    return QMatrix4x4(data).transposed();
+}
+
+QJsonArray vectorToJson(const QVector3D &vector)
+{
+    return QJsonArray { double(vector.x()), double(vector.y()), double(vector.z()) };
+}
+
+QVector3D vectorFromJson(const QJsonValue &value)
+{
+    const QJsonArray values = value.toArray();
+    return values.size() == 3 ? QVector3D(float(values[0].toDouble()), float(values[1].toDouble()), float(values[2].toDouble()))
+                              : QVector3D();
+}
+
+} // namespace
+
+int CameraPath::frameCount() const
+{
+    int frames = 0;
+    for (const Step &step : steps)
+        frames += step.kind == Step::Viewport ? step.frames : int(step.moves.size());
+    return frames;
+}
+
+void CameraPath::addViewport(const QString &name, const ViewportObject::ViewportParameters &viewport, int frames)
+{
+    Step step;
+    step.kind = Step::Viewport;
+    step.name = name;
+    step.viewport = viewport;
+    step.frames = qMax(1, frames);
+    steps.append(step);
+}
+
+void CameraPath::addMove(const QPoint &delta, Qt::MouseButtons buttons)
+{
+    if (steps.isEmpty() || steps.last().kind != Step::Drag) {
+        Step step;
+        step.kind = Step::Drag;
+        steps.append(step);
+    }
+    steps.last().moves.append({ delta, buttons });
+}
+
+CameraPath CameraPath::turntable(int frames)
+{
+    CameraPath path;
+    frames = qMax(1, frames);
+
+    // dragCamera() turns one degree per pixel; the remainder is spread over the first frames
+    for (int i = 0; i < frames; ++i) {
+        const int degrees = 360 / frames + (i < 360 % frames ? 1 : 0);
+        path.addMove(QPoint(degrees, 0), Qt::LeftButton);
+    }
+    return path;
+}
+
+bool CameraPath::save(const QString &filename, QString *errorMessage) const
+{
+    QJsonArray stepArray;
+    for (const Step &step : steps) {
+        QJsonObject object;
+        if (step.kind == Step::Viewport) {
+            const ViewportObject::ViewportParameters &v = step.viewport;
+            object.insert("type", "viewport");
+            object.insert("name", step.name);
+            object.insert("frames", step.frames);
+            object.insert("modelMatrix", matrixToJson(v.modelMatrix));
+            object.insert("viewMatrix", matrixToJson(v.viewMatrix));
+            object.insert("cameraDistance", double(v.cameraDistance));
+            object.insert("xRot", double(v.xRot));
+            object.insert("yRot", double(v.yRot));
+            object.insert("modelCenter", vectorToJson(v.modelCenter));
+            object.insert("focalDistance", double(v.focalDistance));
+            object.insert("fov", double(v.fov));
+        } else {
+            // Each move is [dx, dy, buttons]
+            QJsonArray moves;
+            for (const Move &move : step.moves)
+                moves.append(QJsonArray { move.delta.x(), move.delta.y(), move.buttons.toInt() });
+            object.insert("type", "drag");
+            object.insert("moves", moves);
+        }
+        stepArray.append(object);
+    }
+
+    QJsonObject root;
+    root.insert("version", 1);
+    root.insert("steps", stepArray);
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)
+        || file.write(QJsonDocument(root).toJson()) < 0
+        || !file.commit())
+    {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool CameraPath::load(const QString &filename, CameraPath &path, QString *errorMessage)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!document.isObject())
+    {
+        if (errorMessage)
+            *errorMessage = parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                                          : QStringLiteral("Not a camera path");
+        return false;
+    }
+
+    path.steps.clear();
+    const QJsonArray stepArray = document.object().value("steps").toArray();
+    for (const QJsonValue &value : stepArray) {
+        const QJsonObject object = value.toObject();
+        const QString type = object.value("type").toString();
+
+        if (type == QLatin1String("viewport")) {
+            ViewportObject::ViewportParameters v {};
+            v.modelMatrix = matrixFromJson(object.value("modelMatrix"));
+            v.viewMatrix = matrixFromJson(object.value("viewMatrix"));
+            v.cameraDistance = float(object.value("cameraDistance").toDouble(5.0));
+            v.xRot = float(object.value("xRot").toDouble());
+            v.yRot = float(object.value("yRot").toDouble());
+            v.modelCenter = vectorFromJson(object.value("modelCenter"));
+            v.focalDistance = float(object.value("focalDistance").toDouble(0.5));
+            v.fov = float(object.value("fov").toDouble(30.0));
+            path.addViewport(object.value("name").toString(), v, object.value("frames").toInt(1));
+        } else if (type == QLatin1String("drag")) {
+            const QJsonArray moves = object.value("moves").toArray();
+            for (const QJsonValue &moveValue : moves) {
+                const QJsonArray move = moveValue.toArray();
+                if (move.size() == 3)
+                    path.addMove(QPoint(move[0].toInt(), move[1].toInt()), Qt::MouseButtons::fromInt(move[2].toInt()));
+            }
+        } else {
+            if (errorMessage)
+                *errorMessage = QStringLiteral("Unknown step type \"%1\"").arg(type);
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <QPoint>
+#include <QString>
+#include <QVector>
+#include "viewportobject.h"
+
+// A replayable camera path: saved viewports, each held for some frames, and
+// mouse drags recorded in the viewer, one frame per move. Stored as JSON so
+// paths can be kept next to the scenes they were recorded on.
+class CameraPath
+{
+public:
+    struct Move {
+        QPoint delta;
+        Qt::MouseButtons buttons;
+    };
+
+    struct Step {
+        enum Kind {
+            Viewport,   // Jump to viewport and draw it for frames frames
+            Drag        // Replay moves through PointCloudGLWidget::dragCamera()
+        };
+
+        Kind kind = Viewport;
+        QString name;
+        ViewportObject::ViewportParameters viewport {};
+        int frames = 1;
+        QVector<Move> moves;
+    };
+
+    QVector<Step> steps;
+
+    bool isEmpty() const { return steps.isEmpty(); }
+    int frameCount() const;
+
+    void addViewport(const QString &name, const ViewportObject::ViewportParameters &viewport, int frames = 1);
+
+    // Appends to the last step when it is a drag, so a recording stays one step per gesture run
+    void addMove(const QPoint &delta, Qt::MouseButtons buttons);
+
+    // A full turn around the scene in the given number of frames, for scenes with no recorded path
+    static CameraPath turntable(int frames);
+
+    bool save(const QString &filename, QString *errorMessage = nullptr) const;
+    static bool load(const QString &filename, CameraPath &path, QString *errorMessage = nullptr);
+};
+
+#endif // CAMERAPATH_H
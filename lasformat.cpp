@@ -0,0 +1,336 @@
+#include "lasformat.h"
+#include "pointstatistics.h"
+#include <QDate>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr quint16 HeaderSize = 375;
+constexpr quint16 RecordSizeFormat6 = 30;
+constexpr quint16 RecordSizeFormat7 = 36;
+
+// Appends little-endian fields at a moving cursor
+template <typename T>
+inline void put(char *&out, T value)
+{
+    qToLittleEndian(value, out);
+    out += sizeof(T);
+}
+
+template <typename T>
+inline T get(const uchar *data, qint64 offset)
+{
+    return qFromLittleEndian<T>(data + offset);
+}
+
+// Record sizes of point data formats 0-10 without extra bytes, and where their RGB starts
+constexpr int MinimumRecordSize[11] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+constexpr int ColorOffset[11] = { -1, -1, 20, 28, -1, 28, -1, 30, 30, -1, 30 };
+
+inline void putText(char *&out, const char *text, int fieldSize)
+{
+    std::memset(out, 0, size_t(fieldSize));
+    std::memcpy(out, text, qMin(size_t(fieldSize), std::strlen(text)));
+    out += fieldSize;
+}
+
+// The largest power of ten that still resolves the float spacing at the
+// largest coordinate, coarsened until the extent fits the 32-bit integers
+double chooseScale(double maxMagnitude, double extent)
+{
+    double scale = 0.001;
+    if (maxMagnitude > 0.0)
+        scale = std::pow(10.0, std::floor(std::log10(maxMagnitude * std::ldexp(1.0, -23))));
+    while (extent / scale > double(std::numeric_limits<qint32>::max()))
+        scale *= 10.0;
+    return scale;
+}
+
+} // namespace
+
+bool LasWriter::writeFile(const QString &filename, const PointAttributes &points,
+                          const ProgressCallback &progress, PtsWriteStats *stats, QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype pointCount = points.size();
+    const bool hasColors = points.colors.size() == pointCount;
+    const bool hasIntensities = points.intensities.size() == pointCount;
+
+    // Bounds, and the intensity range so values beyond 16 bits can be rescaled
+    double boundsMin[3] = { 0.0, 0.0, 0.0 };
+    double boundsMax[3] = { 0.0, 0.0, 0.0 };
+    if (pointCount > 0) {
+        QVector3D pointsMin = points.points.first();
+        QVector3D pointsMax = points.points.first();
+        PointStatistics::growBounds(points.points.constData(), pointCount, pointsMin, pointsMax);
+        for (int axis = 0; axis < 3; ++axis) {
+            boundsMin[axis] = pointsMin[axis];
+            boundsMax[axis] = pointsMax[axis];
+        }
+    }
+
+    float intensityMin = 0.0f;
+    float intensityMax = 0.0f;
+    if (hasIntensities && pointCount > 0) {
+        const auto range = std::minmax_element(points.intensities.cbegin(), points.intensities.cend());
+        intensityMin = *range.first;
+        intensityMax = *range.second;
+    }
+
+    double scale[3];
+    double offset[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        scale[axis] = chooseScale(qMax(std::abs(boundsMin[axis]), std::abs(boundsMax[axis])),
+                                  boundsMax[axis] - boundsMin[axis]);
+        offset[axis] = std::floor(boundsMin[axis] / scale[axis]) * scale[axis];
+    }
+
+    // Intensities already within the LAS range are kept, others are stretched over it
+    const bool rescaleIntensity = intensityMin < 0.0f || intensityMax > 65535.0f;
+    const float intensityFactor = intensityMax > intensityMin ? 65535.0f / (intensityMax - intensityMin) : 0.0f;
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    auto fail = [&](const QString &message) {
+        if (errorMessage)
+            *errorMessage = message;
+        file.cancelWriting();
+        return false;
+    };
+
+    const quint8 recordFormat = hasColors ? 7 : 6;
+    const quint16 recordSize = hasColors ? RecordSizeFormat7 : RecordSizeFormat6;
+    const QDate today = QDate::currentDate();
+
+    QByteArray header(HeaderSize, Qt::Uninitialized);
+    char *out = header.data();
+    out[0] = 'L'; out[1] = 'A'; out[2] = 'S'; out[3] = 'F';
+    out += 4;
+    put<quint16>(out, 0);                   // File source ID
+    put<quint16>(out, 0x10);                // Global encoding: WKT, required for formats 6-10
+    std::memset(out, 0, 16);                // Project ID
+    out += 16;
+    put<quint8>(out, 1);                    // Version 1.4
+    put<quint8>(out, 4);
+    putText(out, "OTHER", 32);              // System identifier
+    putText(out, "Point Cloud Viewer", 32); // Generating software
+    put<quint16>(out, quint16(today.dayOfYear()));
+    put<quint16>(out, quint16(today.year()));
+    put<quint16>(out, HeaderSize);
+    put<quint32>(out, HeaderSize);          // Offset to point data, no VLRs
+    put<quint32>(out, 0);                   // Number of VLRs
+    put<quint8>(out, recordFormat);
+    put<quint16>(out, recordSize);
+    put<quint32>(out, 0);                   // Legacy point count, zero for formats 6 and up
+    for (int i = 0; i < 5; ++i)
+        put<quint32>(out, 0);               // Legacy points by return
+    for (int axis = 0; axis < 3; ++axis)
+        put<double>(out, scale[axis]);
+    for (int axis = 0; axis < 3; ++axis)
+        put<double>(out, offset[axis]);
+    for (int axis = 0; axis < 3; ++axis) {
+        put<double>(out, boundsMax[axis]);
+        put<double>(out, boundsMin[axis]);
+    }
+    put<quint64>(out, 0);                   // Start of waveform data
+    put<quint64>(out, 0);                   // Start of first EVLR
+    put<quint32>(out, 0);                   // Number of EVLRs
+    put<quint64>(out, quint64(pointCount));
+    put<quint64>(out, quint64(pointCount)); // Every point is a single first return
+    for (int i = 1; i < 15; ++i)
+        put<quint64>(out, 0);
+    Q_ASSERT(out == header.data() + HeaderSize);
+
+    qint64 bytes = header.size();
+    if (file.write(header) != header.size())
+        return fail(file.errorString());
+
+    QByteArray block(qMin(pointCount, BlockPoints) * recordSize, Qt::Uninitialized);
+
+    for (qsizetype first = 0; first < pointCount; first += BlockPoints) {
+        if (progress && !progress(static_cast<int>(first * 100 / pointCount)))
+            return fail(QStringLiteral("Cancelled"));
+
+        const qsizetype count = qMin(BlockPoints, pointCount - first);
+        out = block.data();
+        for (qsizetype i = first; i < first + count; ++i) {
+            const QVector3D &point = points.points[i];
+            for (int axis = 0; axis < 3; ++axis)
+                put<qint32>(out, qint32(std::llround((point[axis] - offset[axis]) / scale[axis])));
+
+            quint16 intensity = 0;
+            if (hasIntensities) {
+                const float value = rescaleIntensity ? (points.intensities[i] - intensityMin) * intensityFactor
+                                                     : points.intensities[i];
+                intensity = quint16(qBound(0.0f, std::round(value), 65535.0f));
+            }
+            put<quint16>(out, intensity);
+            put<quint8>(out, 0x11);         // Return 1 of 1
+            put<quint8>(out, 0);            // Classification flags, channel, scan direction, edge
+            put<quint8>(out, 0);            // Classification: created, never classified
+            put<quint8>(out, 0);            // User data
+            put<qint16>(out, 0);            // Scan angle
+            put<quint16>(out, 0);           // Point source ID
+            put<double>(out, 0.0);          // GPS time
+
+            if (hasColors) {
+                // Spread 8-bit components over the full 16-bit range
+                const PointColor &color = points.colors[i];
+                put<quint16>(out, quint16(color.r * 257));
+                put<quint16>(out, quint16(color.g * 257));
+                put<quint16>(out, quint16(color.b * 257));
+            }
+        }
+
+        const qint64 blockBytes = count * recordSize;
+        if (file.write(block.constData(), blockBytes) != blockBytes)
+            return fail(file.errorString());
+        bytes += blockBytes;
+    }
+
+    if (!file.commit())
+        return fail(file.errorString());
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = bytes;
+        stats->points = pointCount;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
+
+bool LasReader::readFile(const QString &filename, PointAttributes &points,
+                         const ProgressCallback &progress, PtsParseStats *stats, QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage)
+            *errorMessage = message;
+        return false;
+    };
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+
+    const qint64 fileSize = file.size();
+    const uchar *data = fileSize >= 227 ? file.map(0, fileSize) : nullptr;
+    if (!data || std::memcmp(data, "LASF", 4) != 0)
+        return fail(QStringLiteral("Not a LAS file"));
+
+    const quint8 versionMinor = data[25];
+    const quint16 headerSize = get<quint16>(data, 94);
+    const quint32 pointOffset = get<quint32>(data, 96);
+    const quint8 formatByte = data[104];
+    const quint16 recordSize = get<quint16>(data, 105);
+
+    // LAZ marks compressed records by setting the top bits of the format
+    if (formatByte & 0xC0)
+        return fail(QStringLiteral("Compressed LAZ files are not supported"));
+
+    const int format = formatByte & 0x3F;
+    if (format > 10 || recordSize < MinimumRecordSize[format])
+        return fail(QStringLiteral("Unsupported LAS point format %1").arg(format));
+
+    qint64 count = get<quint32>(data, 107);
+    if (versionMinor >= 4 && headerSize >= HeaderSize && fileSize >= HeaderSize)
+        count = qint64(get<quint64>(data, 247));
+
+    // Divided rather than multiplied, so a corrupt 64-bit count cannot overflow past the check
+    if (count < 0 || qint64(pointOffset) > fileSize || count > (fileSize - qint64(pointOffset)) / recordSize)
+        return fail(QStringLiteral("LAS file is shorter than its header declares"));
+
+    double scale[3];
+    double offset[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        scale[axis] = get<double>(data, 131 + 8 * axis);
+        offset[axis] = get<double>(data, 155 + 8 * axis);
+    }
+
+    const qsizetype pointCount = qsizetype(count);
+    const int colorOffset = ColorOffset[format];
+    const uchar *records = data + pointOffset;
+
+    // The spec asks for 16-bit colours but plenty of writers store 8-bit values;
+    // the first records tell which
+    bool colors16Bit = false;
+    if (colorOffset >= 0) {
+        for (qsizetype i = 0; i < qMin<qsizetype>(pointCount, 65536) && !colors16Bit; ++i) {
+            const uchar *color = records + qint64(i) * recordSize + colorOffset;
+            colors16Bit = get<quint16>(color, 0) > 255 || get<quint16>(color, 2) > 255 || get<quint16>(color, 4) > 255;
+        }
+    }
+
+    points = PointAttributes();
+    points.points.resize(pointCount);
+    points.intensities.resize(pointCount);
+    points.colors.resize(pointCount);   // White for formats without RGB
+
+    // Workers write disjoint ranges through raw pointers taken once, up front
+    QVector3D *positionsOut = points.points.data();
+    float *intensitiesOut = points.intensities.data();
+    PointColor *colorsOut = colorOffset >= 0 ? points.colors.data() : nullptr;
+    const int colorShift = colors16Bit ? 8 : 0;
+
+    auto decode = [&](const QPair<qsizetype, qsizetype> &range) {
+        for (qsizetype i = range.first; i < range.first + range.second; ++i) {
+            const uchar *record = records + qint64(i) * recordSize;
+            positionsOut[i] = QVector3D(float(get<qint32>(record, 0) * scale[0] + offset[0]),
+                                        float(get<qint32>(record, 4) * scale[1] + offset[1]),
+                                        float(get<qint32>(record, 8) * scale[2] + offset[2]));
+            intensitiesOut[i] = float(get<quint16>(record, 12));
+
+            if (colorsOut) {
+                colorsOut[i].r = quint8(qMin(255, get<quint16>(record, colorOffset) >> colorShift));
+                colorsOut[i].g = quint8(qMin(255, get<quint16>(record, colorOffset + 2) >> colorShift));
+                colorsOut[i].b = quint8(qMin(255, get<quint16>(record, colorOffset + 4) >> colorShift));
+            }
+        }
+    };
+
+    QVector<QPair<qsizetype, qsizetype>> chunks;
+    for (qsizetype first = 0; first < pointCount; first += ChunkPoints)
+        chunks.append(qMakePair(first, qMin(ChunkPoints, pointCount - first)));
+
+    // Chunks are decoded in waves a few times wider than the pool so the job can be cancelled in between
+    const qsizetype waveSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * 2);
+    for (qsizetype first = 0; first < chunks.size(); first += waveSize) {
+        if (progress && !progress(static_cast<int>(first * 100 / chunks.size())))
+            return fail(QStringLiteral("Cancelled"));
+
+        QVector<QPair<qsizetype, qsizetype>> wave = chunks.mid(first, waveSize);
+        QtConcurrent::blockingMap(wave, decode);
+    }
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = fileSize;
+        stats->points = pointCount;
+        stats->malformedLines = 0;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef LASFORMAT_H
+#define LASFORMAT_H
+
+#include <QString>
+#include "pointcloud.h"
+#include "ptsparser.h"
+#include "ptswriter.h"
+
+// Reader for uncompressed LAS 1.0-1.4 files with any of point data record
+// formats 0-10. Positions are read in full, along with intensities and, for
+// formats that carry them, RGB colours, with white for the others; other
+// attributes are skipped.
+// Compressed (LAZ) files are rejected.
+class LasReader
+{
+public:
+    using ProgressCallback = PtsParser::ProgressCallback;
+
+    // Sizes the arrays from the point count in the header, then decodes the
+    // mapped records in parallel chunks straight into them
+    static bool readFile(const QString &filename, PointAttributes &points,
+                         const ProgressCallback &progress = ProgressCallback(),
+                         PtsParseStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // Records decoded by one worker at a time
+    static constexpr qsizetype ChunkPoints = 1 << 20;
+};
+
+// Writer for LAS 1.4 files. Points are stored as point data record format 7
+// (with 16-bit RGB) when the cloud has colours and format 6 otherwise, with a
+// scale fine enough to keep the full precision of the float coordinates.
+class LasWriter
+{
+public:
+    using ProgressCallback = PtsWriter::ProgressCallback;
+
+    // Packs records block by block into one reused buffer and writes through a
+    // temporary file, so a failed or cancelled export leaves no partial file
+    static bool writeFile(const QString &filename, const PointAttributes &points,
+                          const ProgressCallback &progress = ProgressCallback(),
+                          PtsWriteStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // Records packed between progress reports
+    static constexpr qsizetype BlockPoints = 65536;
+};
+
+#endif // LASFORMAT_H
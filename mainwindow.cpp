@@ -1,6 +1,10 @@
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "viewfrustum.h"
+#include "plyformat.h"
+#include "lasformat.h"
+#include "pointstatistics.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QMenu>
@@ -10,18 +14,35 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QFile>
-#include <QTextStream>
 #include <QDebug>
 #include <QMatrix4x4>
 #include <QtMath>
 #include <QMouseEvent>
 #include <QOpenGLShader>
+#include <QOpenGLContext>
 #include <QProgressDialog>
 #include <QCheckBox>
 #include <QLabel>
 #include <QSlider>
 #include <QPushButton>
 #include <QColorDialog>
+#include <QTimer>
+#include <QActionGroup>
+#include <QPainter>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QSpinBox>
+#include <QComboBox>
+#include <QFormLayout>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
 
 unsigned MainWindow::s_viewportIndex = 0;
 
@@ -39,14 +60,30 @@ PointCloudGLWidget::PointCloudGLWidget(QWidget *parent)
     , m_renderMode(POINTS)
 {
     setFocusPolicy(Qt::StrongFocus);
+
+    // Full detail returns once the camera has been still for a moment
+    m_refineTimer = new QTimer(this);
+    m_refineTimer->setSingleShot(true);
+    m_refineTimer->setInterval(250);
+    connect(m_refineTimer, &QTimer::timeout, this, [this]() {
+        m_interacting = false;
+        update();
+    });
+
+    connect(this, &QOpenGLWidget::frameSwapped, this, &PointCloudGLWidget::onFrameSwapped);
 }
 
 PointCloudGLWidget::~PointCloudGLWidget()
 {
     makeCurrent();
-    m_vbo.destroy();
-    m_vao.destroy();
+    releaseAllGpuBuffers();
+    releasePickTargets();
+    m_overlay.release();
+    if (m_gpuTiming)
+        glDeleteQueries(GpuTimerQueries, m_gpuTimerQueries);
     delete m_program;
+    delete m_pickProgram;
+    delete m_meshProgram;
     doneCurrent();
 }
 
@@ -56,6 +93,44 @@ void PointCloudGLWidget::setPointSize(float size)
     update();
 }
 
+void PointCloudGLWidget::setPointBudget(qint64 points)
+{
+    m_pointBudget = qMax<qint64>(0, points);
+    update();
+}
+
+void PointCloudGLWidget::setTargetFrameTime(double milliseconds)
+{
+    m_targetFrameTime = qMax(0.0, milliseconds);
+}
+
+void PointCloudGLWidget::beginInteraction()
+{
+    m_interacting = true;
+    m_refineTimer->start();
+    update();
+}
+
+void PointCloudGLWidget::onFrameSwapped()
+{
+    // Time from the start of paintGL() until the frame reached the screen
+    m_renderStats.frameTimeMs = m_frameTimer.nsecsElapsed() / 1.0e6;
+
+    if (m_renderStats.interactive && m_renderStats.frameTimeMs > 0.0) {
+        // Scale the interactive budget towards the target, damped so one slow frame does not halve the detail twice
+        const double scale = qBound(0.5, m_targetFrameTime / m_renderStats.frameTimeMs, 2.0);
+        qint64 budget = qint64(m_interactionBudget * scale);
+
+        // Do not grow past what the scene can use, or past the full-detail budget
+        budget = qMin(budget, qMax(MinInteractionBudget, m_renderStats.pointsDrawn * 2));
+        if (m_pointBudget > 0)
+            budget = qMin(budget, m_pointBudget);
+        m_interactionBudget = qMax(MinInteractionBudget, budget);
+    }
+
+    emit frameRendered(m_renderStats);
+}
+
 void PointCloudGLWidget::setRenderMode(RenderMode mode)
 {
     m_renderMode = mode;
@@ -73,10 +148,53 @@ void PointCloudGLWidget::initializeGL()
     glEnable(GL_POINT_SMOOTH);
     glHint(GL_POINT_SMOOTH_HINT, GL_NICEST);
 
-    m_vao.create();
-    m_vbo.create();
-
     initShaders();
+    m_overlay.initialize();
+
+    // Timer queries are core from desktop OpenGL 3.3 on; without them gpuTimeMs stays -1.
+    // The 64-bit result getter is not in QOpenGLExtraFunctions, so it is resolved here
+    QOpenGLContext *glContext = context();
+    m_gpuTiming = !glContext->isOpenGLES()
+                  && (glContext->format().version() >= qMakePair(3, 3) || glContext->hasExtension("GL_ARB_timer_query"));
+    if (m_gpuTiming) {
+        m_getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64v>(glContext->getProcAddress("glGetQueryObjectui64v"));
+        m_gpuTiming = m_getQueryObjectui64v != nullptr;
+    }
+    if (m_gpuTiming)
+        glGenQueries(GpuTimerQueries, m_gpuTimerQueries);
+}
+
+void PointCloudGLWidget::beginGpuTimer(RenderStats& stats)
+{
+    if (!m_gpuTiming)
+        return;
+
+    // Results come back in the order the queries were issued; take the oldest if it is in
+    if (m_gpuTimersRead < m_gpuTimersIssued) {
+        const GLuint query = m_gpuTimerQueries[m_gpuTimersRead % GpuTimerQueries];
+        GLuint available = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            // A 32-bit read would wrap for frames longer than about 4.3 s
+            GLuint64 nanoseconds = 0;
+            m_getQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            stats.gpuTimeMs = nanoseconds / 1.0e6;
+            ++m_gpuTimersRead;
+        }
+    }
+
+    // With every query still in flight the oldest is reused and its result dropped
+    if (m_gpuTimersIssued - m_gpuTimersRead == GpuTimerQueries)
+        ++m_gpuTimersRead;
+
+    glBeginQuery(GL_TIME_ELAPSED, m_gpuTimerQueries[m_gpuTimersIssued % GpuTimerQueries]);
+    ++m_gpuTimersIssued;
+}
+
+void PointCloudGLWidget::endGpuTimer()
+{
+    if (m_gpuTiming)
+        glEndQuery(GL_TIME_ELAPSED);
 }
 
 void PointCloudGLWidget::initShaders()
@@ -86,7 +204,8 @@ void PointCloudGLWidget::initShaders()
     const char *vertexShaderSource = R"(
         #version 330 core
         layout (location = 0) in vec3 position;
-        layout (location = 1) in vec3 color;
+        layout (location = 1) in vec4 color;
+        layout (location = 2) in float selected;
 
         uniform mat4 model;
         uniform mat4 view;
@@ -100,7 +219,7 @@ void PointCloudGLWidget::initShaders()
         {
             gl_Position = projection * view * model * vec4(position, 1.0);
             gl_PointSize = pointSize;
-            vertexColor = color * (tintColor / 255.0);
+            vertexColor = mix(color.rgb * (tintColor / 255.0), vec3(1.0, 0.8, 0.0), selected);
         }
     )";
 
@@ -131,22 +250,121 @@ void PointCloudGLWidget::initShaders()
     m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
     m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
     m_program->link();
+
+    // The id pass writes the entity id and 1 + the vertex index, so zero means nothing was drawn
+    const char *pickVertexShaderSource = R"(
+        #version 330 core
+        layout (location = 0) in vec3 position;
+
+        uniform mat4 model;
+        uniform mat4 view;
+        uniform mat4 projection;
+        uniform float pointSize;
+        uniform bool hasPointIndex;
+
+        flat out uint pointId;
+
+        void main()
+        {
+            gl_Position = projection * view * model * vec4(position, 1.0);
+            gl_PointSize = pointSize;
+            pointId = hasPointIndex ? uint(gl_VertexID) + 1u : 0u;
+        }
+    )";
+
+    const char *pickFragmentShaderSource = R"(
+        #version 330 core
+        flat in uint pointId;
+        out uvec2 ids;
+
+        uniform uint entityId;
+
+        void main()
+        {
+            ids = uvec2(entityId, pointId);
+        }
+    )";
+
+    m_pickProgram = new QOpenGLShaderProgram();
+    m_pickProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, pickVertexShaderSource);
+    m_pickProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, pickFragmentShaderSource);
+    m_pickProgram->link();
+
+    // Meshes are lit from the camera, on both sides, so open CAD shells read from any angle
+    const char *meshVertexShaderSource = R"(
+        #version 330 core
+        layout (location = 0) in vec3 position;
+        layout (location = 1) in vec3 normal;
+
+        uniform mat4 model;
+        uniform mat4 view;
+        uniform mat4 projection;
+        uniform vec3 diffuse;
+        uniform vec3 tintColor;
+
+        out vec3 viewNormal;
+        out vec3 surfaceColor;
+
+        void main()
+        {
+            gl_Position = projection * view * model * vec4(position, 1.0);
+            viewNormal = mat3(view * model) * normal;
+            surfaceColor = diffuse * (tintColor / 255.0);
+        }
+    )";
+
+    const char *meshFragmentShaderSource = R"(
+        #version 330 core
+        in vec3 viewNormal;
+        in vec3 surfaceColor;
+        out vec4 fragColor;
+
+        uniform bool hasNormals;
+
+        void main()
+        {
+            float light = hasNormals ? 0.25 + 0.75 * abs(normalize(viewNormal).z) : 1.0;
+            fragColor = vec4(surfaceColor * light, 1.0);
+        }
+    )";
+
+    m_meshProgram = new QOpenGLShaderProgram();
+    m_meshProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, meshVertexShaderSource);
+    m_meshProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, meshFragmentShaderSource);
+    m_meshProgram->link();
 }
 
-void PointCloudGLWidget::loadMesh(const QVector<QVector3D>& vertices, const QVector<unsigned int>& indices)
+void PointCloudGLWidget::paintGL()
 {
-    m_meshVertices = vertices;
-    m_meshIndices = indices;
-    m_hasMesh = true;
-    update();
+    m_frameTimer.start();
+
+    RenderStats timing;
+    beginGpuTimer(timing);
+    renderScene();
+    endGpuTimer();
+
+    m_renderStats.cpuTimeMs = m_frameTimer.nsecsElapsed() / 1.0e6;
+    m_renderStats.gpuTimeMs = timing.gpuTimeMs;
 }
 
-void PointCloudGLWidget::paintGL()
+void PointCloudGLWidget::renderScene()
 {
+    resolvePick();
+
+    // QPainter, used for the selection outline, leaves its own state behind
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glDisable(GL_BLEND);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (m_pointClouds.isEmpty())
+    if (!m_scene || m_scene->isEmpty()) {
+        m_renderStats = RenderStats();
+        if (m_pickState == PickState::Requested) {
+            m_pickState = PickState::Idle;
+            deliverPick(0, -1);
+        }
         return;
+    }
 
     m_view.setToIdentity();
     m_view.translate(0.0f, 0.0f, -m_distance);
@@ -158,332 +376,1308 @@ void PointCloudGLWidget::paintGL()
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
 
-    for (auto it = m_pointClouds.constBegin(); it != m_pointClouds.constEnd(); ++it) {
-        const QString& name = it.key();
-        const PointCloud& pc = it.value();
+    // While the camera moves, draw only as many points as fit the target frame time
+    RenderStats stats;
+    stats.interactive = m_interacting && m_targetFrameTime > 0.0;
 
-        if (pc.isVisible && !pc.points.isEmpty()) {
-            renderPointCloud(pc);
-        }
+    qint64 budget = m_pointBudget;
+    if (stats.interactive)
+        budget = m_pointBudget > 0 ? qMin(m_pointBudget, m_interactionBudget) : m_interactionBudget;
+
+    const QHash<EntityId, QVector<DrawRange>> selection = selectDrawRanges(budget, stats);
+
+    // Entities without a selection are hidden or entirely out of view
+    for (EntityId id : m_scene->entityIds()) {
+        auto ranges = selection.constFind(id);
+        if (ranges != selection.constEnd())
+            renderPointCloud(id, *m_scene->cloud(id), &ranges.value());
     }
 
-    if (m_showBoundingBox && !m_selectedEntityForBoundingBox.isEmpty() && m_pointClouds.contains(m_selectedEntityForBoundingBox)) {
-        const PointCloud& pc = m_pointClouds[m_selectedEntityForBoundingBox];
-        glLineWidth(2.0f);
-        glColor3f(1.0f, 0.0f, 0.0f);
-        glBegin(GL_LINE_LOOP);
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMin.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMin.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMax.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMax.y(), pc.boundingBoxMin.z());
-        glEnd();
-        glBegin(GL_LINE_LOOP);
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMin.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMin.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMax.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMax.y(), pc.boundingBoxMax.z());
-        glEnd();
-        glBegin(GL_LINES);
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMin.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMin.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMin.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMin.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMax.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMax.x(), pc.boundingBoxMax.y(), pc.boundingBoxMax.z());
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMax.y(), pc.boundingBoxMin.z());
-        glVertex3f(pc.boundingBoxMin.x(), pc.boundingBoxMax.y(), pc.boundingBoxMax.z());
-        glEnd();
+    renderMeshes(stats);
+    renderPrimitives(stats);
+
+    // Out-of-core clouds get whatever budget the resident clouds left
+    m_outOfCoreDraws.clear();
+    renderOutOfCoreClouds(budget > 0 ? qMax<qint64>(1, budget - stats.pointsDrawn) : 0, stats);
+
+    // The id pass draws exactly what this frame drew, so the pick matches the picture
+    if (m_pickState == PickState::Requested)
+        renderPickPass(selection);
+
+    // Every box and gizmo goes out in one instanced draw
+    if (m_overlayDirty)
+        rebuildOverlays();
+    if (!m_overlay.isEmpty()) {
+        m_overlay.render(m_projection * m_view * m_model);
+        ++stats.drawCalls;
     }
 
     if (m_renderMode == POINTS_SMOOTH) {
         glDisable(GL_BLEND);
     }
 
-    if (m_hasMesh && !m_meshVertices.isEmpty() && !m_meshIndices.isEmpty()) {
-        glColor3f(0.7f, 0.7f, 0.9f);
-        glBegin(GL_TRIANGLES);
-        for (int i = 0; i + 2 < m_meshIndices.size(); i += 3) {
-            const QVector3D& v1 = m_meshVertices[m_meshIndices[i]];
-            const QVector3D& v2 = m_meshVertices[m_meshIndices[i + 1]];
-            const QVector3D& v3 = m_meshVertices[m_meshIndices[i + 2]];
-            glVertex3f(v1.x(), v1.y(), v1.z());
-            glVertex3f(v2.x(), v2.y(), v2.z());
-            glVertex3f(v3.x(), v3.y(), v3.z());
-        }
-        glEnd();
-    }
+    m_renderStats = stats;
+
+    if (m_selecting)
+        drawSelectionOutline();
 }
 
-void PointCloudGLWidget::renderPointCloud(const PointCloud& pc)
+void PointCloudGLWidget::rebuildOverlays()
 {
-    if (pc.points.isEmpty())
-        return;
+    m_overlay.clear();
+    m_overlayDirty = false;
 
-    m_program->bind();
-    m_program->setUniformValue("model", m_model);
-    m_program->setUniformValue("view", m_view);
-    m_program->setUniformValue("projection", m_projection);
-    m_program->setUniformValue("pointSize", pc.pointSize);
-    m_program->setUniformValue("smoothPoints", m_renderMode == POINTS_SMOOTH);
+    static const PointColor primaryColor = { 255, 0, 0, 255 };
+    static const PointColor secondaryColor = { 255, 160, 0, 255 };
+    static const PointColor extraColor = { 0, 200, 255, 255 };
 
-    QVector3D tintColor(pc.tintColor.red(), pc.tintColor.green(), pc.tintColor.blue());
-    m_program->setUniformValue("tintColor", tintColor);
+    for (int i = 0; i < m_selectedEntities.size(); ++i) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(m_selectedEntities[i]);
+        if (!pc || pc->boundingBoxMin.x() > pc->boundingBoxMax.x())
+            continue;
 
-    m_vao.bind();
-    m_vbo.bind();
+        m_overlay.addBox(pc->boundingBoxMin, pc->boundingBoxMax, i == 0 ? primaryColor : secondaryColor);
 
-    QVector<GLfloat> vertexData;
-    vertexData.reserve(pc.points.size() * 6);
-    for (int i = 0; i < pc.points.size(); ++i)
-    {
-        vertexData.append(pc.points[i].x());
-        vertexData.append(pc.points[i].y());
-        vertexData.append(pc.points[i].z());
-        vertexData.append(pc.colors[i].x() / 255.0f);
-        vertexData.append(pc.colors[i].y() / 255.0f);
-        vertexData.append(pc.colors[i].z() / 255.0f);
+        // The gizmo reaches from the centre of the primary selection to its faces
+        if (i == 0) {
+            const QVector3D extent = pc->boundingBoxMax - pc->boundingBoxMin;
+            const float length = 0.5f * qMax(qMax(extent.x(), extent.y()), extent.z());
+            m_overlay.addAxes((pc->boundingBoxMin + pc->boundingBoxMax) * 0.5f, length);
+        }
     }
-    m_vbo.allocate(vertexData.constData(), vertexData.size() * sizeof(GLfloat));
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void*>(3 * sizeof(GLfloat)));
+    if (m_showExtraBox)
+        m_overlay.addBox(m_extraBoxMin, m_extraBoxMax, extraColor);
+}
+
+void PointCloudGLWidget::renderMeshes(RenderStats& stats)
+{
+    const ViewFrustum frustum(m_projection * m_view * m_model);
+    bool bound = false;
+
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+        if (pc->meshes.isEmpty() || !pc->isVisible)
+            continue;
+
+        // Meshes only ever arrive, so anything past what is resident is new
+        QVector<GpuMesh*> &meshes = m_gpuMeshes[id];
+        while (meshes.size() < pc->meshes.size())
+            meshes.append(uploadMesh(pc->meshes[meshes.size()]));
+
+        if (!bound) {
+            m_meshProgram->bind();
+            m_meshProgram->setUniformValue("model", m_model);
+            m_meshProgram->setUniformValue("view", m_view);
+            m_meshProgram->setUniformValue("projection", m_projection);
+            bound = true;
+        }
+        m_meshProgram->setUniformValue("tintColor", QVector3D(pc->tintColor.red(), pc->tintColor.green(), pc->tintColor.blue()));
 
-    glDrawArrays(GL_POINTS, 0, pc.points.size());
+        for (GpuMesh *mesh : meshes) {
+            if (frustum.classify(mesh->boundsMin, mesh->boundsMax) == ViewFrustum::Outside)
+                continue;
 
-    m_vbo.release();
-    m_vao.release();
-    m_program->release();
+            m_meshProgram->setUniformValue("diffuse", mesh->diffuse);
+            m_meshProgram->setUniformValue("hasNormals", mesh->hasNormals);
+            mesh->vao.bind();
+            glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, nullptr);
+            mesh->vao.release();
 
-    if (!pc.polygons.isEmpty()) {
-        m_program->bind();
-        m_program->setUniformValue("model", m_model);
-        m_program->setUniformValue("view", m_view);
-        m_program->setUniformValue("projection", m_projection);
-        m_program->setUniformValue("pointSize", 1.0f);
-        m_program->setUniformValue("smoothPoints", false);
-        m_program->setUniformValue("tintColor", tintColor);
-
-        QOpenGLVertexArrayObject triangleVAO;
-        triangleVAO.create();
-        triangleVAO.bind();
-
-        QOpenGLBuffer triangleVBO(QOpenGLBuffer::VertexBuffer);
-        triangleVBO.create();
-        triangleVBO.bind();
-
-        QVector<GLfloat> triangleData;
-        int totalVertices = 0;
-        for (const auto& polygon : pc.polygons) {
-            totalVertices += polygon.size();
-        }
-        triangleData.reserve(totalVertices * 6);
-
-        for (int i = 0; i < pc.polygons.size(); ++i) {
-            const QVector<QVector3D>& triangle = pc.polygons[i];
-            const QVector<QVector3D>& triangleColor = pc.polygonColors[i];
-
-            for (int j = 0; j < triangle.size(); ++j) {
-                triangleData.append(triangle[j].x());
-                triangleData.append(triangle[j].y());
-                triangleData.append(triangle[j].z());
-                QVector3D color = triangleColor[j];
-                triangleData.append(color.x() / 255.0f);
-                triangleData.append(color.y() / 255.0f);
-                triangleData.append(color.z() / 255.0f);
-            }
+            ++stats.drawCalls;
+            stats.trianglesDrawn += mesh->indexCount / 3;
         }
+    }
 
-        triangleVBO.allocate(triangleData.constData(), triangleData.size() * sizeof(GLfloat));
+    if (bound)
+        m_meshProgram->release();
+}
 
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
+PointCloudGLWidget::GpuMesh* PointCloudGLWidget::uploadMesh(const MeshPart& mesh)
+{
+    GpuMesh *gpuMesh = new GpuMesh;
+    gpuMesh->indexCount = mesh.indices.size();
+    gpuMesh->hasNormals = mesh.normals.size() == mesh.vertices.size();
+    gpuMesh->diffuse = QVector3D(mesh.diffuse.r, mesh.diffuse.g, mesh.diffuse.b) / 255.0f;
+
+    gpuMesh->boundsMin = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    gpuMesh->boundsMax = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    PointStatistics::growBounds(mesh.vertices.constData(), mesh.vertices.size(), gpuMesh->boundsMin, gpuMesh->boundsMax);
+
+    const int positionBytes = mesh.vertices.size() * int(sizeof(QVector3D));
+    const int normalBytes = gpuMesh->hasNormals ? positionBytes : 0;
+
+    gpuMesh->vao.create();
+    gpuMesh->vao.bind();
+
+    gpuMesh->vbo.create();
+    gpuMesh->vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    gpuMesh->vbo.bind();
+    gpuMesh->vbo.allocate(positionBytes + normalBytes);
+    gpuMesh->vbo.write(0, mesh.vertices.constData(), positionBytes);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), nullptr);
+    if (gpuMesh->hasNormals) {
+        gpuMesh->vbo.write(positionBytes, mesh.normals.constData(), normalBytes);
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void*>(3 * sizeof(GLfloat)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), reinterpret_cast<void*>(qintptr(positionBytes)));
+    }
 
-        glDrawArrays(GL_TRIANGLES, 0, totalVertices);
+    // The element buffer binding is part of the VAO, so it stays bound until the VAO is released
+    gpuMesh->ebo.create();
+    gpuMesh->ebo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    gpuMesh->ebo.bind();
+    gpuMesh->ebo.allocate(mesh.indices.constData(), mesh.indices.size() * int(sizeof(quint32)));
 
-        triangleVBO.release();
-        triangleVAO.release();
-        m_program->release();
+    gpuMesh->vao.release();
+    gpuMesh->vbo.release();
+    return gpuMesh;
+}
+
+void PointCloudGLWidget::renderPrimitives(RenderStats& stats)
+{
+    bool bound = false;
+
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+        if ((pc->polygons.isEmpty() && pc->lines.isEmpty()) || !pc->isVisible)
+            continue;
+
+        GpuPrimitiveBuffer *buffer = m_gpuPrimitives.value(id, nullptr);
+        if (!buffer) {
+            buffer = new GpuPrimitiveBuffer;
+            m_gpuPrimitives.insert(id, buffer);
+        }
+        if (buffer->dirty)
+            uploadPrimitives(buffer, *pc);
+
+        if (!bound) {
+            m_program->bind();
+            m_program->setUniformValue("model", m_model);
+            m_program->setUniformValue("view", m_view);
+            m_program->setUniformValue("projection", m_projection);
+            m_program->setUniformValue("pointSize", 1.0f);
+            m_program->setUniformValue("smoothPoints", false);
+            bound = true;
+        }
+        m_program->setUniformValue("tintColor", QVector3D(pc->tintColor.red(), pc->tintColor.green(), pc->tintColor.blue()));
+
+        // Triangle indices come first in the element buffer, then the line segments
+        buffer->vao.bind();
+        if (buffer->triangleIndexCount > 0) {
+            glDrawElements(GL_TRIANGLES, buffer->triangleIndexCount, GL_UNSIGNED_INT, nullptr);
+            stats.trianglesDrawn += buffer->triangleIndexCount / 3;
+            ++stats.drawCalls;
+        }
+        if (buffer->lineIndexCount > 0) {
+            glDrawElements(GL_LINES, buffer->lineIndexCount, GL_UNSIGNED_INT,
+                           reinterpret_cast<void*>(qintptr(buffer->triangleIndexCount) * qintptr(sizeof(quint32))));
+            ++stats.drawCalls;
+        }
+        buffer->vao.release();
     }
+
+    if (bound)
+        m_program->release();
 }
 
-void PointCloudGLWidget::resizeGL(int width, int height)
+void PointCloudGLWidget::uploadPrimitives(GpuPrimitiveBuffer* buffer, const PointCloud& pc)
 {
-    float aspect = width / static_cast<float>(height);
-    m_projection.setToIdentity();
-    m_projection.perspective(m_fov, aspect, 0.01f, 1000.0f);
-    update();
+    // Polygon vertices are followed by line vertices, so line indices are offset by the polygon vertex count
+    const qsizetype polygonVertices = pc.polygons.vertices.size();
+    const qsizetype vertexCount = polygonVertices + pc.lines.vertices.size();
+
+    QVector<quint32> indices;
+    indices.reserve(3 * polygonVertices + 2 * pc.lines.vertices.size());
+    for (qsizetype i = 0; i < pc.polygons.count(); ++i) {
+        const quint32 first = pc.polygons.offsets[i];
+        for (quint32 v = first + 1; v + 1 < pc.polygons.offsets[i + 1]; ++v)
+            indices.append({ first, v, v + 1 });
+    }
+    buffer->triangleIndexCount = int(indices.size());
+
+    for (qsizetype i = 0; i < pc.lines.count(); ++i) {
+        const quint32 first = quint32(polygonVertices) + pc.lines.offsets[i];
+        const quint32 end = quint32(polygonVertices) + pc.lines.offsets[i + 1];
+        for (quint32 v = first; v + 1 < end; ++v)
+            indices.append({ v, v + 1 });
+    }
+    buffer->lineIndexCount = int(indices.size()) - buffer->triangleIndexCount;
+
+    const int positionBytes = int(vertexCount * qsizetype(sizeof(QVector3D)));
+    const int colorBytes = int(vertexCount * qsizetype(sizeof(PointColor)));
+    const int polygonPositionBytes = int(polygonVertices * qsizetype(sizeof(QVector3D)));
+    const int polygonColorBytes = int(polygonVertices * qsizetype(sizeof(PointColor)));
+
+    if (!buffer->vao.isCreated()) {
+        buffer->vao.create();
+        buffer->vbo.create();
+        buffer->vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        buffer->ebo.create();
+        buffer->ebo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    }
+
+    buffer->vao.bind();
+    buffer->vbo.bind();
+    buffer->vbo.allocate(positionBytes + colorBytes);
+    buffer->vbo.write(0, pc.polygons.vertices.constData(), polygonPositionBytes);
+    buffer->vbo.write(polygonPositionBytes, pc.lines.vertices.constData(), positionBytes - polygonPositionBytes);
+    buffer->vbo.write(positionBytes, pc.polygons.colors.constData(), polygonColorBytes);
+    buffer->vbo.write(positionBytes + polygonColorBytes, pc.lines.colors.constData(), colorBytes - polygonColorBytes);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointColor), reinterpret_cast<void*>(qintptr(positionBytes)));
+
+    // The element buffer binding is part of the VAO, so it stays bound until the VAO is released
+    buffer->ebo.bind();
+    buffer->ebo.allocate(indices.constData(), int(indices.size() * qsizetype(sizeof(quint32))));
+
+    buffer->vao.release();
+    buffer->vbo.release();
+    buffer->dirty = false;
 }
 
-void PointCloudGLWidget::setPointClouds(const QMap<QString, PointCloud>& pointClouds)
+void PointCloudGLWidget::releaseGpuPrimitives(EntityId id)
 {
-    m_pointClouds = pointClouds;
-    update();
+    GpuPrimitiveBuffer *buffer = m_gpuPrimitives.take(id);
+    if (!buffer)
+        return;
+
+    buffer->ebo.destroy();
+    buffer->vbo.destroy();
+    buffer->vao.destroy();
+    delete buffer;
 }
 
-void PointCloudGLWidget::updatePointCloudVisibility(const QString& name, bool visible)
+void PointCloudGLWidget::releaseGpuMeshes(EntityId id)
 {
-    if (m_pointClouds.contains(name)) {
-        m_pointClouds[name].isVisible = visible;
-        update();
+    const QVector<GpuMesh*> meshes = m_gpuMeshes.take(id);
+    for (GpuMesh *mesh : meshes) {
+        mesh->ebo.destroy();
+        mesh->vbo.destroy();
+        mesh->vao.destroy();
+        delete mesh;
     }
 }
 
-void PointCloudGLWidget::calculateSceneExtents(QVector3D& min, QVector3D& max)
+void PointCloudGLWidget::drawSelectionOutline()
 {
-    min = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-    max = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
-
-    bool foundVisiblePoints = false;
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(QColor(255, 204, 0), 1, Qt::DashLine));
+    painter.setBrush(QColor(255, 204, 0, 40));
 
-    for (const auto& pc : m_pointClouds) {
-        if (pc.isVisible && !pc.points.isEmpty()) {
-            for (const auto& point : pc.points) {
-                min.setX(qMin(min.x(), point.x()));
-                min.setY(qMin(min.y(), point.y()));
-                min.setZ(qMin(min.z(), point.z()));
+    if (m_selectionTool == SelectionTool::Rectangle && m_selectionOutline.size() == 2)
+        painter.drawRect(QRect(m_selectionOutline[0], m_selectionOutline[1]).normalized());
+    else
+        painter.drawPolygon(m_selectionOutline);
+}
 
-                max.setX(qMax(max.x(), point.x()));
-                max.setY(qMax(max.y(), point.y()));
-                max.setZ(qMax(max.z(), point.z()));
-            }
-            foundVisiblePoints = true;
-        }
+PointCloudGLWidget::GpuPointBuffer* PointCloudGLWidget::gpuBufferFor(EntityId id, const PointCloud& pc)
+{
+    GpuPointBuffer *buffer = m_gpuBuffers.value(id, nullptr);
+    if (!buffer) {
+        buffer = new GpuPointBuffer;
+        buffer->vao.create();
+        buffer->vbo.create();
+        m_gpuBuffers.insert(id, buffer);
     }
 
-    if (!foundVisiblePoints) {
-        min = QVector3D(-1.0f, -1.0f, -1.0f);
-        max = QVector3D(1.0f, 1.0f, 1.0f);
+    if (buffer->dirty || buffer->appendPending) {
+        const int firstPoint = buffer->dirty ? 0 : buffer->vertexCount;
+        uploadPointCloud(buffer, pc, firstPoint);
+
+        // New or reordered points need their selection flags written as well
+        markSelectionDirty(buffer, firstPoint, pc.points.size());
     }
+
+    if (buffer->selectionDirtyEnd > buffer->selectionDirtyFirst)
+        uploadSelection(buffer, m_scene->selection(id));
+
+    return buffer;
 }
 
-void PointCloudGLWidget::resetView()
+void PointCloudGLWidget::markSelectionDirty(GpuPointBuffer* buffer, qsizetype first, qsizetype end)
 {
-    m_xRot = 30.0f; // Increased from 15.0f
-    m_yRot = 40.0f; // Increased from 15.0f
-    m_distance = 5.0f;
-    m_fov = 30.0f; // Changed from 45.0f
-    m_focalDistance = 0.5f;
-
-    QVector3D min, max;
-    calculateSceneExtents(min, max);
+    if (end <= first)
+        return;
 
-    QVector3D center = (min + max) * 0.5f;
-    QVector3D size = max - min;
+    if (buffer->selectionDirtyEnd > buffer->selectionDirtyFirst) {
+        buffer->selectionDirtyFirst = qMin(buffer->selectionDirtyFirst, first);
+        buffer->selectionDirtyEnd = qMax(buffer->selectionDirtyEnd, end);
+    } else {
+        buffer->selectionDirtyFirst = first;
+        buffer->selectionDirtyEnd = end;
+    }
+}
 
-    // Increase the distance multiplier from 0.8f to 2.0f
-    float sceneSize = size.length();
-    m_distance = sceneSize * 2.0f;
+void PointCloudGLWidget::uploadSelection(GpuPointBuffer* buffer, const PointSelection& selection)
+{
+    if (!buffer->selectionVbo.isCreated()) {
+        // Until an entity is first selected the attribute stays disabled, which reads as unselected
+        if (selection.isEmpty()) {
+            buffer->selectionDirtyFirst = buffer->selectionDirtyEnd = 0;
+            return;
+        }
+        buffer->selectionVbo.create();
+    }
 
-    // Decrease scale value to show more of the scene - change from 1.5f to 1.0f
-    float scale = 1.0f / qMax(qMax(size.x(), size.y()), size.z());
+    buffer->vao.bind();
+    buffer->selectionVbo.bind();
+
+    // Follows the capacity of the position buffer; fresh storage is written in full
+    if (buffer->selectionCapacity != buffer->capacity) {
+        buffer->selectionCapacity = buffer->capacity;
+        buffer->selectionVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+        buffer->selectionVbo.allocate(buffer->selectionCapacity);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_TRUE, 1, nullptr);
+        buffer->selectionDirtyFirst = 0;
+        buffer->selectionDirtyEnd = buffer->vertexCount;
+    }
 
-    m_model.setToIdentity();
-    m_model.scale(scale);
-    m_model.translate(-center);
+    const qsizetype first = buffer->selectionDirtyFirst;
+    const qsizetype end = qMin<qsizetype>(buffer->selectionDirtyEnd, buffer->vertexCount);
+    if (end > first) {
+        m_selectionScratch.resize(end - first);
+        selection.expand(first, end, m_selectionScratch.data());
+        buffer->selectionVbo.write(int(first), m_selectionScratch.constData(), int(end - first));
+    }
 
-    update();
+    buffer->vao.release();
+    buffer->selectionVbo.release();
+    buffer->selectionDirtyFirst = buffer->selectionDirtyEnd = 0;
 }
 
-
-void PointCloudGLWidget::setFocusOnPointCloud(const QString& name, const QVector3D& min, const QVector3D& max)
+void PointCloudGLWidget::uploadPointCloud(GpuPointBuffer* buffer, const PointAttributes& pc, int firstPoint)
 {
-    if (!m_pointClouds.contains(name))
-        return;
+    const int pointCount = pc.points.size();
 
-    const PointCloud &pc = m_pointClouds[name];
-    if (pc.points.isEmpty())
-        return;
+    buffer->vao.bind();
+    buffer->vbo.bind();
 
-    // Calculate bounding box center and size
-    QVector3D center = (min + max) * 0.5f;
-    QVector3D size = max - min;
-    float sceneSize = size.length();
+    // Positions and colours live in two blocks of one buffer, copied straight from the host arrays
+    if (firstPoint > pointCount || pointCount > buffer->capacity) {
+        // A full upload sizes the buffer exactly; growth while streaming doubles it
+        buffer->capacity = buffer->dirty ? pointCount : qMax(pointCount, buffer->capacity * 2);
+        // Sized through GL directly: QOpenGLBuffer takes int byte counts, which overflow past ~134M points
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(qint64(buffer->capacity) * qint64(sizeof(QVector3D) + sizeof(PointColor))),
+                     nullptr, GL_STATIC_DRAW);
+        firstPoint = 0;
 
-    // Increase the distance multiplier from 0.8f to 2.0f for a more zoomed-out view
-    float cameraDistance = sceneSize * 4.0f;
-    m_distance = cameraDistance;
+        // The attribute layout is recorded in the VAO, so drawing later only needs a bind
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), nullptr);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointColor),
+                              reinterpret_cast<void*>(qintptr(buffer->capacity) * qintptr(sizeof(QVector3D))));
+    }
 
-    m_view.setToIdentity();
-    m_view.lookAt(
-        center + QVector3D(0.0f, 0.0f, cameraDistance), // Camera position
-        center,                                        // Look-at point
-        QVector3D(0.0f, 1.0f, 0.0f)                    // Up vector
-        );
+    const int newPoints = pointCount - firstPoint;
+    if (newPoints > 0) {
+        const qint64 colorBlock = qint64(buffer->capacity) * qint64(sizeof(QVector3D));
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(qint64(firstPoint) * qint64(sizeof(QVector3D))),
+                        GLsizeiptr(qint64(newPoints) * qint64(sizeof(QVector3D))), pc.points.constData() + firstPoint);
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(colorBlock + qint64(firstPoint) * qint64(sizeof(PointColor))),
+                        GLsizeiptr(qint64(newPoints) * qint64(sizeof(PointColor))), pc.colors.constData() + firstPoint);
+    }
 
-    // Adjust FOV for better perspective - change from 45.0f to 40.0f for less distortion
-    m_fov = 30.0f;
-    m_focalDistance = sceneSize * 1.5f;
+    buffer->vao.release();
+    buffer->vbo.release();
 
-    float aspect = width() / static_cast<float>(height());
-    float nearPlane = qMax(0.01f, sceneSize * 0.01f);
-    float farPlane = sceneSize * 20.0f; // Increased from 10.0f to 20.0f for better depth visibility
+    buffer->vertexCount = pointCount;
+    buffer->dirty = false;
+    buffer->appendPending = false;
+}
 
-    m_projection.setToIdentity();
-    m_projection.perspective(m_fov, aspect, nearPlane, farPlane);
+void PointCloudGLWidget::setScene(SceneStore *scene)
+{
+    if (m_scene)
+        disconnect(m_scene, nullptr, this, nullptr);
+
+    m_scene = scene;
+
+    if (m_scene) {
+        connect(m_scene, &SceneStore::dataChanged, this, &PointCloudGLWidget::onEntityDataChanged);
+        connect(m_scene, &SceneStore::pointsAppended, this, &PointCloudGLWidget::onEntityPointsAppended);
+        connect(m_scene, &SceneStore::meshAppended, this, &PointCloudGLWidget::onEntityMeshAppended);
+        connect(m_scene, &SceneStore::entityRemoved, this, &PointCloudGLWidget::onEntityRemoved);
+        connect(m_scene, &SceneStore::selectionChanged, this, &PointCloudGLWidget::onEntitySelectionChanged);
+
+        // Property changes only need a repaint; the buffers stay as they are
+        connect(m_scene, &SceneStore::entityAdded, this, qOverload<>(&PointCloudGLWidget::update));
+        connect(m_scene, &SceneStore::visibilityChanged, this, qOverload<>(&PointCloudGLWidget::update));
+        connect(m_scene, &SceneStore::tintColorChanged, this, qOverload<>(&PointCloudGLWidget::update));
+        connect(m_scene, &SceneStore::pointSizeChanged, this, qOverload<>(&PointCloudGLWidget::update));
+    }
 
-    // Decrease scale value to show more of the scene - change from 1.5f to 1.0f
-    float scale = 1.0f / qMax(qMax(size.x(), size.y()), size.z());
-    m_model.setToIdentity();
-    m_model.scale(scale);
-    m_model.translate(-center);
+    update();
+}
 
-    // Adjust initial rotation angles for better 3D perspective
-    m_xRot = 30.0f; // Increased from 15.0f
-    m_yRot = 40.0f; // Increased from 15.0f
+void PointCloudGLWidget::onEntityDataChanged(EntityId id)
+{
+    if (GpuPointBuffer *buffer = m_gpuBuffers.value(id, nullptr))
+        buffer->dirty = true;
+    if (GpuPrimitiveBuffer *buffer = m_gpuPrimitives.value(id, nullptr))
+        buffer->dirty = true;
+    if (m_selectedEntities.contains(id))
+        m_overlayDirty = true;
+
+    // Out-of-core chunks arrive between frames; each one is worth a repaint
+    if (const QSharedPointer<OutOfCoreCloud> cloud = m_scene->outOfCore(id))
+        connect(cloud.data(), &OutOfCoreCloud::chunkLoaded, this, qOverload<>(&PointCloudGLWidget::update), Qt::UniqueConnection);
 
-    m_selectedEntityForBoundingBox = name;
-    m_showBoundingBox = true;
     update();
 }
 
-void PointCloudGLWidget::showBoundingBox(const QVector3D& minCorner, const QVector3D& maxCorner)
+void PointCloudGLWidget::onEntityPointsAppended(EntityId id)
 {
-    m_selectedEntityForBoundingBox = "";
-    m_showBoundingBox = true;
+    if (GpuPointBuffer *buffer = m_gpuBuffers.value(id, nullptr))
+        buffer->appendPending = true;
+    if (m_selectedEntities.contains(id))
+        m_overlayDirty = true;
     update();
 }
 
-void PointCloudGLWidget::hideBoundingBox()
+void PointCloudGLWidget::onEntitySelectionChanged(EntityId id, qsizetype firstPoint, qsizetype pointCount)
 {
-    m_showBoundingBox = false;
+    if (GpuPointBuffer *buffer = m_gpuBuffers.value(id, nullptr))
+        markSelectionDirty(buffer, firstPoint, firstPoint + pointCount);
     update();
 }
 
-void PointCloudGLWidget::mousePressEvent(QMouseEvent *event)
+void PointCloudGLWidget::onEntityMeshAppended(EntityId id)
 {
-    m_lastPos = event->pos();
+    if (m_selectedEntities.contains(id))
+        m_overlayDirty = true;
+    update();
+}
+
+void PointCloudGLWidget::onEntityRemoved(EntityId id)
+{
+    if (m_selectedEntities.removeOne(id))
+        m_overlayDirty = true;
+
+    if (context()) {
+        makeCurrent();
+        releaseGpuBuffer(id);
+        releaseGpuMeshes(id);
+        releaseGpuPrimitives(id);
+
+        const QList<ChunkKey> chunks = m_chunkBuffers.keys();
+        for (const ChunkKey &key : chunks) {
+            if (key.first == id)
+                releaseChunkBuffer(key);
+        }
+        doneCurrent();
+    }
+    update();
+}
+
+void PointCloudGLWidget::releaseGpuBuffer(EntityId id)
+{
+    GpuPointBuffer *buffer = m_gpuBuffers.take(id);
+    if (!buffer)
+        return;
+
+    buffer->selectionVbo.destroy();
+    buffer->vbo.destroy();
+    buffer->vao.destroy();
+    delete buffer;
+}
+
+void PointCloudGLWidget::releaseAllGpuBuffers()
+{
+    const QList<EntityId> ids = m_gpuBuffers.keys();
+    for (EntityId id : ids)
+        releaseGpuBuffer(id);
+
+    const QList<EntityId> meshIds = m_gpuMeshes.keys();
+    for (EntityId id : meshIds)
+        releaseGpuMeshes(id);
+
+    const QList<EntityId> primitiveIds = m_gpuPrimitives.keys();
+    for (EntityId id : primitiveIds)
+        releaseGpuPrimitives(id);
+
+    const QList<ChunkKey> chunks = m_chunkBuffers.keys();
+    for (const ChunkKey &key : chunks)
+        releaseChunkBuffer(key);
+}
+
+void PointCloudGLWidget::releaseChunkBuffer(const ChunkKey& key)
+{
+    GpuPointBuffer *buffer = m_chunkBuffers.take(key);
+    if (!buffer)
+        return;
+
+    m_chunkGpuMemory -= qint64(buffer->capacity) * qint64(sizeof(QVector3D) + sizeof(PointColor));
+    buffer->vbo.destroy();
+    buffer->vao.destroy();
+    delete buffer;
+}
+
+float PointCloudGLWidget::projectedBoxSize(const QVector3D& boxMin, const QVector3D& boxMax, const QMatrix4x4& modelView, float pixelsPerUnit) const
+{
+    const QVector3D center = modelView.map((boxMin + boxMax) * 0.5f);
+    const float radius = modelView.mapVector((boxMax - boxMin) * 0.5f).length();
+    const float distance = center.length();
+
+    // A box around the camera covers the whole view
+    if (distance <= radius)
+        return std::numeric_limits<float>::max();
+
+    return 2.0f * radius / distance * pixelsPerUnit;
+}
+
+QHash<EntityId, QVector<PointCloudGLWidget::DrawRange>> PointCloudGLWidget::selectDrawRanges(qint64 budget, RenderStats& stats) const
+{
+    QHash<EntityId, QVector<DrawRange>> selection;
+
+    struct Candidate {
+        float projectedSize;
+        EntityId id;
+        int node;
+        bool operator<(const Candidate &other) const { return projectedSize < other.projectedSize; }
+    };
+
+    const QMatrix4x4 modelView = m_view * m_model;
+    const ViewFrustum frustum(m_projection * modelView);
+    const float pixelsPerUnit = height() * 0.5f / qTan(qDegreesToRadians(m_fov * 0.5f));
+    const bool unlimited = budget <= 0;
+
+    QHash<EntityId, QSharedPointer<const PointOctree>> trees;
+    std::priority_queue<Candidate> candidates;
+    qint64 remaining = unlimited ? std::numeric_limits<qint64>::max() : budget;
+
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+        if (!pc->isVisible || pc->points.isEmpty())
+            continue;
+
+        // Clouds still loading or waiting for their octree are one chunk, drawn in full if in view
+        const QSharedPointer<const PointOctree> lod = m_scene->levelOfDetail(id);
+        if (!lod || lod->isEmpty()) {
+            if (frustum.classify(pc->boundingBoxMin, pc->boundingBoxMax) == ViewFrustum::Outside) {
+                ++stats.chunksCulled;
+                continue;
+            }
+            ++stats.chunksDrawn;
+            remaining -= pc->points.size();
+            selection.insert(id, { { 0, int(pc->points.size()) } });
+            continue;
+        }
+
+        trees.insert(id, lod);
+        selection.insert(id, QVector<DrawRange>());
+        candidates.push({ projectedBoxSize(lod->root().boundsMin, lod->root().boundsMax, modelView, pixelsPerUnit), id, 0 });
+    }
+
+    // Children are only worth visiting while the parent's sample grid is coarser than a pixel
+    const float minProjectedSize = float(PointOctree::SampleGrid);
+
+    while (!candidates.empty()) {
+        const Candidate candidate = candidates.top();
+        candidates.pop();
+
+        const PointOctree &lod = *trees.value(candidate.id);
+        const PointOctree::Node &node = lod.nodes()[candidate.node];
+
+        const ViewFrustum::Containment containment = frustum.classify(node.boundsMin, node.boundsMax);
+        if (containment == ViewFrustum::Outside) {
+            ++stats.chunksCulled;
+            continue;
+        }
+
+        // Without a budget a node entirely in view is drawn with its whole subtree in one range
+        if (unlimited && containment == ViewFrustum::Inside) {
+            stats.chunksDrawn += countSubtreeNodes(lod, candidate.node);
+            selection[candidate.id].append({ int(node.first), int(node.subtreeCount) });
+            continue;
+        }
+
+        // Roots are always drawn so every cloud in view stays visible at some density;
+        // past that, smaller nodes may still fit where a larger one did not
+        if (node.depth > 0 && node.count > remaining)
+            continue;
+
+        ++stats.chunksDrawn;
+        remaining -= node.count;
+        selection[candidate.id].append({ int(node.first), int(node.count) });
+
+        if (!unlimited && candidate.projectedSize < minProjectedSize)
+            continue;
+
+        for (qint32 child : node.children) {
+            if (child >= 0)
+                candidates.push({ projectedBoxSize(lod.nodes()[child].boundsMin, lod.nodes()[child].boundsMax, modelView, pixelsPerUnit), candidate.id, child });
+        }
+    }
+
+    // A node's points are followed by those of its first child, so sorted ranges often merge
+    for (QVector<DrawRange> &ranges : selection) {
+        std::sort(ranges.begin(), ranges.end(), [](const DrawRange &a, const DrawRange &b) { return a.first < b.first; });
+
+        int merged = 0;
+        for (int i = 1; i < ranges.size(); ++i) {
+            if (ranges[merged].first + ranges[merged].count == ranges[i].first)
+                ranges[merged].count += ranges[i].count;
+            else
+                ranges[++merged] = ranges[i];
+        }
+        ranges.resize(qMin<qsizetype>(ranges.size(), merged + 1));
+
+        stats.drawCalls += ranges.size();
+        for (const DrawRange &range : ranges)
+            stats.pointsDrawn += range.count;
+    }
+
+    return selection;
+}
+
+void PointCloudGLWidget::renderOutOfCoreClouds(qint64 budget, RenderStats& stats)
+{
+    struct Candidate {
+        float projectedSize;
+        EntityId id;
+        int chunk;
+    };
+
+    const QMatrix4x4 modelView = m_view * m_model;
+    const ViewFrustum frustum(m_projection * modelView);
+    const float pixelsPerUnit = height() * 0.5f / qTan(qDegreesToRadians(m_fov * 0.5f));
+
+    QHash<EntityId, QSharedPointer<OutOfCoreCloud>> clouds;
+    QVector<Candidate> candidates;
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<OutOfCoreCloud> cloud = m_scene->outOfCore(id);
+        if (!cloud || !m_scene->cloud(id)->isVisible)
+            continue;
+
+        cloud->beginFrame();
+        clouds.insert(id, cloud);
+
+        const QVector<OutOfCoreCloud::Chunk> &chunks = cloud->chunks();
+        for (int i = 0; i < chunks.size(); ++i) {
+            if (frustum.classify(chunks[i].boundsMin, chunks[i].boundsMax) == ViewFrustum::Outside) {
+                ++stats.chunksCulled;
+                continue;
+            }
+            candidates.append({ projectedBoxSize(chunks[i].boundsMin, chunks[i].boundsMax, modelView, pixelsPerUnit), id, i });
+        }
+    }
+
+    if (clouds.isEmpty())
+        return;
+
+    ++m_frameIndex;
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.projectedSize > b.projectedSize;
+    });
+
+    m_program->bind();
+    m_program->setUniformValue("model", m_model);
+    m_program->setUniformValue("view", m_view);
+    m_program->setUniformValue("projection", m_projection);
+    m_program->setUniformValue("smoothPoints", m_renderMode == POINTS_SMOOTH);
+
+    qint64 remaining = budget > 0 ? budget : std::numeric_limits<qint64>::max();
+    EntityId boundEntity = 0;
+    float pointSize = 1.0f;
+
+    // Nearest chunks first, each with only as many points as its size on screen can show
+    for (const Candidate &candidate : candidates) {
+        if (remaining <= 0)
+            break;
+
+        if (candidate.id != boundEntity) {
+            const QSharedPointer<const PointCloud> pc = m_scene->cloud(candidate.id);
+            pointSize = qMax(1.0f, pc->pointSize);
+            m_program->setUniformValue("pointSize", pc->pointSize);
+            m_program->setUniformValue("tintColor", QVector3D(pc->tintColor.red(), pc->tintColor.green(), pc->tintColor.blue()));
+            boundEntity = candidate.id;
+        }
+
+        OutOfCoreCloud &cloud = *clouds.value(candidate.id);
+        const OutOfCoreCloud::Chunk &chunk = cloud.chunks()[candidate.chunk];
+
+        // Enough points to cover the chunk's footprint about twice at the cloud's point size
+        const double footprint = double(candidate.projectedSize) * candidate.projectedSize * 2.0 / (pointSize * pointSize);
+        const quint32 wanted = quint32(qMin<qint64>(remaining, qint64(qBound(1.0, footprint, double(chunk.count)))));
+
+        const PointAttributes resident = cloud.residentPoints(candidate.chunk, wanted);
+        GpuPointBuffer *buffer = chunkBufferFor(ChunkKey(candidate.id, candidate.chunk), resident);
+        if (!buffer)
+            continue;
+
+        const int count = qMin(int(wanted), buffer->vertexCount);
+        if (count <= 0)
+            continue;
+
+        buffer->vao.bind();
+        glDrawArrays(GL_POINTS, 0, count);
+        buffer->vao.release();
+
+        ++stats.chunksDrawn;
+        ++stats.drawCalls;
+        stats.pointsDrawn += count;
+        remaining -= count;
+
+        if (m_pickState == PickState::Requested)
+            m_outOfCoreDraws.append(qMakePair(ChunkKey(candidate.id, candidate.chunk), count));
+    }
+
+    m_program->release();
+
+    // Evict what the view no longer needs; anything used this frame stays
+    const qint64 hostShare = m_hostMemoryBudget / clouds.size();
+    for (const QSharedPointer<OutOfCoreCloud> &cloud : clouds)
+        cloud->trimToBudget(hostShare);
+    trimChunkBuffers();
+}
+
+PointCloudGLWidget::GpuPointBuffer* PointCloudGLWidget::chunkBufferFor(const ChunkKey& key, const PointAttributes& resident)
+{
+    GpuPointBuffer *buffer = m_chunkBuffers.value(key, nullptr);
+    if (!buffer) {
+        if (resident.size() == 0)
+            return nullptr;
+
+        buffer = new GpuPointBuffer;
+        buffer->vao.create();
+        buffer->vbo.create();
+        m_chunkBuffers.insert(key, buffer);
+    }
+
+    buffer->lastUsedFrame = m_frameIndex;
+
+    // Chunks only grow, by re-reading a longer prefix; the buffer is replaced to match
+    if (resident.size() > buffer->vertexCount) {
+        const qint64 bytesPerPoint = qint64(sizeof(QVector3D) + sizeof(PointColor));
+        m_chunkGpuMemory -= qint64(buffer->capacity) * bytesPerPoint;
+        buffer->dirty = true;
+        uploadPointCloud(buffer, resident, 0);
+        m_chunkGpuMemory += qint64(buffer->capacity) * bytesPerPoint;
+    }
+
+    return buffer;
+}
+
+void PointCloudGLWidget::trimChunkBuffers()
+{
+    if (m_chunkGpuMemory <= m_gpuMemoryBudget)
+        return;
+
+    QVector<QPair<quint64, ChunkKey>> evictable;
+    for (auto it = m_chunkBuffers.constBegin(); it != m_chunkBuffers.constEnd(); ++it) {
+        if (it.value()->lastUsedFrame < m_frameIndex)
+            evictable.append(qMakePair(it.value()->lastUsedFrame, it.key()));
+    }
+    std::sort(evictable.begin(), evictable.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    for (const auto &entry : evictable) {
+        if (m_chunkGpuMemory <= m_gpuMemoryBudget)
+            break;
+        releaseChunkBuffer(entry.second);
+    }
+}
+
+void PointCloudGLWidget::pickAt(const QPoint& pos, Qt::KeyboardModifiers modifiers)
+{
+    const qreal ratio = devicePixelRatioF();
+    m_pickPos = QPoint(qFloor(pos.x() * ratio), qFloor((height() - pos.y()) * ratio) - 1);
+    m_pickModifiers = modifiers;
+    m_pickState = PickState::Requested;
+    update();
+}
+
+void PointCloudGLWidget::ensurePickTargets()
+{
+    const QSize size(qMax(1, qRound(width() * devicePixelRatioF())), qMax(1, qRound(height() * devicePixelRatioF())));
+    if (m_pickFramebuffer && size == m_pickTargetSize)
+        return;
+
+    if (!m_pickFramebuffer) {
+        glGenFramebuffers(1, &m_pickFramebuffer);
+        glGenRenderbuffers(1, &m_pickColorBuffer);
+        glGenRenderbuffers(1, &m_pickDepthBuffer);
+
+        // Sized once for the largest pick rectangle
+        const int side = 2 * PickRadius + 1;
+        glGenBuffers(1, &m_pickPixelBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pickPixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, side * side * 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    m_pickTargetSize = size;
+    glBindRenderbuffer(GL_RENDERBUFFER, m_pickColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32UI, size.width(), size.height());
+    glBindRenderbuffer(GL_RENDERBUFFER, m_pickDepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.width(), size.height());
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_pickFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_pickColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_pickDepthBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+}
+
+void PointCloudGLWidget::releasePickTargets()
+{
+    if (m_pickFence) {
+        glDeleteSync(m_pickFence);
+        m_pickFence = nullptr;
+    }
+    if (!m_pickFramebuffer)
+        return;
+
+    glDeleteFramebuffers(1, &m_pickFramebuffer);
+    glDeleteRenderbuffers(1, &m_pickColorBuffer);
+    glDeleteRenderbuffers(1, &m_pickDepthBuffer);
+    glDeleteBuffers(1, &m_pickPixelBuffer);
+    m_pickFramebuffer = m_pickColorBuffer = m_pickDepthBuffer = m_pickPixelBuffer = 0;
+    m_pickTargetSize = QSize();
+}
+
+void PointCloudGLWidget::renderPickPass(const QHash<EntityId, QVector<DrawRange>>& selection)
+{
+    ensurePickTargets();
+
+    // A newer request supersedes a readback still in flight
+    if (m_pickFence) {
+        glDeleteSync(m_pickFence);
+        m_pickFence = nullptr;
+    }
+
+    const QRect bounds(QPoint(0, 0), m_pickTargetSize);
+    m_pickRect = QRect(m_pickPos - QPoint(PickRadius, PickRadius), QSize(2 * PickRadius + 1, 2 * PickRadius + 1)).intersected(bounds);
+    if (m_pickRect.isEmpty()) {
+        m_pickState = PickState::Idle;
+        deliverPick(0, -1);
+        return;
+    }
+
+    // Only the few pixels around the cursor are rasterized
+    glBindFramebuffer(GL_FRAMEBUFFER, m_pickFramebuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(m_pickRect.x(), m_pickRect.y(), m_pickRect.width(), m_pickRect.height());
+    const GLuint nothing[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    m_pickProgram->bind();
+    m_pickProgram->setUniformValue("model", m_model);
+    m_pickProgram->setUniformValue("view", m_view);
+    m_pickProgram->setUniformValue("projection", m_projection);
+
+    m_pickProgram->setUniformValue("hasPointIndex", true);
+    for (auto it = selection.constBegin(); it != selection.constEnd(); ++it) {
+        GpuPointBuffer *buffer = m_gpuBuffers.value(it.key(), nullptr);
+        if (!buffer)
+            continue;
+
+        m_pickProgram->setUniformValue("entityId", GLuint(it.key()));
+        m_pickProgram->setUniformValue("pointSize", m_scene->cloud(it.key())->pointSize);
+        buffer->vao.bind();
+        for (const DrawRange &range : it.value())
+            glDrawArrays(GL_POINTS, range.first, range.count);
+        buffer->vao.release();
+    }
+
+    // Chunk buffers hold a prefix of the chunk, not the entity's arrays, so only the entity is known
+    m_pickProgram->setUniformValue("hasPointIndex", false);
+    for (const auto &draw : std::as_const(m_outOfCoreDraws)) {
+        GpuPointBuffer *buffer = m_chunkBuffers.value(draw.first, nullptr);
+        if (!buffer)
+            continue;
+
+        m_pickProgram->setUniformValue("entityId", GLuint(draw.first.first));
+        m_pickProgram->setUniformValue("pointSize", m_scene->cloud(draw.first.first)->pointSize);
+        buffer->vao.bind();
+        glDrawArrays(GL_POINTS, 0, draw.second);
+        buffer->vao.release();
+    }
+
+    // Surfaces name only their entity, and their depth hides the points behind them
+    for (auto it = m_gpuMeshes.constBegin(); it != m_gpuMeshes.constEnd(); ++it) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(it.key());
+        if (!pc || !pc->isVisible)
+            continue;
+
+        m_pickProgram->setUniformValue("entityId", GLuint(it.key()));
+        for (GpuMesh *mesh : it.value()) {
+            mesh->vao.bind();
+            glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, nullptr);
+            mesh->vao.release();
+        }
+    }
+
+    for (auto it = m_gpuPrimitives.constBegin(); it != m_gpuPrimitives.constEnd(); ++it) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(it.key());
+        GpuPrimitiveBuffer *buffer = it.value();
+        if (!pc || !pc->isVisible || buffer->dirty || buffer->triangleIndexCount == 0)
+            continue;
+
+        m_pickProgram->setUniformValue("entityId", GLuint(it.key()));
+        buffer->vao.bind();
+        glDrawElements(GL_TRIANGLES, buffer->triangleIndexCount, GL_UNSIGNED_INT, nullptr);
+        buffer->vao.release();
+    }
+    m_pickProgram->release();
+
+    // The copy into the pixel buffer runs asynchronously; the next frame maps it once the fence has passed
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pickPixelBuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(m_pickRect.x(), m_pickRect.y(), m_pickRect.width(), m_pickRect.height(), GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_pickFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+
+    m_pickState = PickState::Reading;
+    update();
+}
+
+void PointCloudGLWidget::resolvePick()
+{
+    if (m_pickState != PickState::Reading || !m_pickFence)
+        return;
+
+    // Never wait on the GPU; if the copy has not landed, look again next frame
+    if (glClientWaitSync(m_pickFence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        update();
+        return;
+    }
+
+    glDeleteSync(m_pickFence);
+    m_pickFence = nullptr;
+    m_pickState = PickState::Idle;
+
+    EntityId entity = 0;
+    qint64 pointIndex = -1;
+
+    const int width = m_pickRect.width();
+    const int height = m_pickRect.height();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pickPixelBuffer);
+    const GLuint *ids = static_cast<const GLuint *>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 2 * sizeof(GLuint), GL_MAP_READ_BIT));
+    if (ids) {
+        // The drawn texel nearest the cursor wins; depth testing already kept the frontmost per texel
+        int nearest = std::numeric_limits<int>::max();
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const GLuint *texel = ids + 2 * (y * width + x);
+                if (texel[0] == 0)
+                    continue;
+
+                const int dx = m_pickRect.x() + x - m_pickPos.x();
+                const int dy = m_pickRect.y() + y - m_pickPos.y();
+                const int distance = dx * dx + dy * dy;
+                if (distance < nearest) {
+                    nearest = distance;
+                    entity = texel[0];
+                    pointIndex = qint64(texel[1]) - 1;
+                }
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    deliverPick(entity, pointIndex);
+}
+
+void PointCloudGLWidget::deliverPick(EntityId id, qint64 pointIndex)
+{
+    // Receivers may change the scene, which is not safe halfway through a paint
+    const Qt::KeyboardModifiers modifiers = m_pickModifiers;
+    QMetaObject::invokeMethod(this, [this, id, pointIndex, modifiers]() {
+        emit pointPicked(id, pointIndex, modifiers);
+    }, Qt::QueuedConnection);
+}
+
+void PointCloudGLWidget::setMemoryBudgets(qint64 hostBytes, qint64 gpuBytes)
+{
+    m_hostMemoryBudget = qMax<qint64>(0, hostBytes);
+    m_gpuMemoryBudget = qMax<qint64>(0, gpuBytes);
+    update();
+}
+
+int PointCloudGLWidget::countSubtreeNodes(const PointOctree& lod, int node)
+{
+    int count = 1;
+    for (qint32 child : lod.nodes()[node].children) {
+        if (child >= 0)
+            count += countSubtreeNodes(lod, child);
+    }
+    return count;
+}
+
+void PointCloudGLWidget::renderPointCloud(EntityId id, const PointCloud& pc, const QVector<DrawRange>* ranges)
+{
+    if (pc.points.isEmpty())
+        return;
+
+    GpuPointBuffer *buffer = gpuBufferFor(id, pc);
+
+    m_program->bind();
+    m_program->setUniformValue("model", m_model);
+    m_program->setUniformValue("view", m_view);
+    m_program->setUniformValue("projection", m_projection);
+    m_program->setUniformValue("pointSize", pc.pointSize);
+    m_program->setUniformValue("smoothPoints", m_renderMode == POINTS_SMOOTH);
+
+    QVector3D tintColor(pc.tintColor.red(), pc.tintColor.green(), pc.tintColor.blue());
+    m_program->setUniformValue("tintColor", tintColor);
+
+    buffer->vao.bind();
+    if (ranges) {
+        for (const DrawRange &range : *ranges)
+            glDrawArrays(GL_POINTS, range.first, range.count);
+    } else {
+        glDrawArrays(GL_POINTS, 0, buffer->vertexCount);
+    }
+    buffer->vao.release();
+    m_program->release();
+}
+
+void PointCloudGLWidget::resizeGL(int width, int height)
+{
+    float aspect = width / static_cast<float>(height);
+    m_projection.setToIdentity();
+    m_projection.perspective(m_fov, aspect, 0.01f, 1000.0f);
+    update();
+}
+
+void PointCloudGLWidget::calculateSceneExtents(QVector3D& min, QVector3D& max)
+{
+    min = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    max = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+
+    bool foundVisiblePoints = false;
+
+    // The store keeps every cloud's bounding box current, including out-of-core ones
+    for (EntityId id : m_scene->entityIds()) {
+        const PointCloud &pc = *m_scene->cloud(id);
+        if (pc.isVisible && (pc.hasGeometry() || m_scene->outOfCore(id))) {
+            min.setX(qMin(min.x(), pc.boundingBoxMin.x()));
+            min.setY(qMin(min.y(), pc.boundingBoxMin.y()));
+            min.setZ(qMin(min.z(), pc.boundingBoxMin.z()));
+
+            max.setX(qMax(max.x(), pc.boundingBoxMax.x()));
+            max.setY(qMax(max.y(), pc.boundingBoxMax.y()));
+            max.setZ(qMax(max.z(), pc.boundingBoxMax.z()));
+            foundVisiblePoints = true;
+        }
+    }
+
+    if (!foundVisiblePoints) {
+        min = QVector3D(-1.0f, -1.0f, -1.0f);
+        max = QVector3D(1.0f, 1.0f, 1.0f);
+    }
+}
+
+void PointCloudGLWidget::resetView()
+{
+    m_xRot = 30.0f; // Increased from 15.0f
+    m_yRot = 40.0f; // Increased from 15.0f
+    m_distance = 5.0f;
+    m_fov = 30.0f; // Changed from 45.0f
+    m_focalDistance = 0.5f;
+
+    QVector3D min, max;
+    calculateSceneExtents(min, max);
+
+    QVector3D center = (min + max) * 0.5f;
+    QVector3D size = max - min;
+
+    // Increase the distance multiplier from 0.8f to 2.0f
+    float sceneSize = size.length();
+    m_distance = sceneSize * 2.0f;
+
+    // Decrease scale value to show more of the scene - change from 1.5f to 1.0f
+    float scale = 1.0f / qMax(qMax(size.x(), size.y()), size.z());
+
+    m_model.setToIdentity();
+    m_model.scale(scale);
+    m_model.translate(-center);
+
+    update();
+}
+
+
+void PointCloudGLWidget::setFocusOnPointCloud(EntityId id, const QVector3D& min, const QVector3D& max)
+{
+    if (!m_scene || !m_scene->contains(id))
+        return;
+
+    if (!m_scene->cloud(id)->hasGeometry() && !m_scene->outOfCore(id))
+        return;
+
+    // Calculate bounding box center and size
+    QVector3D center = (min + max) * 0.5f;
+    QVector3D size = max - min;
+    float sceneSize = size.length();
+
+    // Increase the distance multiplier from 0.8f to 2.0f for a more zoomed-out view
+    float cameraDistance = sceneSize * 4.0f;
+    m_distance = cameraDistance;
+
+    m_view.setToIdentity();
+    m_view.lookAt(
+        center + QVector3D(0.0f, 0.0f, cameraDistance), // Camera position
+        center,                                        // Look-at point
+        QVector3D(0.0f, 1.0f, 0.0f)                    // Up vector
+        );
+
+    // Adjust FOV for better perspective - change from 45.0f to 40.0f for less distortion
+    m_fov = 30.0f;
+    m_focalDistance = sceneSize * 1.5f;
+
+    float aspect = width() / static_cast<float>(height());
+    float nearPlane = qMax(0.01f, sceneSize * 0.01f);
+    float farPlane = sceneSize * 20.0f; // Increased from 10.0f to 20.0f for better depth visibility
+
+    m_projection.setToIdentity();
+    m_projection.perspective(m_fov, aspect, nearPlane, farPlane);
+
+    // Decrease scale value to show more of the scene - change from 1.5f to 1.0f
+    float scale = 1.0f / qMax(qMax(size.x(), size.y()), size.z());
+    m_model.setToIdentity();
+    m_model.scale(scale);
+    m_model.translate(-center);
+
+    // Adjust initial rotation angles for better 3D perspective
+    m_xRot = 30.0f; // Increased from 15.0f
+    m_yRot = 40.0f; // Increased from 15.0f
+
+    update();
+}
+
+void PointCloudGLWidget::showBoundingBox(const QVector3D& minCorner, const QVector3D& maxCorner)
+{
+    m_extraBoxMin = minCorner;
+    m_extraBoxMax = maxCorner;
+    m_showExtraBox = true;
+    m_overlayDirty = true;
+    update();
+}
+
+void PointCloudGLWidget::hideBoundingBox()
+{
+    m_showExtraBox = false;
+    m_overlayDirty = true;
+    update();
+}
+
+void PointCloudGLWidget::setSelectedEntity(EntityId id)
+{
+    setSelectedEntities(id ? QVector<EntityId>{ id } : QVector<EntityId>());
+}
+
+void PointCloudGLWidget::setSelectedEntities(const QVector<EntityId>& ids)
+{
+    if (ids == m_selectedEntities)
+        return;
+
+    m_selectedEntities = ids;
+    m_overlayDirty = true;
+    update();
+}
+
+void PointCloudGLWidget::setSelectionTool(SelectionTool tool)
+{
+    m_selectionTool = tool;
+    m_selecting = false;
+    setCursor(tool == SelectionTool::Navigate ? Qt::ArrowCursor : Qt::CrossCursor);
+    update();
+}
+
+void PointCloudGLWidget::mousePressEvent(QMouseEvent *event)
+{
+    m_lastPos = event->pos();
+    m_pressPos = event->pos();
+
+    if (event->button() == Qt::LeftButton && m_selectionTool != SelectionTool::Navigate) {
+        m_selecting = true;
+        m_selectionOutline = QPolygon({ event->pos(), event->pos() });
+    }
+}
+
+void PointCloudGLWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+
+    // A left click that did not turn into a drag picks what is under the cursor
+    const bool click = (event->pos() - m_pressPos).manhattanLength() <= 3;
+    if (m_selecting) {
+        m_selecting = false;
+        update();
+
+        if (!click) {
+            const QPolygon region = m_selectionTool == SelectionTool::Rectangle
+                ? QPolygon(QRect(m_selectionOutline[0], m_selectionOutline[1]).normalized())
+                : m_selectionOutline;
+            if (region.size() >= 3)
+                emit regionSelected(region, event->modifiers());
+            return;
+        }
+    }
+
+    if (click)
+        pickAt(event->pos(), event->modifiers());
+}
+
+void PointCloudGLWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (m_selecting) {
+        // A rectangle keeps its two corners; a lasso records the path every few pixels
+        if (m_selectionTool == SelectionTool::Rectangle)
+            m_selectionOutline[1] = event->pos();
+        else if ((event->pos() - m_selectionOutline.last()).manhattanLength() >= 3)
+            m_selectionOutline.append(event->pos());
+        m_lastPos = event->pos();
+        update();
+        return;
+    }
+
+    const QPoint delta = event->position().toPoint() - m_lastPos;
+
+    if (event->buttons() & (Qt::LeftButton | Qt::RightButton))
+    {
+        dragCamera(delta, event->buttons());
+        emit cameraDragged(delta, event->buttons());
+        beginInteraction();
+    }
+
+    m_lastPos = event->position().toPoint();
 }
 
-void PointCloudGLWidget::mouseMoveEvent(QMouseEvent *event)
+void PointCloudGLWidget::dragCamera(const QPoint& delta, Qt::MouseButtons buttons)
 {
-    int dx = event->position().x() - m_lastPos.x();
-    int dy = event->position().y() - m_lastPos.y();
-
-    if (event->buttons() & Qt::LeftButton)
+    if (buttons & Qt::LeftButton)
     {
-        m_yRot += dx;
-        m_xRot += dy;
-        update();
+        m_yRot += delta.x();
+        m_xRot += delta.y();
     }
-    else if (event->buttons() & Qt::RightButton)
+    else if (buttons & Qt::RightButton)
     {
-        m_distance -= dy * 0.01f;
+        m_distance -= delta.y() * 0.01f;
         m_distance = qMax(0.1f, m_distance);
-        update();
     }
-
-    m_lastPos = event->position().toPoint();
+    update();
 }
 
 void PointCloudGLWidget::wheelEvent(QWheelEvent *event)
 {
     m_distance -= event->angleDelta().y() * 0.001f;
     m_distance = qMax(0.1f, m_distance);
-    update();
+    beginInteraction();
 }
 
 // ========== MainWindow Implementation ==========
@@ -491,37 +1685,82 @@ void PointCloudGLWidget::wheelEvent(QWheelEvent *event)
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_scene(new SceneStore(this))
+    , m_loader(new PointCloudLoader(this))
+    , m_batchFlushTimer(new QTimer(this))
 {
     ui->setupUi(this);
     setupUI();
     createMenus();
 
+    // Batches are coalesced so GPU buffers grow a few times per second rather than once per chunk
+    m_batchFlushTimer->setSingleShot(true);
+    m_batchFlushTimer->setInterval(100);
+    connect(m_batchFlushTimer, &QTimer::timeout, this, &MainWindow::flushLoadedBatches);
+
+    connect(m_loader, &PointCloudLoader::progressChanged, this, &MainWindow::onLoadProgress);
+    connect(m_loader, &PointCloudLoader::batchReady, this, &MainWindow::onBatchReady);
+    connect(m_loader, &PointCloudLoader::meshReady, this, &MainWindow::onMeshReady);
+    connect(m_loader, &PointCloudLoader::loadFinished, this, &MainWindow::onLoadFinished);
+    connect(m_loader, &PointCloudLoader::loadFailed, this, &MainWindow::onLoadFailed);
+    connect(m_loader, &PointCloudLoader::loadCancelled, this, &MainWindow::onLoadCancelled);
+
+    m_renderStatsLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_renderStatsLabel);
+    connect(m_glWidget, &PointCloudGLWidget::frameRendered, this, &MainWindow::onFrameRendered);
+    connect(m_glWidget, &PointCloudGLWidget::pointPicked, this, &MainWindow::onPointPicked);
+    connect(m_glWidget, &PointCloudGLWidget::regionSelected, this, &MainWindow::onRegionSelected);
+    connect(m_glWidget, &PointCloudGLWidget::cameraDragged, this, &MainWindow::onCameraDragged);
+    connect(&m_downsampleWatcher, &QFutureWatcher<DownsampleResult>::finished, this, &MainWindow::onDownsamplingFinished);
+    connect(&m_outlierWatcher, &QFutureWatcher<OutlierResult>::finished, this, &MainWindow::onOutlierFilterFinished);
+
     statusBar()->showMessage(tr("Ready"));
     setWindowTitle(tr("Point Cloud Viewer"));
 }
 
 MainWindow::~MainWindow()
 {
+    m_loader->cancelAll();
     qDeleteAll(m_viewportList);
     delete ui;
 }
 
-QString MainWindow::getSelectedPointCloud() const
+EntityId MainWindow::getSelectedPointCloud() const
 {
     QTreeWidgetItem *currentItem = m_treeWidget->currentItem();
     if (!currentItem)
-        return QString();
+        return 0;
+
+    return entityForItem(currentItem);
+}
+
+EntityId MainWindow::entityForItem(const QTreeWidgetItem *item) const
+{
+    // Entity rows carry their id; viewport rows carry a ViewportObject pointer instead
+    QVariant data = item->data(0, Qt::UserRole);
+    if (data.typeId() != QMetaType::UInt)
+        return 0;
 
-    QString name = currentItem->data(0, Qt::UserRole).toString();
-    if (m_pointClouds.contains(name))
-        return name;
+    EntityId id = data.toUInt();
+    return m_scene->contains(id) ? id : 0;
+}
 
-    return QString();
+QTreeWidgetItem *MainWindow::itemForEntity(EntityId id) const
+{
+    for (int i = 0; i < m_treeWidget->topLevelItemCount(); ++i) {
+        QTreeWidgetItem* item = m_treeWidget->topLevelItem(i);
+        if (entityForItem(item) == id)
+            return item;
+    }
+    return nullptr;
 }
 
 QString MainWindow::getSupportedFormatsFilter() const
 {
-    QString filter = tr("Point Cloud Files (*.pts)");
+    QString filter = tr("Point Cloud Files (*.pts *.ply *.las)");
+    filter += tr(";;PTS Point Clouds (*.pts)");
+    filter += tr(";;Stanford PLY (*.ply)");
+    filter += tr(";;LAS Point Clouds (*.las)");
 
 #ifdef USE_ASSIMP
     filter += tr(";;3D Models (*.obj *.fbx *.dae *.3ds *.ply *.stl *.gltf *.glb)");
@@ -529,10 +1768,9 @@ QString MainWindow::getSupportedFormatsFilter() const
     filter += tr(";;Autodesk FBX (*.fbx)");
     filter += tr(";;COLLADA (*.dae)");
     filter += tr(";;3D Studio Max (*.3ds)");
-    filter += tr(";;Stanford PLY (*.ply)");
     filter += tr(";;Stereolithography STL (*.stl)");
     filter += tr(";;GL Transmission Format (*.gltf *.glb)");
-    filter += tr(";;All Supported Files (*.pts *.obj *.fbx *.dae *.3ds *.ply *.stl *.gltf *.glb)");
+    filter += tr(";;All Supported Files (*.pts *.las *.obj *.fbx *.dae *.3ds *.ply *.stl *.gltf *.glb)");
 #endif
 
     filter += tr(";;All Files (*)");
@@ -542,6 +1780,7 @@ QString MainWindow::getSupportedFormatsFilter() const
 void MainWindow::setupUI()
 {
     m_glWidget = new PointCloudGLWidget(this);
+    m_glWidget->setScene(m_scene);
 
     QWidget *centralWidget = ui->centralwidget;
     delete centralWidget->layout();
@@ -558,7 +1797,7 @@ void MainWindow::setupUI()
     m_treeWidget->setColumnWidth(0, 200);
     m_treeWidget->setAlternatingRowColors(true);
 
-    m_treeWidget->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_treeWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
     m_treeWidget->setColumnCount(2);
     m_treeWidget->setHeaderLabels(QStringList() << tr("File") << tr("Points"));
 
@@ -579,6 +1818,8 @@ void MainWindow::setupUI()
     connect(m_treeWidget, &QTreeWidget::itemClicked, this, &MainWindow::onItemClicked);
     connect(m_treeWidget, &QTreeWidget::itemChanged, this, &MainWindow::onItemChanged);
     connect(m_treeWidget, &QTreeWidget::itemDoubleClicked, this, &MainWindow::onItemDoubleClicked);
+    connect(m_treeWidget, &QTreeWidget::itemSelectionChanged, this, &MainWindow::onTreeSelectionChanged);
+    connect(m_treeWidget, &QTreeWidget::currentItemChanged, this, &MainWindow::onTreeSelectionChanged);
 }
 
 void MainWindow::createMenus()
@@ -590,7 +1831,15 @@ void MainWindow::createMenus()
     connect(openAction, &QAction::triggered, this, &MainWindow::openFile);
     fileMenu->addAction(openAction);
 
-    QAction *exportAction = new QAction(tr("&Export Selected as PTS"), this);
+    QAction *openOutOfCoreAction = new QAction(tr("Open &Out-of-Core..."), this);
+    connect(openOutOfCoreAction, &QAction::triggered, this, &MainWindow::openOutOfCore);
+    fileMenu->addAction(openOutOfCoreAction);
+
+    QAction *cancelLoadingAction = new QAction(tr("&Cancel Loading"), this);
+    connect(cancelLoadingAction, &QAction::triggered, this, &MainWindow::cancelLoading);
+    fileMenu->addAction(cancelLoadingAction);
+
+    QAction *exportAction = new QAction(tr("&Export Selected..."), this);
     exportAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_E));
     connect(exportAction, &QAction::triggered, this, &MainWindow::exportPointCloud);
     fileMenu->addAction(exportAction);
@@ -611,112 +1860,863 @@ void MainWindow::createMenus()
 
     viewMenu->addSeparator();
 
-    QAction *showAllAction = new QAction(tr("Show &All"), this);
-    connect(showAllAction, &QAction::triggered, [this]() {
-        setAllVisible(true);
-    });
-    viewMenu->addAction(showAllAction);
+    QAction *showAllAction = new QAction(tr("Show &All"), this);
+    connect(showAllAction, &QAction::triggered, [this]() {
+        setAllVisible(true);
+    });
+    viewMenu->addAction(showAllAction);
+
+    QAction *hideAllAction = new QAction(tr("&Hide All"), this);
+    connect(hideAllAction, &QAction::triggered, [this]() {
+        setAllVisible(false);
+    });
+    viewMenu->addAction(hideAllAction);
+
+    viewMenu->addSeparator();
+
+    QMenu *pointSizeMenu = viewMenu->addMenu(tr("Point &Size"));
+
+    QAction *smallPointsAction = new QAction(tr("&Small (2px)"), this);
+    connect(smallPointsAction, &QAction::triggered, [this]() {
+        m_glWidget->setPointSize(2.0f);
+    });
+    pointSizeMenu->addAction(smallPointsAction);
+
+    QAction *mediumPointsAction = new QAction(tr("&Medium (4px)"), this);
+    connect(mediumPointsAction, &QAction::triggered, [this]() {
+        m_glWidget->setPointSize(4.0f);
+    });
+    pointSizeMenu->addAction(mediumPointsAction);
+
+    QAction *largePointsAction = new QAction(tr("&Large (6px)"), this);
+    connect(largePointsAction, &QAction::triggered, [this]() {
+        m_glWidget->setPointSize(6.0f);
+    });
+    pointSizeMenu->addAction(largePointsAction);
+
+    viewMenu->addSeparator();
+
+    QMenu *renderModeMenu = viewMenu->addMenu(tr("Render &Mode"));
+
+    QAction *standardPointsAction = new QAction(tr("&Standard Points"), this);
+    connect(standardPointsAction, &QAction::triggered, [this]() {
+        m_glWidget->setRenderMode(PointCloudGLWidget::POINTS);
+    });
+    renderModeMenu->addAction(standardPointsAction);
+
+    QAction *smoothPointsAction = new QAction(tr("S&mooth Points"), this);
+    connect(smoothPointsAction, &QAction::triggered, [this]() {
+        m_glWidget->setRenderMode(PointCloudGLWidget::POINTS_SMOOTH);
+    });
+    renderModeMenu->addAction(smoothPointsAction);
+
+    QMenu *pointBudgetMenu = viewMenu->addMenu(tr("Point &Budget"));
+    QActionGroup *pointBudgetGroup = new QActionGroup(this);
+
+    const QList<QPair<QString, qint64>> pointBudgets = {
+        { tr("&1 Million Points"), 1000000 },
+        { tr("&2 Million Points"), 2000000 },
+        { tr("&5 Million Points"), 5000000 },
+        { tr("1&0 Million Points"), 10000000 },
+        { tr("2&0 Million Points"), 20000000 },
+        { tr("&Unlimited"), 0 }
+    };
+    for (const auto &budget : pointBudgets) {
+        QAction *budgetAction = new QAction(budget.first, this);
+        budgetAction->setCheckable(true);
+        budgetAction->setChecked(budget.second == m_glWidget->pointBudget());
+        pointBudgetGroup->addAction(budgetAction);
+        connect(budgetAction, &QAction::triggered, [this, points = budget.second]() {
+            m_glWidget->setPointBudget(points);
+        });
+        pointBudgetMenu->addAction(budgetAction);
+    }
+
+    QMenu *frameRateMenu = viewMenu->addMenu(tr("&Interaction Frame Rate"));
+    QActionGroup *frameRateGroup = new QActionGroup(this);
+
+    // While the camera moves, detail is reduced to hold this rate; off always draws the full budget
+    const QList<QPair<QString, double>> frameTimes = {
+        { tr("&60 fps"), 1000.0 / 60.0 },
+        { tr("&30 fps"), 1000.0 / 30.0 },
+        { tr("&15 fps"), 1000.0 / 15.0 },
+        { tr("&Off"), 0.0 }
+    };
+    for (const auto &frameTime : frameTimes) {
+        QAction *frameTimeAction = new QAction(frameTime.first, this);
+        frameTimeAction->setCheckable(true);
+        frameTimeAction->setChecked(qFuzzyCompare(frameTime.second + 1.0, m_glWidget->targetFrameTime() + 1.0));
+        frameRateGroup->addAction(frameTimeAction);
+        connect(frameTimeAction, &QAction::triggered, [this, milliseconds = frameTime.second]() {
+            m_glWidget->setTargetFrameTime(milliseconds);
+        });
+        frameRateMenu->addAction(frameTimeAction);
+    }
+
+    QMenu *memoryMenu = viewMenu->addMenu(tr("Out-of-Core &Memory"));
+    QActionGroup *memoryGroup = new QActionGroup(this);
+
+    // Host and GPU residency limits for clouds opened out-of-core
+    const QList<QPair<QString, QPair<qint64, qint64>>> memoryBudgets = {
+        { tr("&Low (1 GB host, 512 MB GPU)"), { qint64(1) << 30, qint64(512) << 20 } },
+        { tr("&Medium (2 GB host, 1 GB GPU)"), { qint64(2) << 30, qint64(1) << 30 } },
+        { tr("&High (8 GB host, 2 GB GPU)"), { qint64(8) << 30, qint64(2) << 30 } },
+        { tr("&Very High (16 GB host, 4 GB GPU)"), { qint64(16) << 30, qint64(4) << 30 } }
+    };
+    for (const auto &memory : memoryBudgets) {
+        QAction *memoryAction = new QAction(memory.first, this);
+        memoryAction->setCheckable(true);
+        memoryAction->setChecked(memory.second.first == m_glWidget->hostMemoryBudget()
+                                 && memory.second.second == m_glWidget->gpuMemoryBudget());
+        memoryGroup->addAction(memoryAction);
+        connect(memoryAction, &QAction::triggered, [this, budgets = memory.second]() {
+            m_glWidget->setMemoryBudgets(budgets.first, budgets.second);
+        });
+        memoryMenu->addAction(memoryAction);
+    }
+
+    QMenu *viewportMenu = menuBar()->addMenu(tr("Viewport Select/Unselect"));
+    QAction *saveViewportAction = new QAction(tr("Save Viewport for Selected Entity"), this);
+    connect(saveViewportAction, &QAction::triggered, this, &MainWindow::saveViewportForSelectedEntity);
+    viewportMenu->addAction(saveViewportAction);
+
+    QAction *saveCameraPathAction = new QAction(tr("Save Viewports as Camera Path..."), this);
+    connect(saveCameraPathAction, &QAction::triggered, this, &MainWindow::saveViewportsAsCameraPath);
+    viewportMenu->addAction(saveCameraPathAction);
+
+    QAction *recordCameraPathAction = new QAction(tr("Record Camera Path"), this);
+    recordCameraPathAction->setCheckable(true);
+    connect(recordCameraPathAction, &QAction::toggled, this, &MainWindow::recordCameraPath);
+    viewportMenu->addAction(recordCameraPathAction);
+
+    viewportMenu->addSeparator();
+    QActionGroup *selectionToolGroup = new QActionGroup(this);
+
+    // Shift adds to the current selection, Ctrl removes from it and both together intersect with it
+    const QList<QPair<QString, PointCloudGLWidget::SelectionTool>> selectionTools = {
+        { tr("&Navigate"), PointCloudGLWidget::SelectionTool::Navigate },
+        { tr("&Rectangle Select Points"), PointCloudGLWidget::SelectionTool::Rectangle },
+        { tr("&Lasso Select Points"), PointCloudGLWidget::SelectionTool::Lasso }
+    };
+    for (const auto &tool : selectionTools) {
+        QAction *toolAction = new QAction(tool.first, this);
+        toolAction->setCheckable(true);
+        toolAction->setChecked(tool.second == m_glWidget->selectionTool());
+        selectionToolGroup->addAction(toolAction);
+        connect(toolAction, &QAction::triggered, [this, selectionTool = tool.second]() {
+            m_glWidget->setSelectionTool(selectionTool);
+        });
+        viewportMenu->addAction(toolAction);
+    }
+
+    QAction *clearSelectionAction = new QAction(tr("&Clear Point Selection"), this);
+    connect(clearSelectionAction, &QAction::triggered, this, &MainWindow::clearPointSelection);
+    viewportMenu->addAction(clearSelectionAction);
+
+    QAction *invertSelectionAction = new QAction(tr("&Invert Point Selection"), this);
+    connect(invertSelectionAction, &QAction::triggered, this, &MainWindow::invertPointSelection);
+    viewportMenu->addAction(invertSelectionAction);
+
+    QAction *extractSelectionAction = new QAction(tr("&Extract Selected Points"), this);
+    connect(extractSelectionAction, &QAction::triggered, this, &MainWindow::extractSelectedPoints);
+    viewportMenu->addAction(extractSelectionAction);
+
+    QMenu *processingMenu = menuBar()->addMenu(tr("&Processing"));
+
+    QAction *loadDownsamplingAction = new QAction(tr("Downsampling on &Load..."), this);
+    connect(loadDownsamplingAction, &QAction::triggered, this, &MainWindow::configureLoadDownsampling);
+    processingMenu->addAction(loadDownsamplingAction);
+
+    QAction *downsampleAction = new QAction(tr("&Downsample Selected Entity..."), this);
+    connect(downsampleAction, &QAction::triggered, this, &MainWindow::downsampleSelectedEntity);
+    processingMenu->addAction(downsampleAction);
+
+    processingMenu->addSeparator();
+
+    QAction *outlierAction = new QAction(tr("Remove Statistical &Outliers..."), this);
+    connect(outlierAction, &QAction::triggered, this, &MainWindow::removeStatisticalOutliers);
+    processingMenu->addAction(outlierAction);
+
+    QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
+
+    QAction *aboutAction = new QAction(tr("&About"), this);
+    connect(aboutAction, &QAction::triggered, this, &MainWindow::showAbout);
+    helpMenu->addAction(aboutAction);
+}
+
+void MainWindow::onFrameRendered(const PointCloudGLWidget::RenderStats &stats)
+{
+    m_renderStatsLabel->setText(tr("Chunks drawn: %1, culled: %2 | Points: %3 | Triangles: %4 | Draw calls: %5 | Frame: %6 ms%7")
+                                    .arg(stats.chunksDrawn)
+                                    .arg(stats.chunksCulled)
+                                    .arg(stats.pointsDrawn)
+                                    .arg(stats.trianglesDrawn)
+                                    .arg(stats.drawCalls)
+                                    .arg(stats.frameTimeMs, 0, 'f', 1)
+                                    .arg(stats.interactive ? tr(" (interactive)") : QString()));
+}
+
+void MainWindow::onPointPicked(EntityId id, qint64 pointIndex, Qt::KeyboardModifiers modifiers)
+{
+    // Clicking empty space unselects everything
+    if (!id)
+    {
+        m_treeWidget->setCurrentItem(nullptr);
+        m_treeWidget->clearSelection();
+        m_textEdit->clear();
+        statusBar()->showMessage(tr("Selection cleared"));
+        return;
+    }
+
+    QTreeWidgetItem *item = itemForEntity(id);
+    if (!item)
+        return;
+
+    // Ctrl-clicking a selected entity unselects just that one
+    if ((modifiers & Qt::ControlModifier) && item->isSelected())
+    {
+        item->setSelected(false);
+        statusBar()->showMessage(tr("Unselected %1").arg(m_scene->name(id)));
+        return;
+    }
+
+    // The tree selection drives the outlines; Shift adds to it instead of replacing it
+    m_treeWidget->setCurrentItem(item, 0, (modifiers & Qt::ShiftModifier) ? QItemSelectionModel::Select
+                                                                          : QItemSelectionModel::ClearAndSelect);
+    displayPointCloudInfo(id);
+
+    // The index is into the arrays as drawn; it is dropped if they have changed since
+    const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+    if (pointIndex < 0 || pointIndex >= pc->points.size())
+    {
+        statusBar()->showMessage(tr("Selected %1").arg(m_scene->name(id)));
+        return;
+    }
+
+    const QVector3D &point = pc->points[pointIndex];
+    m_textEdit->appendPlainText(QString());
+    m_textEdit->appendPlainText(tr("Picked point #%1:").arg(pointIndex));
+    m_textEdit->appendPlainText(tr("Position: %1, %2, %3").arg(point.x()).arg(point.y()).arg(point.z()));
+    if (pointIndex < pc->colors.size())
+    {
+        const PointColor &color = pc->colors[pointIndex];
+        m_textEdit->appendPlainText(tr("Color: %1, %2, %3").arg(color.r).arg(color.g).arg(color.b));
+    }
+    if (pointIndex < pc->intensities.size())
+        m_textEdit->appendPlainText(tr("Intensity: %1").arg(pc->intensities[pointIndex]));
+
+    statusBar()->showMessage(tr("Selected point #%1 of %2").arg(pointIndex).arg(m_scene->name(id)));
+}
+
+void MainWindow::onRegionSelected(const QPolygon &region, Qt::KeyboardModifiers modifiers)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // The shape is rasterized once, so testing a point is one lookup however many corners a lasso has
+    QImage mask(m_glWidget->size(), QImage::Format_Grayscale8);
+    mask.fill(0);
+    {
+        QPainter painter(&mask);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(Qt::white);
+        painter.drawPolygon(region);
+    }
+
+    PointSelection::Combine mode = PointSelection::Combine::Replace;
+    if ((modifiers & Qt::ShiftModifier) && (modifiers & Qt::ControlModifier))
+        mode = PointSelection::Combine::Intersect;
+    else if (modifiers & Qt::ShiftModifier)
+        mode = PointSelection::Combine::Add;
+    else if (modifiers & Qt::ControlModifier)
+        mode = PointSelection::Combine::Subtract;
+
+    const QMatrix4x4 modelViewProjection = m_glWidget->modelViewProjection();
+    qint64 selectedPoints = 0;
+    int selectedEntities = 0;
+
+    // Hidden and out-of-core entities keep whatever selection they had
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+        if (!pc->isVisible || pc->points.isEmpty())
+            continue;
+
+        PointSelection selection = m_scene->selection(id);
+        selection.combine(PointSelection::inRegion(pc->points, modelViewProjection, mask), mode);
+        m_scene->setSelection(id, selection);
+
+        const qsizetype count = selection.count();
+        if (count > 0) {
+            selectedPoints += count;
+            ++selectedEntities;
+        }
+    }
+
+    statusBar()->showMessage(tr("%1 points selected in %2 entities (%3 ms)")
+                                 .arg(selectedPoints)
+                                 .arg(selectedEntities)
+                                 .arg(timer.elapsed()));
+
+    if (EntityId id = getSelectedPointCloud())
+        displayPointCloudInfo(id);
+}
+
+void MainWindow::clearPointSelection()
+{
+    for (EntityId id : m_scene->entityIds())
+        m_scene->clearSelection(id);
+
+    if (EntityId id = getSelectedPointCloud())
+        displayPointCloudInfo(id);
+    statusBar()->showMessage(tr("Point selection cleared"));
+}
+
+void MainWindow::invertPointSelection()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Like region selection, only what is drawn in memory takes part
+    qint64 selectedPoints = 0;
+    for (EntityId id : m_scene->entityIds()) {
+        const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+        if (!pc->isVisible || pc->points.isEmpty())
+            continue;
+
+        PointSelection selection = m_scene->selection(id);
+        selection.resize(pc->points.size());
+        selection.invert();
+        m_scene->setSelection(id, selection);
+        selectedPoints += selection.count();
+    }
+
+    statusBar()->showMessage(tr("%1 points selected (%2 ms)").arg(selectedPoints).arg(timer.elapsed()));
+
+    if (EntityId id = getSelectedPointCloud())
+        displayPointCloudInfo(id);
+}
+
+void MainWindow::extractSelectedPoints()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Copied, since the new entities are appended to the list being walked
+    const QVector<EntityId> ids = m_scene->entityIds();
+    QTreeWidgetItem *lastItem = nullptr;
+    qint64 extractedPoints = 0;
+
+    for (EntityId id : ids) {
+        const PointSelection selection = m_scene->selection(id);
+        if (selection.isEmpty())
+            continue;
+
+        const QSharedPointer<const PointCloud> source = m_scene->cloud(id);
+        const PointAttributes points = selection.extract(*source);
+        if (points.points.isEmpty())
+            continue;
+
+        const QString name = uniqueEntityName(tr("%1 (selection)").arg(m_scene->name(id)));
+        QTreeWidgetItem *item = addDerivedEntity(id, name, points);
+
+        extractedPoints += points.size();
+        lastItem = item;
+    }
+
+    if (!lastItem) {
+        statusBar()->showMessage(tr("No points are selected"));
+        return;
+    }
+
+    m_treeWidget->setCurrentItem(lastItem);
+    statusBar()->showMessage(tr("Extracted %1 points (%2 ms)").arg(extractedPoints).arg(timer.elapsed()));
+}
+
+QTreeWidgetItem *MainWindow::addDerivedEntity(EntityId source, const QString &name, const PointAttributes &points)
+{
+    const QSharedPointer<const PointCloud> sourceCloud = m_scene->cloud(source);
+
+    PointCloud pc;
+    pc.sourceFormat = sourceCloud->sourceFormat;
+    pc.pointSize = sourceCloud->pointSize;
+    pc.tintColor = sourceCloud->tintColor;
+
+    const EntityId id = m_scene->addEntity(name, pc);
+    m_scene->appendPoints(id, points);
+    m_scene->buildLevelOfDetail(id);
+
+    QTreeWidgetItem *item = new QTreeWidgetItem();
+    item->setText(0, name);
+    item->setData(0, Qt::UserRole, id);
+    item->setToolTip(0, tr("Derived from %1").arg(m_scene->name(source)));
+    item->setText(1, QString::number(points.size()));
+    item->setCheckState(0, Qt::Checked);
+    item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+    item->setIcon(0, QIcon(":/icons/text-x-generic.png"));
+    m_treeWidget->addTopLevelItem(item);
+    return item;
+}
+
+bool MainWindow::askDownsamplingOptions(const QString &title, VoxelGrid::Options &options, bool *enabled)
+{
+    QDialog dialog(this);
+    dialog.setWindowTitle(title);
+    QFormLayout *layout = new QFormLayout(&dialog);
+
+    QCheckBox *enabledBox = nullptr;
+    if (enabled) {
+        enabledBox = new QCheckBox(tr("Downsample point files as they load"), &dialog);
+        enabledBox->setChecked(*enabled);
+        layout->addRow(enabledBox);
+    }
+
+    QDoubleSpinBox *sizeBox = new QDoubleSpinBox(&dialog);
+    sizeBox->setDecimals(4);
+    sizeBox->setRange(0.0001, 1000000.0);
+    sizeBox->setValue(options.voxelSize > 0.0f ? options.voxelSize : 0.05);
+    layout->addRow(tr("Voxel size:"), sizeBox);
+
+    QComboBox *policyBox = new QComboBox(&dialog);
+    policyBox->addItem(tr("Average of each voxel"), int(VoxelGrid::Policy::Average));
+    policyBox->addItem(tr("First point of each voxel"), int(VoxelGrid::Policy::FirstPoint));
+    policyBox->setCurrentIndex(options.policy == VoxelGrid::Policy::FirstPoint ? 1 : 0);
+    layout->addRow(tr("Keep:"), policyBox);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return false;
+
+    options.voxelSize = float(sizeBox->value());
+    options.policy = VoxelGrid::Policy(policyBox->currentData().toInt());
+    if (enabled)
+        *enabled = enabledBox->isChecked();
+    return true;
+}
+
+void MainWindow::configureLoadDownsampling()
+{
+    bool enabled = m_loader->downsampling().isEnabled();
+    if (!askDownsamplingOptions(tr("Downsampling on Load"), m_downsampleOptions, &enabled))
+        return;
+
+    VoxelGrid::Options options = m_downsampleOptions;
+    if (!enabled)
+        options.voxelSize = 0.0f;
+    m_loader->setDownsampling(options);
+
+    statusBar()->showMessage(enabled ? tr("Files opened from now on are downsampled to %1 voxels").arg(options.voxelSize)
+                                     : tr("Downsampling on load is off"));
+}
+
+void MainWindow::downsampleSelectedEntity()
+{
+    const EntityId id = getSelectedPointCloud();
+    const QSharedPointer<const PointCloud> pc = id ? m_scene->cloud(id) : QSharedPointer<const PointCloud>();
+    if (!pc || pc->points.isEmpty())
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Select a point cloud held in memory to downsample."));
+        return;
+    }
+
+    if (m_downsampleWatcher.isRunning())
+    {
+        statusBar()->showMessage(tr("Downsampling is still running"));
+        return;
+    }
+
+    if (!askDownsamplingOptions(tr("Downsample %1").arg(m_scene->name(id)), m_downsampleOptions))
+        return;
+
+    // A shallow copy; edits to the entity meanwhile detach from it
+    const PointAttributes source = *pc;
+    const VoxelGrid::Options options = m_downsampleOptions;
+    m_downsampleEntity = id;
+    m_downsampleWatcher.setFuture(QtConcurrent::run([source, options]() {
+        DownsampleResult result;
+        result.points = VoxelGrid::downsample(source, options, &result.stats);
+        return result;
+    }));
+
+    statusBar()->showMessage(tr("Downsampling %1...").arg(m_scene->name(id)));
+}
+
+void MainWindow::onDownsamplingFinished()
+{
+    const DownsampleResult result = m_downsampleWatcher.result();
+    const EntityId id = m_downsampleEntity;
+    m_downsampleEntity = 0;
+
+    // The copy takes its name and look from the source, so that must still be there
+    if (!m_scene->contains(id))
+    {
+        statusBar()->showMessage(tr("Downsampling discarded: the entity was removed while it ran"));
+        return;
+    }
+
+    const QString name = uniqueEntityName(tr("%1 (voxel %2)").arg(m_scene->name(id)).arg(result.stats.voxelSize));
+    m_treeWidget->setCurrentItem(addDerivedEntity(id, name, result.points));
+
+    statusBar()->showMessage(tr("Downsampled %1 to %2 points (%3%) in %4 ms")
+                                 .arg(result.stats.inputPoints)
+                                 .arg(result.stats.outputPoints)
+                                 .arg(100.0 * result.stats.reductionRatio(), 0, 'f', 1)
+                                 .arg(result.stats.elapsedMs));
+}
+
+void MainWindow::removeStatisticalOutliers()
+{
+    const EntityId id = getSelectedPointCloud();
+    const QSharedPointer<const PointCloud> pc = id ? m_scene->cloud(id) : QSharedPointer<const PointCloud>();
+    if (!pc || pc->points.isEmpty())
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Select a point cloud held in memory to filter."));
+        return;
+    }
+
+    if (m_outlierWatcher.isRunning())
+    {
+        statusBar()->showMessage(tr("Outlier removal is still running"));
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Remove Outliers from %1").arg(m_scene->name(id)));
+    QFormLayout *layout = new QFormLayout(&dialog);
+
+    QSpinBox *neighboursBox = new QSpinBox(&dialog);
+    neighboursBox->setRange(1, 256);
+    neighboursBox->setValue(m_outlierOptions.neighbours);
+    layout->addRow(tr("Neighbours:"), neighboursBox);
+
+    QDoubleSpinBox *deviationsBox = new QDoubleSpinBox(&dialog);
+    deviationsBox->setDecimals(2);
+    deviationsBox->setRange(0.0, 100.0);
+    deviationsBox->setSingleStep(0.1);
+    deviationsBox->setValue(m_outlierOptions.standardDeviations);
+    layout->addRow(tr("Standard deviations:"), deviationsBox);
+
+    QComboBox *outputBox = new QComboBox(&dialog);
+    outputBox->addItem(tr("New entity without the outliers"));
+    outputBox->addItem(tr("Select the outliers"));
+    outputBox->setCurrentIndex(m_outliersAsSelection ? 1 : 0);
+    layout->addRow(tr("Result:"), outputBox);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    m_outlierOptions.neighbours = neighboursBox->value();
+    m_outlierOptions.standardDeviations = float(deviationsBox->value());
+    m_outliersAsSelection = outputBox->currentIndex() == 1;
+
+    m_outlierTimer.start();
+    m_outlierEntity = id;
+    m_outlierSource = pc->points;
+
+    // A tree already built for these points is reused; otherwise it is built on the pool too
+    const QSharedPointer<const PointKdTree> tree = m_scene->builtSpatialIndex(id);
+    const QVector<QVector3D> points = m_outlierSource;
+    const OutlierFilter::Options options = m_outlierOptions;
+    m_outlierWatcher.setFuture(QtConcurrent::run([points, tree, options]() {
+        const PointKdTree built = tree ? PointKdTree() : PointKdTree::build(points);
+        OutlierResult result;
+        result.outliers = OutlierFilter::findOutliers(points, tree ? *tree : built, options, &result.stats);
+        return result;
+    }));
+
+    statusBar()->showMessage(tr("Removing outliers from %1...").arg(m_scene->name(id)));
+}
+
+void MainWindow::onOutlierFilterFinished()
+{
+    OutlierResult result = m_outlierWatcher.result();
+    const EntityId id = m_outlierEntity;
+    const QSharedPointer<const PointCloud> pc = m_scene->contains(id) ? m_scene->cloud(id) : QSharedPointer<const PointCloud>();
+
+    // Any edit or reordering of the points detaches them from the copy the filter ran on
+    const bool current = pc && pc->points.constData() == m_outlierSource.constData();
+    m_outlierSource = QVector<QVector3D>();
+    m_outlierEntity = 0;
+    if (!current)
+    {
+        statusBar()->showMessage(tr("Outlier removal discarded: the points changed while it ran"));
+        return;
+    }
+
+    if (m_outliersAsSelection)
+    {
+        m_scene->setSelection(id, result.outliers);
+        displayPointCloudInfo(id);
+    }
+    else
+    {
+        result.outliers.invert();
+        const QString name = uniqueEntityName(tr("%1 (filtered)").arg(m_scene->name(id)));
+        m_treeWidget->setCurrentItem(addDerivedEntity(id, name, result.outliers.extract(*pc)));
+    }
+
+    statusBar()->showMessage(tr("Found %1 outliers among %2 points (mean neighbour distance above %3) in %4 ms")
+                                 .arg(result.stats.outliers)
+                                 .arg(result.stats.inputPoints)
+                                 .arg(result.stats.threshold, 0, 'g', 4)
+                                 .arg(m_outlierTimer.elapsed()));
+}
+
+void MainWindow::openFile()
+{
+    QStringList filenames = QFileDialog::getOpenFileNames(
+        this, tr("Open 3D Model Files"), QString(), getSupportedFormatsFilter()
+        );
+
+    for (const QString &filename : filenames)
+    {
+        startLoading(filename);
+    }
+}
+
+void MainWindow::openOutOfCore()
+{
+    QStringList filenames = QFileDialog::getOpenFileNames(
+        this, tr("Open Point Clouds Out-of-Core"), QString(), tr("PTS Files (*.pts)")
+        );
+
+    for (const QString &filename : filenames)
+    {
+        startLoading(filename, true);
+    }
+}
+
+QString MainWindow::uniqueEntityName(const QString &fileName) const
+{
+    QString name = fileName;
+    for (int suffix = 2; m_scene->containsName(name); ++suffix)
+        name = QString("%1 (%2)").arg(fileName).arg(suffix);
+    return name;
+}
 
-    QAction *hideAllAction = new QAction(tr("&Hide All"), this);
-    connect(hideAllAction, &QAction::triggered, [this]() {
-        setAllVisible(false);
-    });
-    viewMenu->addAction(hideAllAction);
+void MainWindow::startLoading(const QString &filename, bool outOfCore)
+{
+    QFileInfo fileInfo(filename);
+    QString name = uniqueEntityName(fileInfo.fileName());
+    QString extension = fileInfo.suffix().toLower();
+
+    PointCloud pc;
+    pc.sourceFormat = extension.toUpper();
+    pc.isVisible = true; // Default to visible
+
+    QColor colors[] = {
+        QColor(255, 255, 255),
+        QColor(230, 230, 255),
+        QColor(230, 255, 230),
+        QColor(255, 230, 230),
+        QColor(255, 255, 230),
+        QColor(230, 255, 255),
+        QColor(255, 230, 255)
+    };
+    pc.tintColor = colors[m_scene->count() % 7];
+    EntityId id = m_scene->addEntity(name, pc);
+
+    // The entity is listed right away and fills in as batches arrive
+    QTreeWidgetItem *item = new QTreeWidgetItem();
+    item->setText(0, name);
+    item->setData(0, Qt::UserRole, id);
+    item->setToolTip(0, filename);
+    item->setText(1, tr("Loading..."));
+    item->setCheckState(0, Qt::Checked); // Default to checked
+    item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+    item->setIcon(0, QIcon(PointCloudLoader::isAssimpFormat(extension) ? ":/icons/model.png" : ":/icons/text-x-generic.png"));
+    m_treeWidget->addTopLevelItem(item);
+    m_treeWidget->expandAll();
+    m_treeWidget->setCurrentItem(item);
 
-    viewMenu->addSeparator();
+    PendingLoad load;
+    load.entity = id;
+    load.filename = filename;
+    load.item = item;
+    m_pendingLoads.insert(outOfCore ? m_loader->loadOutOfCore(filename) : m_loader->load(filename), load);
 
-    QMenu *pointSizeMenu = viewMenu->addMenu(tr("Point &Size"));
+    statusBar()->showMessage(tr("Loading %1...").arg(name));
+}
 
-    QAction *smallPointsAction = new QAction(tr("&Small (2px)"), this);
-    connect(smallPointsAction, &QAction::triggered, [this]() {
-        m_glWidget->setPointSize(2.0f);
-    });
-    pointSizeMenu->addAction(smallPointsAction);
+void MainWindow::cancelLoading()
+{
+    // Cancel the selected file if it is still loading, otherwise everything in flight
+    EntityId selected = getSelectedPointCloud();
+    for (auto it = m_pendingLoads.constBegin(); it != m_pendingLoads.constEnd(); ++it) {
+        if (selected && it.value().entity == selected) {
+            m_loader->cancel(it.key());
+            return;
+        }
+    }
 
-    QAction *mediumPointsAction = new QAction(tr("&Medium (4px)"), this);
-    connect(mediumPointsAction, &QAction::triggered, [this]() {
-        m_glWidget->setPointSize(4.0f);
-    });
-    pointSizeMenu->addAction(mediumPointsAction);
+    m_loader->cancelAll();
+}
 
-    QAction *largePointsAction = new QAction(tr("&Large (6px)"), this);
-    connect(largePointsAction, &QAction::triggered, [this]() {
-        m_glWidget->setPointSize(6.0f);
-    });
-    pointSizeMenu->addAction(largePointsAction);
+void MainWindow::removeEntity(EntityId id, QTreeWidgetItem *item)
+{
+    delete item;
+    m_scene->removeEntity(id);
+}
 
-    viewMenu->addSeparator();
+void MainWindow::onLoadProgress(int jobId, int percent)
+{
+    auto it = m_pendingLoads.find(jobId);
+    if (it == m_pendingLoads.end())
+        return;
 
-    QMenu *renderModeMenu = viewMenu->addMenu(tr("Render &Mode"));
+    it->item->setText(1, tr("Loading %1%").arg(percent));
+}
 
-    QAction *standardPointsAction = new QAction(tr("&Standard Points"), this);
-    connect(standardPointsAction, &QAction::triggered, [this]() {
-        m_glWidget->setRenderMode(PointCloudGLWidget::POINTS);
-    });
-    renderModeMenu->addAction(standardPointsAction);
+void MainWindow::onBatchReady(int jobId, const PointBatch &batch)
+{
+    auto it = m_pendingLoads.find(jobId);
+    if (it == m_pendingLoads.end())
+        return;
 
-    QAction *smoothPointsAction = new QAction(tr("S&mooth Points"), this);
-    connect(smoothPointsAction, &QAction::triggered, [this]() {
-        m_glWidget->setRenderMode(PointCloudGLWidget::POINTS_SMOOTH);
-    });
-    renderModeMenu->addAction(smoothPointsAction);
+    it->queuedBatches.append(batch);
+    if (!m_batchFlushTimer->isActive())
+        m_batchFlushTimer->start();
+}
 
-    QMenu *viewportMenu = menuBar()->addMenu(tr("Viewport Select/Unselect"));
-    QAction *saveViewportAction = new QAction(tr("Save Viewport for Selected Entity"), this);
-    connect(saveViewportAction, &QAction::triggered, this, &MainWindow::saveViewportForSelectedEntity);
-    viewportMenu->addAction(saveViewportAction);
+void MainWindow::onMeshReady(int jobId, const MeshPart &mesh)
+{
+    auto it = m_pendingLoads.find(jobId);
+    if (it == m_pendingLoads.end())
+        return;
 
-    QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
+    // Meshes arrive whole and far less often than point batches, so they go straight in
+    m_scene->appendMesh(it->entity, mesh);
+    if (!it->focused && it->item == m_treeWidget->currentItem()) {
+        it->focused = true;
+        focusCameraOnPointCloud(it->entity);
+    }
+}
 
-    QAction *aboutAction = new QAction(tr("&About"), this);
-    connect(aboutAction, &QAction::triggered, this, &MainWindow::showAbout);
-    helpMenu->addAction(aboutAction);
+void MainWindow::flushLoadedBatches()
+{
+    for (auto it = m_pendingLoads.begin(); it != m_pendingLoads.end(); ++it) {
+        PendingLoad &load = it.value();
+        if (load.queuedBatches.isEmpty())
+            continue;
+
+        for (const PointBatch &batch : load.queuedBatches)
+            m_scene->appendPoints(load.entity, batch);
+        load.queuedBatches.clear();
+
+        // Frame the file being looked at as soon as its first points are visible
+        if (!load.focused && load.item == m_treeWidget->currentItem()) {
+            load.focused = true;
+            focusCameraOnPointCloud(load.entity);
+        }
+    }
 }
 
-void MainWindow::openFile()
+void MainWindow::onLoadFinished(int jobId, const LoadSummary &summary)
 {
-    QStringList filenames = QFileDialog::getOpenFileNames(
-        this, tr("Open 3D Model Files"), QString(), getSupportedFormatsFilter()
-        );
+    flushLoadedBatches();
 
-    for (const QString &filename : filenames)
+    PendingLoad load = m_pendingLoads.take(jobId);
+    if (!load.item)
+        return;
+
+    if (!summary.chunkFile.isEmpty()) {
+        finishOutOfCoreLoad(load, summary);
+        return;
+    }
+
+    if (!m_scene->contains(load.entity) || !m_scene->cloud(load.entity)->hasGeometry())
     {
-        QFileInfo fileInfo(filename);
-        QString extension = fileInfo.suffix().toLower();
+        removeEntity(load.entity, load.item);
+        QMessageBox::warning(this, tr("Error"), tr("No valid points found in file: %1").arg(load.filename));
+        return;
+    }
 
-        bool success = false;
+    if (summary.stats.malformedLines > 0)
+        qDebug() << "Skipped" << summary.stats.malformedLines << "malformed lines in" << load.filename;
+
+    m_scene->setSourceFormat(load.entity, summary.sourceFormat);
+    const QSharedPointer<const PointCloud> pc = m_scene->cloud(load.entity);
+    // The cache holds the points as read; a model would lose its faces, a downsampled file its detail
+    if (summary.cacheable && !summary.fromCache && pc->meshes.isEmpty() && summary.downsampling.inputPoints == 0)
+        m_loader->storeInCache(load.filename, summary.sourceFormat, *pc, pc->boundingBoxMin, pc->boundingBoxMax);
+    m_scene->buildLevelOfDetail(load.entity);
+
+    const qsizetype pointCount = pc->points.size();
+    load.item->setText(1, pc->meshes.isEmpty() ? QString::number(pointCount) : tr("%1 triangles").arg(summary.triangles));
+
+    statusBar()->showMessage(tr("Loaded %1 with %2 points%3%4 (%5 MB/s, %6 points/s)")
+                                 .arg(m_scene->name(load.entity))
+                                 .arg(pointCount)
+                                 .arg(summary.triangles ? tr(" and %1 triangles").arg(summary.triangles) : QString())
+                                 .arg(summary.fromCache ? tr(" from cache") : QString())
+                                 .arg(summary.stats.megabytesPerSecond(), 0, 'f', 1)
+                                 .arg(summary.stats.pointsPerSecond(), 0, 'f', 0));
+
+    if (summary.downsampling.inputPoints > 0)
+        statusBar()->showMessage(statusBar()->currentMessage()
+                                 + tr(", downsampled from %1 points (%2%) in %3 ms")
+                                       .arg(summary.downsampling.inputPoints)
+                                       .arg(100.0 * summary.downsampling.reductionRatio(), 0, 'f', 1)
+                                       .arg(summary.downsampling.elapsedMs));
+
+    if (load.item == m_treeWidget->currentItem()) {
+        displayPointCloudInfo(load.entity);
+        focusCameraOnPointCloud(load.entity);
+    }
+}
 
-        if (extension == "pts")
-        {
-            success = loadPointCloud(filename);
-        }
-#ifdef USE_ASSIMP
-        else if (extension == "obj" || extension == "fbx" || extension == "dae" ||
-                 extension == "3ds" || extension == "ply" || extension == "stl" ||
-                 extension == "gltf" || extension == "glb")
-        {
-            success = loadModelWithAssimp(filename);
-        }
-#endif
-        else
-        {
-            success = loadPointCloud(filename);
-#ifdef USE_ASSIMP
-            if (!success)
-            {
-                success = loadModelWithAssimp(filename);
-            }
-#endif
-        }
+void MainWindow::finishOutOfCoreLoad(const PendingLoad &load, const LoadSummary &summary)
+{
+    QSharedPointer<OutOfCoreCloud> cloud(new OutOfCoreCloud);
+    QString errorMessage;
+    if (!cloud->open(summary.chunkFile, &errorMessage)) {
+        removeEntity(load.entity, load.item);
+        QMessageBox::warning(this, tr("Error"), tr("Failed to open %1 out-of-core.\n%2").arg(load.filename, errorMessage));
+        return;
+    }
 
-        if (!success)
-        {
-            QMessageBox::warning(this, tr("Error"),
-                                 tr("Failed to load file: %1. Unsupported format or file is corrupted.").arg(filename));
-        }
+    m_scene->setSourceFormat(load.entity, summary.sourceFormat);
+    m_scene->setOutOfCore(load.entity, cloud);
+    load.item->setText(1, QString::number(cloud->pointCount()));
+
+    statusBar()->showMessage(tr("Opened %1 out-of-core: %2 points in %3 chunks")
+                                 .arg(m_scene->name(load.entity))
+                                 .arg(cloud->pointCount())
+                                 .arg(cloud->chunks().size()));
+
+    if (load.item == m_treeWidget->currentItem()) {
+        displayPointCloudInfo(load.entity);
+        focusCameraOnPointCloud(load.entity);
     }
+}
+
+void MainWindow::onLoadFailed(int jobId, const QString &errorMessage)
+{
+    PendingLoad load = m_pendingLoads.take(jobId);
+    if (!load.item)
+        return;
+
+    removeEntity(load.entity, load.item);
+    QMessageBox::warning(this, tr("Error"),
+                         tr("Failed to load file: %1. Unsupported format or file is corrupted.\n%2").arg(load.filename, errorMessage));
+}
+
+void MainWindow::onLoadCancelled(int jobId)
+{
+    PendingLoad load = m_pendingLoads.take(jobId);
+    if (!load.item)
+        return;
 
-    updateAllVisiblePointClouds();
+    statusBar()->showMessage(tr("Cancelled loading %1").arg(m_scene->name(load.entity)));
+    removeEntity(load.entity, load.item);
 }
 
 void MainWindow::setAllVisible(bool visible)
@@ -727,14 +2727,10 @@ void MainWindow::setAllVisible(bool visible)
         QTreeWidgetItem* item = m_treeWidget->topLevelItem(i);
         item->setCheckState(0, visible ? Qt::Checked : Qt::Unchecked);
 
-        QString name = item->data(0, Qt::UserRole).toString();
-        if (m_pointClouds.contains(name)) {
-            m_pointClouds[name].isVisible = visible;
-        }
+        m_scene->setVisible(entityForItem(item), visible);
     }
 
     m_treeWidget->blockSignals(false);
-    updateAllVisiblePointClouds();
 }
 
 void MainWindow::exportPointCloud()
@@ -746,257 +2742,176 @@ void MainWindow::exportPointCloud()
         return;
     }
 
-    QString name = currentItem->data(0, Qt::UserRole).toString();
-    if (!m_pointClouds.contains(name))
+    EntityId id = entityForItem(currentItem);
+    if (!id)
     {
         QMessageBox::warning(this, tr("Error"), tr("Selected item is not a valid point cloud."));
         return;
     }
 
-    const PointCloud &pc = m_pointClouds[name];
-    QString defaultName = name;
-    if (!defaultName.endsWith(".pts"))
+    if (m_scene->outOfCore(id))
     {
-        defaultName = defaultName.split('.').first() + ".pts";
+        QMessageBox::warning(this, tr("Error"), tr("Point clouds opened out-of-core cannot be exported."));
+        return;
     }
 
+    // An implicitly shared copy of the arrays: the progress dialog processes events while
+    // writing, and a level-of-detail reorder or a streamed batch may replace the store's
+    const PointAttributes snapshot = *m_scene->cloud(id);
+    // The filter offered first writes .pts; picking another one swaps the suffix below
+    const QString defaultName = QFileInfo(m_scene->name(id)).completeBaseName() + ".pts";
+
+    // Filters in the order of ExportFormat
+    const QStringList filters = {
+        tr("Point Cloud Files (*.pts)"),
+        tr("Point Cloud Files, Fixed Precision (*.pts)"),
+        tr("PLY Files, Binary (*.ply)"),
+        tr("LAS Files (*.las)")
+    };
+    QString selectedFilter = filters.first();
     QString filename = QFileDialog::getSaveFileName(
-        this, tr("Export Point Cloud"), defaultName, tr("Point Cloud Files (*.pts);;All Files (*)")
+        this, tr("Export Point Cloud"), defaultName,
+        filters.join(";;") + ";;" + tr("All Files (*)"), &selectedFilter
         );
 
     if (filename.isEmpty())
         return;
 
-    if (saveAsPts(filename, pc))
+    // With "All Files" the extension decides; a chosen filter replaces another export
+    // format's extension, so the suggested name does not become scan.pts.ply
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    ExportFormat format = ExportFormat::Pts;
+    if (filters.contains(selectedFilter))
     {
-        statusBar()->showMessage(tr("Exported %1 points to %2").arg(pc.points.size()).arg(filename));
+        format = ExportFormat(filters.indexOf(selectedFilter));
+        const QString expected = format == ExportFormat::Ply ? "ply" : format == ExportFormat::Las ? "las" : "pts";
+        if (suffix != expected)
+        {
+            if (suffix == "pts" || suffix == "ply" || suffix == "las")
+                filename.chop(suffix.size() + 1);
+            filename += "." + expected;
+        }
     }
-    else
+    else if (suffix == "ply")
     {
-        QMessageBox::warning(this, tr("Error"), tr("Failed to export point cloud to %1").arg(filename));
+        format = ExportFormat::Ply;
     }
-}
-
-bool MainWindow::saveAsPts(const QString &filename, const PointCloud &pc)
-{
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    else if (suffix == "las")
     {
-        return false;
+        format = ExportFormat::Las;
     }
 
-    QTextStream out(&file);
-    QProgressDialog progress(tr("Exporting point cloud..."), tr("Cancel"), 0, pc.points.size(), this);
-    progress.setWindowModality(Qt::WindowModal);
-
-    for (int i = 0; i < pc.points.size(); ++i)
+    PtsWriteStats stats;
+    if (savePointCloud(filename, snapshot, format, &stats))
     {
-        if (i % 1000 == 0)
-        {
-            progress.setValue(i);
-            if (progress.wasCanceled())
-            {
-                file.close();
-                return false;
-            }
-        }
-
-        const QVector3D &point = pc.points[i];
-        const QVector3D &color = pc.colors[i];
-
-        out << QString("%1 %2 %3 %4 %5 %6\n")
-                   .arg(point.x(), 0, 'f', 6)
-                   .arg(point.y(), 0, 'f', 6)
-                   .arg(point.z(), 0, 'f', 6)
-                   .arg(qRound(color.x()))
-                   .arg(qRound(color.y()))
-                   .arg(qRound(color.z()));
+        statusBar()->showMessage(tr("Exported %1 points to %2 (%3 MB/s, %4 points/s)")
+                                     .arg(snapshot.size())
+                                     .arg(filename)
+                                     .arg(stats.megabytesPerSecond(), 0, 'f', 1)
+                                     .arg(stats.pointsPerSecond(), 0, 'f', 0));
+    }
+    else
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Failed to export point cloud to %1").arg(filename));
     }
-
-    progress.setValue(pc.points.size());
-    file.close();
-    return true;
 }
 
-bool MainWindow::loadPointCloud(const QString &filename)
+bool MainWindow::savePointCloud(const QString &filename, const PointAttributes &pc,
+                                ExportFormat format, PtsWriteStats *stats)
 {
-    try
-    {
-        QFile file(filename);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to open file: %1").arg(filename));
-            return false;
-        }
-
-        PointCloud pc;
-        QTextStream in(&file);
-        QProgressDialog progress(tr("Loading point cloud..."), tr("Cancel"), 0, 100, this);
-        progress.setWindowModality(Qt::WindowModal);
-
-        qint64 fileSize = file.size();
-        qint64 bytesRead = 0;
-        int lastProgress = 0;
-
-        int lineNumber = 0;
-        while (!in.atEnd())
-        {
-            QString line = in.readLine().trimmed();
-            lineNumber++;
-
-            bytesRead += line.length() + 1;
-            int currentProgress = static_cast<int>((bytesRead * 100) / fileSize);
-            if (currentProgress != lastProgress)
-            {
-                progress.setValue(currentProgress);
-                lastProgress = currentProgress;
-
-                if (progress.wasCanceled())
-                {
-                    file.close();
-                    return false;
-                }
-            }
-
-            if (line.isEmpty())
-                continue;
-
-            QStringList values = line.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
-
-            if (values.size() >= 3)
-            {
-                bool ok1 = false, ok2 = false, ok3 = false;
-                float x = values[0].toFloat(&ok1);
-                float y = values[1].toFloat(&ok2);
-                float z = values[2].toFloat(&ok3);
-
-                if (!ok1 || !ok2 || !ok3)
-                {
-                    qDebug() << "Error parsing point coordinates at line" << lineNumber;
-                    continue;
-                }
-
-                pc.points.append(QVector3D(x, y, z));
-
-                if (values.size() >= 6)
-                {
-                    bool ok4 = false, ok5 = false, ok6 = false;
-                    int r = values[3].toInt(&ok4);
-                    int g = values[4].toInt(&ok5);
-                    int b = values[5].toInt(&ok6);
-
-                    if (!ok4 || !ok5 || !ok6)
-                    {
-                        qDebug() << "Error parsing color values at line" << lineNumber;
-                        pc.colors.append(QVector3D(255, 255, 255));
-                    }
-                    else
-                    {
-                        r = qBound(0, r, 255);
-                        g = qBound(0, g, 255);
-                        b = qBound(0, b, 255);
-                        pc.colors.append(QVector3D(r, g, b));
-                    }
-                }
-                else
-                {
-                    pc.colors.append(QVector3D(255, 255, 255));
-                }
-            }
-        }
-
-        file.close();
-        progress.setValue(100);
+    QProgressDialog progress(tr("Exporting point cloud..."), tr("Cancel"), 0, 100, this);
+    progress.setWindowModality(Qt::WindowModal);
 
-        if (pc.points.isEmpty())
-        {
-            QMessageBox::warning(this, tr("Error"), tr("No valid points found in file: %1").arg(filename));
-            return false;
-        }
+    auto reportProgress = [&progress](int percent) {
+        progress.setValue(percent);
+        return !progress.wasCanceled();
+    };
 
-        pc.boundingBoxMin = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-        pc.boundingBoxMax = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
-        for (const auto& point : pc.points) {
-            pc.boundingBoxMin.setX(qMin(pc.boundingBoxMin.x(), point.x()));
-            pc.boundingBoxMin.setY(qMin(pc.boundingBoxMin.y(), point.y()));
-            pc.boundingBoxMin.setZ(qMin(pc.boundingBoxMin.z(), point.z()));
-            pc.boundingBoxMax.setX(qMax(pc.boundingBoxMax.x(), point.x()));
-            pc.boundingBoxMax.setY(qMax(pc.boundingBoxMax.y(), point.y()));
-            pc.boundingBoxMax.setZ(qMax(pc.boundingBoxMax.z(), point.z()));
-        }
+    QString error;
+    bool ok = false;
+    switch (format)
+    {
+    case ExportFormat::Pts:
+        ok = PtsWriter::writeFile(filename, pc, PtsWriter::Format::Compact, reportProgress, stats, &error);
+        break;
+    case ExportFormat::PtsFixedPrecision:
+        ok = PtsWriter::writeFile(filename, pc, PtsWriter::Format::Legacy, reportProgress, stats, &error);
+        break;
+    case ExportFormat::Ply:
+        ok = PlyWriter::writeFile(filename, pc, reportProgress, stats, &error);
+        break;
+    case ExportFormat::Las:
+        ok = LasWriter::writeFile(filename, pc, reportProgress, stats, &error);
+        break;
+    }
 
-        pc.sourceFormat = "PTS";
-        pc.isVisible = true; // Default to visible
-
-        QColor colors[] = {
-            QColor(255, 255, 255),
-            QColor(230, 230, 255),
-            QColor(230, 255, 230),
-            QColor(255, 230, 230),
-            QColor(255, 255, 230),
-            QColor(230, 255, 255),
-            QColor(255, 230, 255)
-        };
-        pc.tintColor = colors[m_pointClouds.size() % 7];
-
-        QFileInfo fileInfo(filename);
-        QString name = fileInfo.fileName();
-        m_pointClouds[name] = pc;
-
-        QTreeWidgetItem *item = new QTreeWidgetItem();
-        item->setText(0, name);
-        item->setData(0, Qt::UserRole, name);
-        item->setToolTip(0, filename);
-        item->setText(1, QString::number(pc.points.size()));
-        item->setCheckState(0, Qt::Checked); // Default to checked
-        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
-        item->setIcon(0, QIcon(":/icons/text-x-generic.png"));
-        m_treeWidget->addTopLevelItem(item);
-        m_treeWidget->expandAll();
-
-        m_treeWidget->setCurrentItem(item);
-        statusBar()->showMessage(tr("Loaded %1 with %2 points").arg(name).arg(pc.points.size()));
-        displayPointCloudInfo(name, pc);
-
-        // Focus on the newly loaded point cloud
-        focusCameraOnPointCloud(name);
-
-        return true;
-    }
-    catch (const std::exception &e)
+    if (!ok)
     {
-        QMessageBox::critical(this, tr("Error"), tr("Error loading file: %1").arg(e.what()));
+        qDebug() << "Export to" << filename << "failed:" << error;
         return false;
     }
-}
-
-void MainWindow::updateAllVisiblePointClouds()
-{
-    m_glWidget->setPointClouds(m_pointClouds);
+    return true;
 }
 
 void MainWindow::onItemChanged(QTreeWidgetItem *item, int column)
 {
     if (column == 0)
     {
-        QString name = item->data(0, Qt::UserRole).toString();
-        if (m_pointClouds.contains(name))
+        EntityId id = entityForItem(item);
+        if (id)
         {
             bool isVisible = (item->checkState(0) == Qt::Checked);
-            m_pointClouds[name].isVisible = isVisible;
-            m_glWidget->updatePointCloudVisibility(name, isVisible);
-            updateAllVisiblePointClouds();
+            m_scene->setVisible(id, isVisible);
         }
     }
 }
 
-void MainWindow::displayPointCloudInfo(const QString &name, const PointCloud &pc)
+void MainWindow::displayPointCloudInfo(EntityId id)
 {
+    const QSharedPointer<const PointCloud> cloud = m_scene->cloud(id);
+    if (!cloud)
+        return;
+
+    const PointCloud &pc = *cloud;
     m_textEdit->clear();
-    m_textEdit->appendPlainText(tr("File: %1").arg(name));
+    m_textEdit->appendPlainText(tr("File: %1").arg(m_scene->name(id)));
+
+    if (const QSharedPointer<OutOfCoreCloud> outOfCore = m_scene->outOfCore(id)) {
+        m_textEdit->appendPlainText(tr("Number of points: %1 (out-of-core, %2 chunks)").arg(outOfCore->pointCount()).arg(outOfCore->chunks().size()));
+        m_textEdit->appendPlainText(tr("Format: %1").arg(pc.sourceFormat));
+        m_textEdit->appendPlainText(tr("Visible: %1").arg(pc.isVisible ? tr("Yes") : tr("No")));
+        m_textEdit->appendPlainText(tr("Resident memory: %1 MB").arg(outOfCore->hostMemoryUsage() / (1024.0 * 1024.0), 0, 'f', 1));
+        m_textEdit->appendPlainText(QString());
+        m_textEdit->appendPlainText(tr("Bounding Box:"));
+        m_textEdit->appendPlainText(tr("X: %1 to %2").arg(pc.boundingBoxMin.x()).arg(pc.boundingBoxMax.x()));
+        m_textEdit->appendPlainText(tr("Y: %1 to %2").arg(pc.boundingBoxMin.y()).arg(pc.boundingBoxMax.y()));
+        m_textEdit->appendPlainText(tr("Z: %1 to %2").arg(pc.boundingBoxMin.z()).arg(pc.boundingBoxMax.z()));
+        return;
+    }
+
     m_textEdit->appendPlainText(tr("Number of points: %1").arg(pc.points.size()));
     m_textEdit->appendPlainText(tr("Format: %1").arg(pc.sourceFormat));
     m_textEdit->appendPlainText(tr("Visible: %1").arg(pc.isVisible ? tr("Yes") : tr("No")));
+    m_textEdit->appendPlainText(tr("Attributes: position, RGBA%1").arg(pc.hasIntensities() ? tr(", intensity") : QString()));
+    m_textEdit->appendPlainText(tr("Point memory: %1 MB (%2 bytes/point)")
+                                    .arg(pc.pointMemoryUsage() / (1024.0 * 1024.0), 0, 'f', 1)
+                                    .arg(pc.bytesPerPoint(), 0, 'f', 1));
+    const PointSelection selection = m_scene->selection(id);
+    if (const qsizetype selected = selection.count())
+        m_textEdit->appendPlainText(tr("Selected points: %1 (%2 KB)")
+                                        .arg(selected)
+                                        .arg(selection.memoryUsage() / 1024.0, 0, 'f', 1));
+    if (const QSharedPointer<const PointKdTree> index = m_scene->builtSpatialIndex(id))
+        m_textEdit->appendPlainText(tr("Spatial index: %1 MB, built in %2 ms")
+                                        .arg(index->memoryUsage() / (1024.0 * 1024.0), 0, 'f', 1)
+                                        .arg(index->buildTimeMs()));
+    if (!pc.meshes.isEmpty()) {
+        m_textEdit->appendPlainText(tr("Meshes: %1, %2 triangles").arg(pc.meshes.size()).arg(pc.triangleCount()));
+        for (const MeshPart &mesh : pc.meshes) {
+            if (!mesh.materialName.isEmpty())
+                m_textEdit->appendPlainText(tr("  %1: %2 triangles").arg(mesh.materialName).arg(mesh.triangleCount()));
+        }
+    }
 
     if (!pc.points.isEmpty())
     {
@@ -1006,17 +2921,23 @@ void MainWindow::displayPointCloudInfo(const QString &name, const PointCloud &pc
         m_textEdit->appendPlainText(tr("Y: %1 to %2").arg(pc.boundingBoxMin.y()).arg(pc.boundingBoxMax.y()));
         m_textEdit->appendPlainText(tr("Z: %1 to %2").arg(pc.boundingBoxMin.z()).arg(pc.boundingBoxMax.z()));
 
-        QVector3D sum(0.0f, 0.0f, 0.0f);
-        for (const auto& point : pc.points)
-            sum += point;
-
-        QVector3D centroid = sum / pc.points.size();
+        // Computed once per change to the points, then read from the store
+        const PointStatistics statistics = m_scene->statistics(id);
+        const QVector3D &centroid = statistics.centroid;
+        const QVector3D deviation = statistics.standardDeviation();
 
         m_textEdit->appendPlainText(QString());
         m_textEdit->appendPlainText(tr("Centroid:"));
         m_textEdit->appendPlainText(tr("X: %1").arg(centroid.x()));
         m_textEdit->appendPlainText(tr("Y: %1").arg(centroid.y()));
         m_textEdit->appendPlainText(tr("Z: %1").arg(centroid.z()));
+
+        m_textEdit->appendPlainText(QString());
+        m_textEdit->appendPlainText(tr("Standard deviation:"));
+        m_textEdit->appendPlainText(tr("X: %1").arg(deviation.x()));
+        m_textEdit->appendPlainText(tr("Y: %1").arg(deviation.y()));
+        m_textEdit->appendPlainText(tr("Z: %1").arg(deviation.z()));
+        m_textEdit->appendPlainText(tr("Statistics computed in %1 ms").arg(statistics.computeTimeMs));
     }
 }
 
@@ -1025,13 +2946,32 @@ void MainWindow::onItemClicked(QTreeWidgetItem *item, int column)
     if (!item)
         return;
 
-    QString name = item->data(0, Qt::UserRole).toString();
-    if (m_pointClouds.contains(name))
+    EntityId id = entityForItem(item);
+    if (id)
     {
-        const PointCloud &pc = m_pointClouds[name];
-        displayPointCloudInfo(name, pc);
-        focusCameraOnPointCloud(name);
+        displayPointCloudInfo(id);
+        focusCameraOnPointCloud(id);
+    }
+}
+
+void MainWindow::onTreeSelectionChanged()
+{
+    // The current item, when selected, is the primary selection and listed first
+    QVector<EntityId> ids;
+    QTreeWidgetItem *currentItem = m_treeWidget->currentItem();
+    const EntityId current = currentItem && currentItem->isSelected() ? entityForItem(currentItem) : 0;
+    if (current)
+        ids.append(current);
+
+    const QList<QTreeWidgetItem *> items = m_treeWidget->selectedItems();
+    ids.reserve(items.size());
+    for (QTreeWidgetItem *item : items) {
+        const EntityId id = entityForItem(item);
+        if (id && id != current)
+            ids.append(id);
     }
+
+    m_glWidget->setSelectedEntities(ids);
 }
 
 void MainWindow::onItemDoubleClicked(QTreeWidgetItem *item, int column)
@@ -1046,30 +2986,28 @@ void MainWindow::onItemDoubleClicked(QTreeWidgetItem *item, int column)
         statusBar()->showMessage(tr("Applied viewport: %1").arg(viewport->getName()));
     }
     else {
-        QString name = item->data(0, Qt::UserRole).toString();
-        if (m_pointClouds.contains(name))
+        EntityId id = entityForItem(item);
+        if (id)
         {
-            const PointCloud &pc = m_pointClouds[name];
-            displayPointCloudInfo(name, pc);
-            focusCameraOnPointCloud(name);
+            displayPointCloudInfo(id);
+            focusCameraOnPointCloud(id);
         }
     }
 }
 
-void MainWindow::focusCameraOnPointCloud(const QString &name)
+void MainWindow::focusCameraOnPointCloud(EntityId id)
 {
-    if (!m_pointClouds.contains(name))
+    const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+    if (!pc)
         return;
 
-    const PointCloud &pc = m_pointClouds[name];
-    m_glWidget->setFocusOnPointCloud(name, pc.boundingBoxMin, pc.boundingBoxMax);
-    statusBar()->showMessage(tr("Focused on %1").arg(name));
+    m_glWidget->setFocusOnPointCloud(id, pc->boundingBoxMin, pc->boundingBoxMax);
+    statusBar()->showMessage(tr("Focused on %1").arg(m_scene->name(id)));
 }
 
 void MainWindow::resetView()
 {
     m_glWidget->resetView();
-    updateAllVisiblePointClouds();
 }
 
 void MainWindow::showPointCloudProperties()
@@ -1078,17 +3016,20 @@ void MainWindow::showPointCloudProperties()
     if (!currentItem)
         return;
 
-    QString name = currentItem->data(0, Qt::UserRole).toString();
-    if (!m_pointClouds.contains(name))
+    EntityId id = entityForItem(currentItem);
+    if (!id)
         return;
 
+    const QSharedPointer<const PointCloud> pc = m_scene->cloud(id);
+    QColor tintColor = pc->tintColor;
+
     QDialog dialog(this);
     dialog.setWindowTitle(tr("Point Cloud Properties"));
 
     QVBoxLayout *layout = new QVBoxLayout(&dialog);
 
     QCheckBox *visibleCheckBox = new QCheckBox(tr("Visible"), &dialog);
-    visibleCheckBox->setChecked(m_pointClouds[name].isVisible);
+    visibleCheckBox->setChecked(pc->isVisible);
     layout->addWidget(visibleCheckBox);
 
     QLabel *pointSizeLabel = new QLabel(tr("Point Size:"), &dialog);
@@ -1096,12 +3037,15 @@ void MainWindow::showPointCloudProperties()
 
     QSlider *pointSizeSlider = new QSlider(Qt::Horizontal, &dialog);
     pointSizeSlider->setRange(1, 10);
-    pointSizeSlider->setValue(m_pointClouds[name].pointSize);
+    pointSizeSlider->setValue(pc->pointSize);
     layout->addWidget(pointSizeSlider);
 
     QPushButton *colorButton = new QPushButton(tr("Tint Color..."), &dialog);
     layout->addWidget(colorButton);
 
+    QLabel *memoryLabel = new QLabel(tr("Point memory: %1 bytes/point").arg(pc->bytesPerPoint(), 0, 'f', 1), &dialog);
+    layout->addWidget(memoryLabel);
+
     QDialogButtonBox *buttonBox = new QDialogButtonBox(
         QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
     layout->addWidget(buttonBox);
@@ -1110,17 +3054,17 @@ void MainWindow::showPointCloudProperties()
     connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
 
     connect(colorButton, &QPushButton::clicked, [&]() {
-        QColor color = QColorDialog::getColor(m_pointClouds[name].tintColor, this);
+        QColor color = QColorDialog::getColor(tintColor, this);
         if (color.isValid()) {
-            m_pointClouds[name].tintColor = color;
+            tintColor = color;
         }
     });
 
     if (dialog.exec() == QDialog::Accepted) {
-        m_pointClouds[name].isVisible = visibleCheckBox->isChecked();
-        m_pointClouds[name].pointSize = pointSizeSlider->value();
-        currentItem->setCheckState(0, m_pointClouds[name].isVisible ? Qt::Checked : Qt::Unchecked);
-        m_glWidget->updatePointCloudVisibility(name, m_pointClouds[name].isVisible);
+        m_scene->setTintColor(id, tintColor);
+        m_scene->setPointSize(id, pointSizeSlider->value());
+        m_scene->setVisible(id, visibleCheckBox->isChecked());
+        currentItem->setCheckState(0, visibleCheckBox->isChecked() ? Qt::Checked : Qt::Unchecked);
     }
 }
 
@@ -1129,20 +3073,22 @@ void MainWindow::showAbout()
     QMessageBox::about(this, tr("About Point Cloud Viewer"),
                        tr("Point Cloud Viewer\n\n"
                           "A simple application for viewing multiple point cloud and 3D model files simultaneously.\n"
-                          "Supports PTS point clouds and various 3D model formats via Assimp."));
+                          "Supports PTS, binary PLY and LAS point clouds, and various 3D model formats via Assimp."));
 }
 
 void MainWindow::saveViewportForSelectedEntity()
 {
-    QString name = getSelectedPointCloud();
-    if (name.isEmpty())
+    EntityId id = getSelectedPointCloud();
+    if (!id)
     {
         QMessageBox::warning(this, tr("Error"), tr("No point cloud selected!"));
         return;
     }
 
-    const PointCloud &pc = m_pointClouds[name];
-    if (pc.points.isEmpty())
+    const QSharedPointer<const PointCloud> cloud = m_scene->cloud(id);
+    const PointCloud &pc = *cloud;
+    QString name = m_scene->name(id);
+    if (pc.points.isEmpty() && !m_scene->outOfCore(id))
     {
         QMessageBox::warning(this, tr("Error"), tr("Selected point cloud has no valid points."));
         return;
@@ -1204,170 +3150,81 @@ void MainWindow::saveViewportForSelectedEntity()
     viewportObject->setParameters(params);
 
     m_viewportList.append(viewportObject);
-    addViewportToDB(viewportObject, name);
+    addViewportToDB(viewportObject, id);
 
     statusBar()->showMessage(tr("Viewport saved for %1").arg(name));
 }
 
-void MainWindow::addViewportToDB(ViewportObject* viewport, const QString& entityName)
+bool MainWindow::saveCameraPath(const CameraPath &path)
 {
-    updateTreeWidget(viewport, entityName);
-}
+    const QString filename = QFileDialog::getSaveFileName(this, tr("Save Camera Path"), QString(),
+                                                          tr("Camera Paths (*.json)"));
+    if (filename.isEmpty())
+        return false;
 
-void MainWindow::updateTreeWidget(ViewportObject* viewport, const QString& entityName)
-{
-    QTreeWidgetItem* parentItem = nullptr;
-    for (int i = 0; i < m_treeWidget->topLevelItemCount(); ++i) {
-        QTreeWidgetItem* item = m_treeWidget->topLevelItem(i);
-        if (item->data(0, Qt::UserRole).toString() == entityName) {
-            parentItem = item;
-            break;
-        }
+    QString errorMessage;
+    if (!path.save(filename, &errorMessage))
+    {
+        QMessageBox::warning(this, tr("Error"), tr("Failed to save camera path to %1\n%2").arg(filename, errorMessage));
+        return false;
     }
 
-    if (!parentItem)
-        return;
-
-    QTreeWidgetItem* item = new QTreeWidgetItem(parentItem);
-    item->setText(0, viewport->getName());
-    item->setData(0, Qt::UserRole, QVariant::fromValue(viewport));
-    item->setIcon(0, QIcon(":/icons/viewport.png"));
-    m_treeWidget->expandAll();
+    statusBar()->showMessage(tr("Saved a camera path of %1 frames to %2").arg(path.frameCount()).arg(filename));
+    return true;
 }
 
-#ifdef USE_ASSIMP
-bool MainWindow::loadModelWithAssimp(const QString &filename)
+void MainWindow::saveViewportsAsCameraPath()
 {
-    try
+    if (m_viewportList.isEmpty())
     {
-        Assimp::Importer importer;
-        unsigned int flags = aiProcess_Triangulate |
-                             aiProcess_JoinIdenticalVertices |
-                             aiProcess_SortByPType |
-                             aiProcess_GenNormals;
-
-        QProgressDialog progress(tr("Loading 3D model..."), tr("Cancel"), 0, 100, this);
-        progress.setWindowModality(Qt::WindowModal);
-        progress.setValue(10);
-
-        const aiScene* scene = importer.ReadFile(filename.toStdString(), flags);
-        progress.setValue(50);
-
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
-        {
-            QMessageBox::warning(this, tr("Assimp Error"),
-                                 tr("Error loading model: %1").arg(importer.GetErrorString()));
-            return false;
-        }
-
-        PointCloud pc;
-        unsigned int totalVertices = 0;
-        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-            totalVertices += scene->mMeshes[i]->mNumVertices;
-        }
-
-        progress.setMaximum(totalVertices > 0 ? totalVertices : 100);
-        progress.setValue(0);
-        progress.setLabelText(tr("Converting model to point cloud..."));
-
-        unsigned int processedVertices = 0;
-        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
-        {
-            const aiMesh* mesh = scene->mMeshes[i];
-            aiColor4D diffuse(0.8f, 0.8f, 0.8f, 1.0f);
-            if (mesh->mMaterialIndex < scene->mNumMaterials) {
-                const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-                material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
-            }
-
-            for (unsigned int j = 0; j < mesh->mNumVertices; j++)
-            {
-                if (j % 1000 == 0) {
-                    progress.setValue(processedVertices + j);
-                    if (progress.wasCanceled()) {
-                        return false;
-                    }
-                }
+        QMessageBox::warning(this, tr("Error"), tr("No viewports have been saved."));
+        return;
+    }
 
-                const aiVector3D& pos = mesh->mVertices[j];
-                pc.points.append(QVector3D(pos.x, pos.y, pos.z));
+    // Each viewport is held for a second at 60 frames per second when replayed
+    CameraPath path;
+    for (const ViewportObject *viewport : m_viewportList)
+        path.addViewport(viewport->getName(), viewport->parameters(), 60);
+    saveCameraPath(path);
+}
 
-                if (mesh->HasVertexColors(0))
-                {
-                    const aiColor4D& color = mesh->mColors[0][j];
-                    pc.colors.append(QVector3D(color.r * 255, color.g * 255, color.b * 255));
-                }
-                else
-                {
-                    pc.colors.append(QVector3D(diffuse.r * 255, diffuse.g * 255, diffuse.b * 255));
-                }
-            }
+void MainWindow::recordCameraPath(bool recording)
+{
+    m_recordingCameraPath = recording;
+    if (recording)
+    {
+        // The recording starts from wherever the camera is now
+        m_recordedCameraPath = CameraPath();
+        m_recordedCameraPath.addViewport(tr("Start"), ViewportObject::capture(m_glWidget));
+        statusBar()->showMessage(tr("Recording camera path; drag to move the camera"));
+        return;
+    }
 
-            processedVertices += mesh->mNumVertices;
-        }
+    if (m_recordedCameraPath.frameCount() > 1)
+        saveCameraPath(m_recordedCameraPath);
+    m_recordedCameraPath = CameraPath();
+}
 
-        progress.setValue(totalVertices);
+void MainWindow::onCameraDragged(const QPoint &delta, Qt::MouseButtons buttons)
+{
+    if (m_recordingCameraPath)
+        m_recordedCameraPath.addMove(delta, buttons);
+}
 
-        if (pc.points.isEmpty())
-        {
-            QMessageBox::warning(this, tr("Error"),
-                                 tr("No vertices found in model: %1").arg(filename));
-            return false;
-        }
+void MainWindow::addViewportToDB(ViewportObject* viewport, EntityId entity)
+{
+    updateTreeWidget(viewport, entity);
+}
 
-        pc.boundingBoxMin = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
-        pc.boundingBoxMax = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
-        for (const auto& point : pc.points) {
-            pc.boundingBoxMin.setX(qMin(pc.boundingBoxMin.x(), point.x()));
-            pc.boundingBoxMin.setY(qMin(pc.boundingBoxMin.y(), point.y()));
-            pc.boundingBoxMin.setZ(qMin(pc.boundingBoxMin.z(), point.z()));
-            pc.boundingBoxMax.setX(qMax(pc.boundingBoxMax.x(), point.x()));
-            pc.boundingBoxMax.setY(qMax(pc.boundingBoxMax.y(), point.y()));
-            pc.boundingBoxMax.setZ(qMax(pc.boundingBoxMax.z(), point.z()));
-        }
+void MainWindow::updateTreeWidget(ViewportObject* viewport, EntityId entity)
+{
+    QTreeWidgetItem* parentItem = itemForEntity(entity);
+    if (!parentItem)
+        return;
 
-        QFileInfo fileInfo(filename);
-        pc.sourceFormat = fileInfo.suffix().toUpper();
-        pc.isVisible = true; // Default to visible
-
-        QColor colors[] = {
-            QColor(255, 255, 255),
-            QColor(230, 230, 255),
-            QColor(230, 255, 230),
-            QColor(255, 230, 230),
-            QColor(255, 255, 230),
-            QColor(230, 255, 255),
-            QColor(255, 230, 255)
-        };
-        pc.tintColor = colors[m_pointClouds.size() % 7];
-
-        QString name = fileInfo.fileName();
-        m_pointClouds[name] = pc;
-
-        QTreeWidgetItem *item = new QTreeWidgetItem();
-        item->setText(0, name);
-        item->setData(0, Qt::UserRole, name);
-        item->setToolTip(0, filename);
-        item->setText(1, QString::number(pc.points.size()));
-        item->setCheckState(0, Qt::Checked); // Default to checked
-        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
-        item->setIcon(0, QIcon(":/icons/model.png"));
-        m_treeWidget->addTopLevelItem(item);
-        m_treeWidget->expandAll();
-
-        m_treeWidget->setCurrentItem(item);
-        statusBar()->showMessage(tr("Loaded %1 with %2 points").arg(name).arg(pc.points.size()));
-        displayPointCloudInfo(name, pc);
-
-        focusCameraOnPointCloud(name);
-
-        return true;
-    }
-    catch (const std::exception &e)
-    {
-        QMessageBox::critical(this, tr("Error"),
-                              tr("Error loading model: %1").arg(e.what()));
-        return false;
-    }
+    QTreeWidgetItem* item = new QTreeWidgetItem(parentItem);
+    item->setText(0, viewport->getName());
+    item->setData(0, Qt::UserRole, QVariant::fromValue(viewport));
+    item->setIcon(0, QIcon(":/icons/viewport.png"));
+    m_treeWidget->expandAll();
 }
-#endif
@@ -3,7 +3,7 @@
 
 #include <QMainWindow>
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QtOpenGL/QOpenGLBuffer>
 #include <QtOpenGL/QOpenGLVertexArrayObject>
 #include <QtOpenGL/QOpenGLShaderProgram>
@@ -16,41 +16,29 @@
 #include <QVector>
 #include <QPair>
 #include <QMap>
+#include <QHash>
 #include <QRegularExpression>
 #include <QCheckBox>
+#include <QElapsedTimer>
+#include <QPolygon>
+#include <QFutureWatcher>
 #include "viewportobject.h"
-
-#ifdef USE_ASSIMP
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#endif
+#include "pointcloud.h"
+#include "pointcloudloader.h"
+#include "ptswriter.h"
+#include "camerapath.h"
+#include "scenestore.h"
+#include "overlayrenderer.h"
+#include "outlierfilter.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
+class QTimer;
+class QLabel;
 QT_END_NAMESPACE
 
-// Structure to hold point cloud data with rendering properties
-struct PointCloud {
-    QVector<QVector3D> points;
-    QVector<QVector3D> colors;
-    QString sourceFormat;
-    bool isVisible = true;
-    float pointSize = 3.0f;
-    QColor tintColor = QColor(255, 255, 255);
-
-    QVector<QVector3D> vertices;
-    QVector<int> indices;
-    QVector<QVector<QVector3D>> polygons;
-    QVector<QVector<QVector3D>> polygonColors;
-    QVector<QPair<QVector3D, QVector3D>> lines;
-
-    QVector3D boundingBoxMin;
-    QVector3D boundingBoxMax;
-};
-
 // Custom OpenGL Widget for rendering point clouds
-class PointCloudGLWidget : public QOpenGLWidget, protected QOpenGLFunctions
+class PointCloudGLWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
     Q_OBJECT
 
@@ -58,26 +46,60 @@ public:
     explicit PointCloudGLWidget(QWidget *parent = nullptr);
     ~PointCloudGLWidget();
 
-    void setPointClouds(const QMap<QString, PointCloud>& pointClouds);
-    void updatePointCloudVisibility(const QString& name, bool visible);
+    // Renders the entities of a store owned elsewhere; the widget never copies point data
+    void setScene(SceneStore *scene);
+    SceneStore *scene() const { return m_scene; }
+
     void resetView();
     void setPointSize(float size);
 
+    // Upper bound on the points drawn per frame across all clouds; 0 draws everything
+    void setPointBudget(qint64 points);
+    qint64 pointBudget() const { return m_pointBudget; }
+
+    // Memory that out-of-core clouds may keep resident in host memory and on the GPU
+    void setMemoryBudgets(qint64 hostBytes, qint64 gpuBytes);
+    qint64 hostMemoryBudget() const { return m_hostMemoryBudget; }
+    qint64 gpuMemoryBudget() const { return m_gpuMemoryBudget; }
+
+    // Frame time aimed for while the camera moves, by drawing fewer points; 0 disables it
+    void setTargetFrameTime(double milliseconds);
+    double targetFrameTime() const { return m_targetFrameTime; }
+
     enum RenderMode {
         POINTS,
         POINTS_SMOOTH
     };
 
     void setRenderMode(RenderMode mode);
-    void loadMesh(const QVector<QVector3D>& vertices, const QVector<unsigned int>& indices);
 
-    void renderPointCloud(const PointCloud& pc);
+    // A run of consecutive points in an entity's vertex buffer
+    struct DrawRange {
+        int first;
+        int count;
+    };
+
+    // What the last frame drew; chunks are octree nodes, or whole clouds without one
+    struct RenderStats {
+        int chunksDrawn = 0;
+        int chunksCulled = 0;
+        int drawCalls = 0;
+        qint64 pointsDrawn = 0;
+        qint64 trianglesDrawn = 0;
+        double frameTimeMs = 0.0;   // From the start of painting until the frame was swapped
+        double cpuTimeMs = 0.0;     // Spent in paintGL() issuing the frame
+        double gpuTimeMs = -1.0;    // GPU time of the oldest unreported earlier frame, or -1 when none finished since
+        bool interactive = false;   // Drawn at reduced detail while the camera moved
+    };
 
-    QString m_selectedEntityForBoundingBox;
+    const RenderStats& renderStats() const { return m_renderStats; }
 
+    // Draws the given ranges of the cloud, or all of it when ranges is null
+    void renderPointCloud(EntityId id, const PointCloud& pc, const QVector<DrawRange>* ranges = nullptr);
+
+    // An extra box outlined in model space, besides those of the selected entities
     void showBoundingBox(const QVector3D& minCorner, const QVector3D& maxCorner);
     void hideBoundingBox();
-    bool m_showBoundingBox = false;
 
     // Getters and setters for viewport parameters
     QMatrix4x4 getModelMatrix() const { return m_model; }
@@ -102,9 +124,49 @@ public:
     float getFOV() const { return m_fov; }
     void setFOV(float fov) { m_fov = fov; update(); }
 
-    QMap<QString, PointCloud> getPointClouds() const { return m_pointClouds; }
+    void setFocusOnPointCloud(EntityId id, const QVector3D& min, const QVector3D& max);
+
+    // Outlines an entity without moving the camera; 0 clears the outline
+    void setSelectedEntity(EntityId id);
+
+    // Outlines the bounding boxes of any number of entities; the first is the
+    // primary selection, drawn in its own colour with an axes gizmo
+    void setSelectedEntities(const QVector<EntityId>& ids);
+    const QVector<EntityId>& selectedEntities() const { return m_selectedEntities; }
 
-    void setFocusOnPointCloud(const QString& name, const QVector3D& min, const QVector3D& max);
+    // Finds what is drawn under a widget position. The answer arrives through
+    // pointPicked() a frame or two later; a newer request supersedes an older one.
+    void pickAt(const QPoint& pos, Qt::KeyboardModifiers modifiers = Qt::NoModifier);
+
+    // Pixels around the cursor searched for the nearest drawn point
+    static constexpr int PickRadius = 4;
+
+    // What a left drag does: orbit the camera, or select the points inside a shape
+    enum class SelectionTool {
+        Navigate,
+        Rectangle,
+        Lasso
+    };
+    void setSelectionTool(SelectionTool tool);
+    SelectionTool selectionTool() const { return m_selectionTool; }
+
+    QMatrix4x4 modelViewProjection() const { return m_projection * m_view * m_model; }
+
+    // Turns the camera for a left drag by delta pixels, or dollies it for a right drag
+    void dragCamera(const QPoint& delta, Qt::MouseButtons buttons);
+
+signals:
+    void frameRendered(const PointCloudGLWidget::RenderStats& stats);
+
+    // id is 0 when nothing was under the cursor; pointIndex is -1 when the
+    // point has no index in the entity's arrays, as for out-of-core chunks
+    void pointPicked(EntityId id, qint64 pointIndex, Qt::KeyboardModifiers modifiers);
+
+    // A rectangle or lasso finished dragging out, in widget coordinates
+    void regionSelected(const QPolygon& region, Qt::KeyboardModifiers modifiers);
+
+    // The user moved the camera with the mouse, so the drag can be recorded and replayed
+    void cameraDragged(const QPoint& delta, Qt::MouseButtons buttons);
 
 protected:
     void initializeGL() override;
@@ -113,20 +175,175 @@ protected:
 
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
     void wheelEvent(QWheelEvent *event) override;
 
+private slots:
+    // Marks the resident GPU buffers of an entity stale; the next paint re-uploads them once
+    void onEntityDataChanged(EntityId id);
+
+    // Uploads only the points appended since the last paint, growing the buffer when needed
+    void onEntityPointsAppended(EntityId id);
+
+    void onEntityRemoved(EntityId id);
+
+    // Imported meshes are uploaded on the next paint, once, in the order they arrive
+    void onEntityMeshAppended(EntityId id);
+
+    // Queues the changed range of an entity's selection flags for upload
+    void onEntitySelectionChanged(EntityId id, qsizetype firstPoint, qsizetype pointCount);
+
+    void onFrameSwapped();
+
 private:
-    void initShaders();
+    // Vertex data of one entity kept resident on the GPU between frames
+    struct GpuPointBuffer {
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer vbo;
+        int vertexCount = 0;
+        int capacity = 0;
+        bool dirty = true;
+        bool appendPending = false;
+        quint64 lastUsedFrame = 0;
+
+        // One byte per point, created with the entity's first selection; only
+        // [selectionDirtyFirst, selectionDirtyEnd) is rewritten on the next paint
+        QOpenGLBuffer selectionVbo;
+        int selectionCapacity = 0;
+        qsizetype selectionDirtyFirst = 0;
+        qsizetype selectionDirtyEnd = 0;
+    };
+
+    // Vertex and index buffers of one imported mesh, kept until its entity is removed
+    struct GpuMesh {
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer vbo;                                  // Positions, then normals when the mesh has them
+        QOpenGLBuffer ebo { QOpenGLBuffer::IndexBuffer };
+        int indexCount = 0;
+        bool hasNormals = false;
+        QVector3D diffuse;
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+    };
 
-    QOpenGLBuffer m_vbo;
-    QOpenGLVertexArrayObject m_vao;
+    // Polygons and lines of one entity in a single vertex and element buffer,
+    // re-uploaded only after the entity's data has changed
+    struct GpuPrimitiveBuffer {
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer vbo;                                  // Positions, then colours
+        QOpenGLBuffer ebo { QOpenGLBuffer::IndexBuffer };   // Triangle indices, then line segment indices
+        int triangleIndexCount = 0;
+        int lineIndexCount = 0;
+        bool dirty = true;
+    };
+
+    void initShaders();
+    GpuPointBuffer* gpuBufferFor(EntityId id, const PointCloud& pc);
+    void uploadPointCloud(GpuPointBuffer* buffer, const PointAttributes& pc, int firstPoint);
+    void uploadSelection(GpuPointBuffer* buffer, const PointSelection& selection);
+    static void markSelectionDirty(GpuPointBuffer* buffer, qsizetype first, qsizetype end);
+    void releaseGpuBuffer(EntityId id);
+
+    // Draws the meshes of every visible entity with one glDrawElements call per mesh in view
+    void renderMeshes(RenderStats& stats);
+    GpuMesh* uploadMesh(const MeshPart& mesh);
+    void releaseGpuMeshes(EntityId id);
+    QHash<EntityId, QVector<GpuMesh*>> m_gpuMeshes;
+
+    // Draws all polygons of an entity with one call and all its lines with another
+    void renderPrimitives(RenderStats& stats);
+    void uploadPrimitives(GpuPrimitiveBuffer* buffer, const PointCloud& pc);
+    void releaseGpuPrimitives(EntityId id);
+    QHash<EntityId, GpuPrimitiveBuffer*> m_gpuPrimitives;
+    QOpenGLShaderProgram *m_meshProgram = nullptr;
+    void releaseAllGpuBuffers();
+
+    // Picks the octree nodes to draw this frame, largest on screen first, until the
+    // budget is spent; nodes outside the view frustum are skipped with their subtrees
+    QHash<EntityId, QVector<DrawRange>> selectDrawRanges(qint64 budget, RenderStats& stats) const;
+    static int countSubtreeNodes(const PointOctree& lod, int node);
+    float projectedBoxSize(const QVector3D& boxMin, const QVector3D& boxMax, const QMatrix4x4& modelView, float pixelsPerUnit) const;
+
+    // Out-of-core clouds draw per chunk from buffers kept under the GPU budget, least recently used evicted first
+    using ChunkKey = QPair<EntityId, int>;
+    void renderOutOfCoreClouds(qint64 budget, RenderStats& stats);
+    GpuPointBuffer* chunkBufferFor(const ChunkKey& key, const PointAttributes& resident);
+    void releaseChunkBuffer(const ChunkKey& key);
+    void trimChunkBuffers();
+
+    SceneStore *m_scene = nullptr;
+    QHash<EntityId, GpuPointBuffer*> m_gpuBuffers;
+    QByteArray m_selectionScratch;     // Expanded selection flags staged for uploadSelection
+    qint64 m_pointBudget = 5000000;
+    RenderStats m_renderStats;
+
+    QHash<ChunkKey, GpuPointBuffer*> m_chunkBuffers;
+    qint64 m_chunkGpuMemory = 0;
+    qint64 m_hostMemoryBudget = qint64(2) << 30;
+    qint64 m_gpuMemoryBudget = qint64(1) << 30;
+    quint64 m_frameIndex = 0;
+
+    // Interaction mode: m_interactionBudget adapts to the measured frame time
+    static constexpr qint64 MinInteractionBudget = 100000;
+    void beginInteraction();
+    bool m_interacting = false;
+    double m_targetFrameTime = 1000.0 / 30.0;
+    qint64 m_interactionBudget = 1000000;
+    QTimer *m_refineTimer;
+    QElapsedTimer m_frameTimer;
+
+    // Everything paintGL() draws; the caller wraps it in the frame timers
+    void renderScene();
+
+    // GL_TIME_ELAPSED queries in a ring, read a frame or more later so timing
+    // never waits on the GPU; unavailable before desktop OpenGL 3.3
+    static constexpr int GpuTimerQueries = 4;
+    void beginGpuTimer(RenderStats& stats);
+    void endGpuTimer();
+    GLuint m_gpuTimerQueries[GpuTimerQueries] = {};
+    quint64 m_gpuTimersIssued = 0;
+    quint64 m_gpuTimersRead = 0;
+    bool m_gpuTiming = false;
+    using GetQueryObjectui64v = void (QOPENGLF_APIENTRYP)(GLuint id, GLenum pname, GLuint64 *params);
+    GetQueryObjectui64v m_getQueryObjectui64v = nullptr;
     QOpenGLShaderProgram *m_program;
 
+    // Picking renders entity ids and point indices around the cursor into an
+    // integer framebuffer, copied into a pixel buffer that is read once its fence has passed
+    enum class PickState {
+        Idle,
+        Requested,
+        Reading
+    };
+    void renderPickPass(const QHash<EntityId, QVector<DrawRange>>& selection);
+    void resolvePick();
+    void deliverPick(EntityId id, qint64 pointIndex);
+    void ensurePickTargets();
+    void releasePickTargets();
+    QOpenGLShaderProgram *m_pickProgram = nullptr;
+    PickState m_pickState = PickState::Idle;
+    QPoint m_pickPos;               // In framebuffer pixels, origin at the bottom left
+    QRect m_pickRect;
+    Qt::KeyboardModifiers m_pickModifiers;
+    QSize m_pickTargetSize;
+    GLuint m_pickFramebuffer = 0;
+    GLuint m_pickColorBuffer = 0;
+    GLuint m_pickDepthBuffer = 0;
+    GLuint m_pickPixelBuffer = 0;
+    GLsync m_pickFence = nullptr;
+    QVector<QPair<ChunkKey, int>> m_outOfCoreDraws;   // Chunks and point counts drawn this frame, for the pick pass
+
     QMatrix4x4 m_projection;
     QMatrix4x4 m_view;
     QMatrix4x4 m_model;
 
     QPoint m_lastPos;
+    QPoint m_pressPos;
+
+    SelectionTool m_selectionTool = SelectionTool::Navigate;
+    bool m_selecting = false;
+    QPolygon m_selectionOutline;    // Corners of the rectangle, or the lasso path so far
+    void drawSelectionOutline();
     float m_distance;
     float m_xRot, m_yRot;
     float m_focalDistance = 0.75f; // Default focal distance
@@ -137,11 +354,14 @@ private:
     float m_pointSize;
     RenderMode m_renderMode;
 
-    QMap<QString, PointCloud> m_pointClouds;
-
-    QVector<QVector3D> m_meshVertices;
-    QVector<unsigned int> m_meshIndices;
-    bool m_hasMesh = false;
+    // Boxes and gizmos of the selected entities, rebuilt only when the selection or their bounds change
+    void rebuildOverlays();
+    OverlayRenderer m_overlay;
+    QVector<EntityId> m_selectedEntities;
+    bool m_overlayDirty = true;
+    bool m_showExtraBox = false;
+    QVector3D m_extraBoxMin;
+    QVector3D m_extraBoxMax;
 
     void calculateSceneExtents(QVector3D& min, QVector3D& max);
 };
@@ -154,48 +374,129 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
-    // Get the currently selected point cloud
-    QString getSelectedPointCloud() const;
+    // Get the currently selected point cloud, or 0 when none is selected
+    EntityId getSelectedPointCloud() const;
 
 private slots:
     void openFile();
+    void openOutOfCore();
     void resetView();
     void onItemChanged(QTreeWidgetItem *item, int column);
     void onItemClicked(QTreeWidgetItem *item, int column);
     void onItemDoubleClicked(QTreeWidgetItem *item, int column);
+    void onTreeSelectionChanged();
     void showAbout();
     void exportPointCloud();
     void showPointCloudProperties();
     void setAllVisible(bool visible);
     void saveViewportForSelectedEntity();
+    void saveViewportsAsCameraPath();
+    void recordCameraPath(bool recording);
+    void onCameraDragged(const QPoint &delta, Qt::MouseButtons buttons);
+    void cancelLoading();
+
+    void onLoadProgress(int jobId, int percent);
+    void onBatchReady(int jobId, const PointBatch &batch);
+    void onMeshReady(int jobId, const MeshPart &mesh);
+    void onLoadFinished(int jobId, const LoadSummary &summary);
+    void onLoadFailed(int jobId, const QString &errorMessage);
+    void onLoadCancelled(int jobId);
+    void flushLoadedBatches();
+    void onFrameRendered(const PointCloudGLWidget::RenderStats &stats);
+    void onPointPicked(EntityId id, qint64 pointIndex, Qt::KeyboardModifiers modifiers);
+    void onRegionSelected(const QPolygon &region, Qt::KeyboardModifiers modifiers);
+    void clearPointSelection();
+    void invertPointSelection();
+    void extractSelectedPoints();
+    void configureLoadDownsampling();
+    void downsampleSelectedEntity();
+    void onDownsamplingFinished();
+    void removeStatisticalOutliers();
+    void onOutlierFilterFinished();
 
 private:
+    // A file whose points are still streaming in from the loader
+    struct PendingLoad {
+        EntityId entity = 0;
+        QString filename;
+        QTreeWidgetItem *item = nullptr;
+        QVector<PointBatch> queuedBatches;
+        bool focused = false;
+    };
+
     Ui::MainWindow *ui;
     PointCloudGLWidget *m_glWidget;
     QTreeWidget *m_treeWidget;
     QPlainTextEdit *m_textEdit;
 
-    QMap<QString, PointCloud> m_pointClouds;
+    SceneStore *m_scene;
     QList<ViewportObject*> m_viewportList;
+
+    // Asks for a file name and writes the path there; false when cancelled or failed
+    bool saveCameraPath(const CameraPath &path);
+    CameraPath m_recordedCameraPath;
+    bool m_recordingCameraPath = false;
     static unsigned s_viewportIndex;
 
-    bool loadPointCloud(const QString &filename);
-    void displayPointCloudInfo(const QString &name, const PointCloud &pc);
+    PointCloudLoader *m_loader;
+    QHash<int, PendingLoad> m_pendingLoads;
+    QTimer *m_batchFlushTimer;
+    QLabel *m_renderStatsLabel;
+
+    void startLoading(const QString &filename, bool outOfCore = false);
+    void finishOutOfCoreLoad(const PendingLoad &load, const LoadSummary &summary);
+    void removeEntity(EntityId id, QTreeWidgetItem *item);
+    QString uniqueEntityName(const QString &fileName) const;
+
+    // Adds an entity made from the points of another, with a tree item of its own
+    QTreeWidgetItem *addDerivedEntity(EntityId source, const QString &name, const PointAttributes &points);
+
+    // Asks for a voxel size and policy; enabled, when given, adds an on/off switch
+    bool askDownsamplingOptions(const QString &title, VoxelGrid::Options &options, bool *enabled = nullptr);
+    VoxelGrid::Options m_downsampleOptions;
+
+    // Downsampling an entity runs on the thread pool; the result becomes a new entity
+    struct DownsampleResult {
+        PointAttributes points;
+        VoxelGrid::Stats stats;
+    };
+    QFutureWatcher<DownsampleResult> m_downsampleWatcher;
+    EntityId m_downsampleEntity = 0;
+
+    OutlierFilter::Options m_outlierOptions;
+    bool m_outliersAsSelection = false;
+
+    // The filter runs on the thread pool over a shared copy of the positions,
+    // which also tells whether the entity changed before the result came back
+    struct OutlierResult {
+        PointSelection outliers;
+        OutlierFilter::Stats stats;
+    };
+    QFutureWatcher<OutlierResult> m_outlierWatcher;
+    EntityId m_outlierEntity = 0;
+    QVector<QVector3D> m_outlierSource;
+    QElapsedTimer m_outlierTimer;
+    EntityId entityForItem(const QTreeWidgetItem *item) const;
+    QTreeWidgetItem *itemForEntity(EntityId id) const;
+    void displayPointCloudInfo(EntityId id);
     void setupUI();
     void createMenus();
-    void updateAllVisiblePointClouds();
-    void addViewportToDB(ViewportObject* viewport, const QString& entityName);
-    void updateTreeWidget(ViewportObject* viewport, const QString& entityName);
+    void addViewportToDB(ViewportObject* viewport, EntityId entity);
+    void updateTreeWidget(ViewportObject* viewport, EntityId entity);
 
-    void focusCameraOnPointCloud(const QString &name);
+    void focusCameraOnPointCloud(EntityId id);
 
     QString getSupportedFormatsFilter() const;
 
-#ifdef USE_ASSIMP
-    bool loadModelWithAssimp(const QString &filename);
-#endif
+    enum class ExportFormat {
+        Pts,
+        PtsFixedPrecision,
+        Ply,
+        Las
+    };
 
-    bool saveAsPts(const QString &filename, const PointCloud &pc);
+    bool savePointCloud(const QString &filename, const PointAttributes &pc,
+                        ExportFormat format, PtsWriteStats *stats = nullptr);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,99 @@
+#include "outlierfilter.h"
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// A chunk's share of the sums; added up in chunk order so the result does not depend on scheduling
+struct ChunkSums {
+    double sum = 0.0;
+    double sumSquares = 0.0;
+};
+
+} // namespace
+
+PointSelection OutlierFilter::findOutliers(const QVector<QVector3D> &points, const PointKdTree &tree,
+                                           const Options &options, Stats *stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype pointCount = points.size();
+    if (stats) {
+        *stats = Stats();
+        stats->inputPoints = pointCount;
+    }
+
+    // With no neighbours to measure against nothing stands out
+    if (options.neighbours <= 0 || pointCount <= options.neighbours || tree.size() != pointCount)
+        return PointSelection(pointCount);
+
+    // The nearest point to each query is the point itself, so one more is asked for
+    const int k = options.neighbours + 1;
+    const qsizetype chunkCount = (pointCount + ChunkPoints - 1) / ChunkPoints;
+
+    QVector<float> meanDistances(pointCount);
+    QVector<ChunkSums> chunkSums(chunkCount);
+    QVector<qsizetype> chunks(chunkCount);
+    std::iota(chunks.begin(), chunks.end(), qsizetype(0));
+
+    // Pass 1: the mean neighbour distance of every point
+    const QVector3D *positions = points.constData();
+    float *distanceOut = meanDistances.data();
+    ChunkSums *sumsOut = chunkSums.data();
+    QtConcurrent::blockingMap(chunks, [&](qsizetype chunk) {
+        QVector<PointKdTree::Neighbour> neighbours;
+        neighbours.reserve(k);
+
+        ChunkSums sums;
+        const qsizetype end = qMin(pointCount, (chunk + 1) * ChunkPoints);
+        for (qsizetype i = chunk * ChunkPoints; i < end; ++i) {
+            tree.nearest(positions[i], k, neighbours);
+
+            // Closest first; the first is the point or a duplicate of it at distance 0
+            float total = 0.0f;
+            for (qsizetype n = 1; n < neighbours.size(); ++n)
+                total += std::sqrt(neighbours[n].distanceSquared);
+            const float mean = total / float(neighbours.size() - 1);
+
+            distanceOut[i] = mean;
+            sums.sum += mean;
+            sums.sumSquares += double(mean) * double(mean);
+        }
+        sumsOut[chunk] = sums;
+    });
+
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for (const ChunkSums &sums : chunkSums) {
+        sum += sums.sum;
+        sumSquares += sums.sumSquares;
+    }
+    const double mean = sum / double(pointCount);
+    const double variance = qMax(0.0, sumSquares / double(pointCount) - mean * mean);
+    const double deviation = std::sqrt(variance);
+    const double threshold = mean + double(options.standardDeviations) * deviation;
+
+    // Pass 2: flag the points past the threshold
+    QVector<char> flags(pointCount);
+    const float *distances = meanDistances.constData();
+    char *flagOut = flags.data();
+    QtConcurrent::blockingMap(chunks, [&](qsizetype chunk) {
+        const qsizetype end = qMin(pointCount, (chunk + 1) * ChunkPoints);
+        for (qsizetype i = chunk * ChunkPoints; i < end; ++i)
+            flagOut[i] = double(distances[i]) > threshold ? 1 : 0;
+    });
+
+    const PointSelection outliers = PointSelection::fromFlags(flags.constData(), pointCount);
+
+    if (stats) {
+        stats->outliers = outliers.count();
+        stats->meanDistance = mean;
+        stats->distanceDeviation = deviation;
+        stats->threshold = threshold;
+        stats->elapsedMs = timer.elapsed();
+    }
+    return outliers;
+}
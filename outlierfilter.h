@@ -0,0 +1,40 @@
+#ifndef OUTLIERFILTER_H
+#define OUTLIERFILTER_H
+
+#include <QVector>
+#include <QVector3D>
+#include "pointkdtree.h"
+#include "pointselection.h"
+
+// Statistical outlier removal: a point is an outlier when the mean distance to
+// its k nearest neighbours lies further above the mean of that distance over
+// the whole cloud than a multiple of its standard deviation. The queries run
+// chunk by chunk on the global thread pool against a shared, read-only k-d
+// tree, each worker reusing one neighbour array, so the work grows with the
+// point count and divides evenly over the cores.
+class OutlierFilter
+{
+public:
+    struct Options {
+        int neighbours = 8;                 // k, not counting the point itself
+        float standardDeviations = 1.0f;    // How far above the mean distance a point may lie
+    };
+
+    struct Stats {
+        qsizetype inputPoints = 0;
+        qsizetype outliers = 0;
+        double meanDistance = 0.0;          // Mean over the cloud of each point's mean neighbour distance
+        double distanceDeviation = 0.0;
+        double threshold = 0.0;             // Mean neighbour distances beyond this are outliers
+        qint64 elapsedMs = 0;
+    };
+
+    // Selects the outliers among points, which tree must have been built from
+    static PointSelection findOutliers(const QVector<QVector3D> &points, const PointKdTree &tree,
+                                       const Options &options, Stats *stats = nullptr);
+
+    // Points queried by one worker
+    static constexpr qsizetype ChunkPoints = 1 << 14;
+};
+
+#endif // OUTLIERFILTER_H
@@ -0,0 +1,434 @@
+#include "outofcorecloud.h"
+#include "pointcache.h"
+#include "pointstatistics.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+
+const char ChunkMagic[8] = { 'P', 'T', 'C', 'H', 'U', 'N', 'K', 'S' };
+constexpr quint32 ChunkFormatVersion = 1;
+
+// Grid cells are sized for about this many points each
+constexpr double TargetChunkPoints = 32768.0;
+constexpr qint64 MaxGridCells = qint64(1) << 24;
+
+// Points mapped at a time while passing over the spill file
+constexpr qint64 WindowPoints = 4 * 1024 * 1024;
+
+// Layout: header, chunk records, all positions in chunk order, all colours in chunk order
+struct ChunkFileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 chunkCount;
+    quint64 pointCount;
+    qint64 sourceSize;
+    qint64 sourceModified;      // Milliseconds since the epoch
+    float boundsMin[3];
+    float boundsMax[3];
+    char reserved[64];
+};
+static_assert(sizeof(ChunkFileHeader) == 128, "the chunk file header layout is part of the file format");
+
+struct ChunkRecord {
+    float boundsMin[3];
+    float boundsMax[3];
+    quint64 first;
+    quint32 count;
+    quint32 reserved;
+};
+static_assert(sizeof(ChunkRecord) == 40, "the chunk record layout is part of the file format");
+
+// Points in file order, written by the first pass and bucketed by the second
+struct SpillPoint {
+    QVector3D position;
+    PointColor color;
+};
+static_assert(sizeof(SpillPoint) == 16, "spill records are read back by mapping the file");
+
+void stampOf(const QString &sourceFile, qint64 &size, qint64 &modified)
+{
+    const QFileInfo info(sourceFile);
+    size = info.exists() ? info.size() : -1;
+    modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : 0;
+}
+
+// Calls visit(const SpillPoint &) for every record, mapping the file a window at a time
+template <typename Visitor>
+bool forEachSpillPoint(QFile &spill, qint64 pointCount, Visitor &&visit)
+{
+    for (qint64 first = 0; first < pointCount; first += WindowPoints) {
+        const qint64 count = qMin(WindowPoints, pointCount - first);
+        uchar *window = spill.map(first * qint64(sizeof(SpillPoint)), count * qint64(sizeof(SpillPoint)));
+        if (!window)
+            return false;
+
+        const SpillPoint *records = reinterpret_cast<const SpillPoint *>(window);
+        for (qint64 i = 0; i < count; ++i)
+            visit(records[i]);
+        spill.unmap(window);
+    }
+    return true;
+}
+
+bool fail(QString *errorMessage, const QString &message)
+{
+    if (errorMessage)
+        *errorMessage = message;
+    return false;
+}
+
+} // namespace
+
+OutOfCoreCloud::OutOfCoreCloud(QObject *parent)
+    : QObject(parent)
+{
+    // Reads are small and mostly wait on the disk
+    m_pool.setMaxThreadCount(2);
+}
+
+OutOfCoreCloud::~OutOfCoreCloud()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QString OutOfCoreCloud::chunkFilePath(const QString &sourceFile)
+{
+    return PointCache::cachePath(sourceFile, "ptchunks");
+}
+
+bool OutOfCoreCloud::isCurrent(const QString &sourceFile, const QString &chunkFile)
+{
+    QFile file(chunkFile);
+    ChunkFileHeader header;
+    if (!file.open(QIODevice::ReadOnly) || file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header))
+        return false;
+
+    qint64 size, modified;
+    stampOf(sourceFile, size, modified);
+    return std::memcmp(header.magic, ChunkMagic, sizeof(ChunkMagic)) == 0
+        && header.version == ChunkFormatVersion
+        && header.sourceSize == size
+        && header.sourceModified == modified;
+}
+
+bool OutOfCoreCloud::build(const QString &sourceFile, const QString &chunkFile,
+                           const PtsParser::ProgressCallback &progress, QString *errorMessage)
+{
+    auto report = [&progress](int percent) { return !progress || progress(percent); };
+
+    // Pass 1: parse the text once, appending compact binary records to a spill file
+    QFile spill(chunkFile + ".spill");
+    if (!spill.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        return fail(errorMessage, spill.errorString());
+
+    qint64 pointCount = 0;
+    bool spillOk = true;
+    QVector3D boundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    QVector3D boundsMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+
+    auto onBatch = [&](PointBatch &&batch) {
+        QVector<SpillPoint> records(batch.size());
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            records[i].position = batch.points[i];
+            records[i].color = batch.colors[i];
+        }
+        PointStatistics::growBounds(batch.points.constData(), batch.size(), boundsMin, boundsMax);
+
+        const qint64 bytes = records.size() * qint64(sizeof(SpillPoint));
+        spillOk = spillOk && spill.write(reinterpret_cast<const char *>(records.constData()), bytes) == bytes;
+        pointCount += records.size();
+    };
+
+    if (!PtsParser::parseFile(sourceFile, onBatch, [&](int percent) { return report(percent / 2); }, nullptr, errorMessage)
+        || !spillOk || !spill.flush()) {
+        if (spillOk && errorMessage && errorMessage->isEmpty())
+            *errorMessage = spill.errorString();
+        spill.remove();
+        return false;
+    }
+
+    if (pointCount == 0) {
+        spill.remove();
+        return fail(errorMessage, QStringLiteral("No valid points found"));
+    }
+
+    // Size the grid for about TargetChunkPoints per cell. Thin axes get a
+    // single cell, which keeps flat scans from ending up with mostly empty cells.
+    const QVector3D extent = boundsMax - boundsMin;
+    const double targetCells = qMax(1.0, pointCount / TargetChunkPoints);
+    double cellSize = qMax<double>(qMax(qMax(extent.x(), extent.y()), extent.z()), 1e-6) / std::cbrt(targetCells);
+    int dims[3] = { 1, 1, 1 };
+    for (int iteration = 0; iteration < 32; ++iteration) {
+        for (int axis = 0; axis < 3; ++axis)
+            dims[axis] = qBound(1, int(std::ceil(extent[axis] / cellSize)), 1 << 20);
+        const double cells = double(dims[0]) * dims[1] * dims[2];
+        if (cells >= targetCells * 0.5 || cells * 2.0 > double(MaxGridCells))
+            break;
+        cellSize *= 0.7937;     // Halves the cell volume
+    }
+    while (qint64(dims[0]) * dims[1] * dims[2] > MaxGridCells) {
+        cellSize *= 1.26;
+        for (int axis = 0; axis < 3; ++axis)
+            dims[axis] = qBound(1, int(std::ceil(extent[axis] / cellSize)), 1 << 20);
+    }
+
+    const float inverseCellSize = float(1.0 / cellSize);
+    auto cellOf = [&](const QVector3D &point) {
+        const QVector3D local = (point - boundsMin) * inverseCellSize;
+        const int x = qBound(0, int(local.x()), dims[0] - 1);
+        const int y = qBound(0, int(local.y()), dims[1] - 1);
+        const int z = qBound(0, int(local.z()), dims[2] - 1);
+        return (qint64(z) * dims[1] + y) * dims[0] + x;
+    };
+
+    // Pass 2a: count the points of every cell and lay the cells out back to back
+    std::vector<quint64> cellFirst(size_t(dims[0]) * dims[1] * dims[2] + 1, 0);
+    if (!forEachSpillPoint(spill, pointCount, [&](const SpillPoint &record) { ++cellFirst[size_t(cellOf(record.position)) + 1]; })) {
+        spill.remove();
+        return fail(errorMessage, spill.errorString());
+    }
+    if (!report(60)) {
+        spill.remove();
+        return fail(errorMessage, QStringLiteral("Cancelled"));
+    }
+
+    QVector<ChunkRecord> records;
+    for (size_t cell = 0; cell + 1 < cellFirst.size(); ++cell) {
+        const quint64 count = cellFirst[cell + 1];
+        cellFirst[cell + 1] += cellFirst[cell];
+        if (count == 0)
+            continue;
+
+        // Crowded cells are split into several chunks of similar size
+        const quint64 pieces = (count + MaxChunkPoints - 1) / MaxChunkPoints;
+        for (quint64 piece = 0; piece < pieces; ++piece) {
+            ChunkRecord record;
+            std::memset(&record, 0, sizeof(record));
+            record.first = cellFirst[cell] + count * piece / pieces;
+            record.count = quint32(cellFirst[cell] + count * (piece + 1) / pieces - record.first);
+            records.append(record);
+        }
+    }
+
+    // Pass 2b: scatter the points into place in the mapped output file
+    const qint64 positionsOffset = qint64(sizeof(ChunkFileHeader)) + records.size() * qint64(sizeof(ChunkRecord));
+    const qint64 colorsOffset = positionsOffset + pointCount * qint64(sizeof(QVector3D));
+    const qint64 fileSize = colorsOffset + pointCount * qint64(sizeof(PointColor));
+
+    QFile output(chunkFile + ".part");
+    uchar *base = nullptr;
+    if (!output.open(QIODevice::ReadWrite | QIODevice::Truncate) || !output.resize(fileSize)
+        || !(base = output.map(0, fileSize))) {
+        const QString message = output.errorString();
+        output.remove();
+        spill.remove();
+        return fail(errorMessage, message);
+    }
+
+    QVector3D *positions = reinterpret_cast<QVector3D *>(base + positionsOffset);
+    PointColor *colors = reinterpret_cast<PointColor *>(base + colorsOffset);
+    std::vector<quint64> cursor(cellFirst.begin(), cellFirst.end() - 1);
+    const bool scattered = forEachSpillPoint(spill, pointCount, [&](const SpillPoint &record) {
+        const quint64 index = cursor[size_t(cellOf(record.position))]++;
+        positions[index] = record.position;
+        colors[index] = record.color;
+    });
+    spill.remove();
+
+    if (!scattered || !report(85)) {
+        output.unmap(base);
+        output.remove();
+        return fail(errorMessage, scattered ? QStringLiteral("Cancelled") : spill.errorString());
+    }
+
+    // Shuffle every chunk so its prefixes are even subsamples, and measure its bounds
+    QtConcurrent::blockingMap(records, [positions, colors](ChunkRecord &record) {
+        QVector3D *chunkPositions = positions + record.first;
+        PointColor *chunkColors = colors + record.first;
+
+        std::mt19937 random(quint32(record.first));
+        for (quint32 i = record.count; i > 1; --i) {
+            const quint32 j = quint32(random() % i);
+            std::swap(chunkPositions[i - 1], chunkPositions[j]);
+            std::swap(chunkColors[i - 1], chunkColors[j]);
+        }
+
+        QVector3D chunkMin = chunkPositions[0];
+        QVector3D chunkMax = chunkPositions[0];
+        PointStatistics::growBounds(chunkPositions, record.count, chunkMin, chunkMax);
+        for (int axis = 0; axis < 3; ++axis) {
+            record.boundsMin[axis] = chunkMin[axis];
+            record.boundsMax[axis] = chunkMax[axis];
+        }
+    });
+
+    ChunkFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ChunkMagic, sizeof(ChunkMagic));
+    header.version = ChunkFormatVersion;
+    header.chunkCount = quint32(records.size());
+    header.pointCount = quint64(pointCount);
+    stampOf(sourceFile, header.sourceSize, header.sourceModified);
+    for (int axis = 0; axis < 3; ++axis) {
+        header.boundsMin[axis] = boundsMin[axis];
+        header.boundsMax[axis] = boundsMax[axis];
+    }
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + sizeof(header), records.constData(), size_t(records.size()) * sizeof(ChunkRecord));
+
+    output.unmap(base);
+    output.close();
+
+    QFile::remove(chunkFile);
+    if (!output.rename(chunkFile)) {
+        output.remove();
+        return fail(errorMessage, output.errorString());
+    }
+
+    report(100);
+    return true;
+}
+
+bool OutOfCoreCloud::open(const QString &chunkFile, QString *errorMessage)
+{
+    QFile file(chunkFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(errorMessage, file.errorString());
+
+    ChunkFileHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, ChunkMagic, sizeof(ChunkMagic)) != 0
+        || header.version != ChunkFormatVersion)
+        return fail(errorMessage, QStringLiteral("Not a chunked point cloud file"));
+
+    QVector<ChunkRecord> records(header.chunkCount);
+    const qint64 recordBytes = records.size() * qint64(sizeof(ChunkRecord));
+    if (file.read(reinterpret_cast<char *>(records.data()), recordBytes) != recordBytes)
+        return fail(errorMessage, QStringLiteral("Truncated chunk table"));
+
+    m_positionsOffset = qint64(sizeof(header)) + recordBytes;
+    m_colorsOffset = m_positionsOffset + qint64(header.pointCount) * qint64(sizeof(QVector3D));
+    if (file.size() < m_colorsOffset + qint64(header.pointCount) * qint64(sizeof(PointColor)))
+        return fail(errorMessage, QStringLiteral("Truncated point data"));
+
+    m_chunks.resize(records.size());
+    for (qsizetype i = 0; i < records.size(); ++i) {
+        const ChunkRecord &record = records[i];
+        Chunk &chunk = m_chunks[i];
+        chunk.boundsMin = QVector3D(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        chunk.boundsMax = QVector3D(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+        chunk.first = record.first;
+        chunk.count = record.count;
+    }
+
+    m_filename = chunkFile;
+    m_pointCount = qint64(header.pointCount);
+    m_boundsMin = QVector3D(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    m_boundsMax = QVector3D(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    m_resident.clear();
+    m_hostMemory = 0;
+    return true;
+}
+
+PointAttributes OutOfCoreCloud::residentPoints(int chunk, quint32 wanted)
+{
+    const Chunk &info = m_chunks[chunk];
+    wanted = qBound(qMin(MinReadPoints, info.count), wanted, info.count);
+
+    ResidentChunk &resident = m_resident[chunk];
+    resident.lastUsedFrame = m_frame;
+
+    const quint32 available = quint32(resident.points.size());
+    if (available < wanted && resident.pending < wanted && !resident.failed && m_pendingReads < MaxPendingReads) {
+        // Powers of two keep a chunk from being re-read many times as the camera approaches
+        quint32 request = MinReadPoints;
+        while (request < wanted)
+            request *= 2;
+        request = qMin(request, info.count);
+
+        resident.pending = request;
+        ++m_pendingReads;
+
+        const qint64 positionsAt = m_positionsOffset + qint64(info.first) * qint64(sizeof(QVector3D));
+        const qint64 colorsAt = m_colorsOffset + qint64(info.first) * qint64(sizeof(PointColor));
+        m_pool.start([this, chunk, request, positionsAt, colorsAt, filename = m_filename]() {
+            PointAttributes points;
+            QFile file(filename);
+            if (file.open(QIODevice::ReadOnly)) {
+                points.points.resize(request);
+                points.colors.resize(request);
+                const qint64 positionBytes = qint64(request) * qint64(sizeof(QVector3D));
+                const qint64 colorBytes = qint64(request) * qint64(sizeof(PointColor));
+                if (!file.seek(positionsAt)
+                    || file.read(reinterpret_cast<char *>(points.points.data()), positionBytes) != positionBytes
+                    || !file.seek(colorsAt)
+                    || file.read(reinterpret_cast<char *>(points.colors.data()), colorBytes) != colorBytes)
+                    points = PointAttributes();
+            }
+
+            QMetaObject::invokeMethod(this, [this, chunk, points]() {
+                readFinished(chunk, points);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    return resident.points;
+}
+
+void OutOfCoreCloud::readFinished(int chunk, const PointAttributes &points)
+{
+    --m_pendingReads;
+
+    auto it = m_resident.find(chunk);
+    if (it == m_resident.end())
+        return;
+
+    it->pending = 0;
+    if (points.size() == 0) {
+        it->failed = true;
+        return;
+    }
+
+    if (points.size() > it->points.size()) {
+        m_hostMemory += (points.size() - it->points.size()) * qint64(sizeof(QVector3D) + sizeof(PointColor));
+        it->points = points;
+    }
+
+    emit chunkLoaded(chunk);
+}
+
+void OutOfCoreCloud::beginFrame()
+{
+    ++m_frame;
+}
+
+void OutOfCoreCloud::trimToBudget(qint64 hostBudgetBytes)
+{
+    if (m_hostMemory <= hostBudgetBytes)
+        return;
+
+    QVector<QPair<quint64, int>> evictable;
+    for (auto it = m_resident.constBegin(); it != m_resident.constEnd(); ++it) {
+        if (it->lastUsedFrame < m_frame && it->pending == 0)
+            evictable.append(qMakePair(it->lastUsedFrame, it.key()));
+    }
+    std::sort(evictable.begin(), evictable.end());
+
+    for (const auto &entry : evictable) {
+        if (m_hostMemory <= hostBudgetBytes)
+            break;
+        const ResidentChunk resident = m_resident.take(entry.second);
+        m_hostMemory -= resident.points.size() * qint64(sizeof(QVector3D) + sizeof(PointColor));
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef OUTOFCORECLOUD_H
+#define OUTOFCORECLOUD_H
+
+#include <QObject>
+#include <QHash>
+#include <QThreadPool>
+#include <QVector3D>
+#include "pointcloud.h"
+#include "ptsparser.h"
+
+// A point cloud that stays on disk in a chunked file and is paged into memory
+// a chunk at a time. Chunks are cells of a regular grid holding at most
+// MaxChunkPoints points, stored shuffled so that any prefix of a chunk is an
+// even subsample of it: a distant chunk only needs its first few points read.
+// Resident chunks are evicted least recently used first once the host memory
+// budget is exceeded.
+class OutOfCoreCloud : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Chunk {
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        quint64 first = 0;      // Index of the chunk's first point in the file's arrays
+        quint32 count = 0;
+    };
+
+    explicit OutOfCoreCloud(QObject *parent = nullptr);
+    ~OutOfCoreCloud();
+
+    // Converts a .pts file into a chunked file in two passes, holding no more
+    // than a window of the data in memory at any time. Intensities are dropped.
+    static bool build(const QString &sourceFile, const QString &chunkFile,
+                      const PtsParser::ProgressCallback &progress = PtsParser::ProgressCallback(),
+                      QString *errorMessage = nullptr);
+
+    // Where the chunked file of a source lives, and whether it matches the source as it is now
+    static QString chunkFilePath(const QString &sourceFile);
+    static bool isCurrent(const QString &sourceFile, const QString &chunkFile);
+
+    bool open(const QString &chunkFile, QString *errorMessage = nullptr);
+
+    qint64 pointCount() const { return m_pointCount; }
+    QVector3D boundingBoxMin() const { return m_boundsMin; }
+    QVector3D boundingBoxMax() const { return m_boundsMax; }
+    const QVector<Chunk> &chunks() const { return m_chunks; }
+
+    // Returns the points of a chunk read so far, which may be fewer than wanted.
+    // Missing points are read in the background and chunkLoaded() follows.
+    PointAttributes residentPoints(int chunk, quint32 wanted);
+
+    // Starts a frame; chunks asked for after this are kept by trimToBudget()
+    void beginFrame();
+
+    // Drops chunks not used this frame, least recently used first, until within budget
+    void trimToBudget(qint64 hostBudgetBytes);
+    qint64 hostMemoryUsage() const { return m_hostMemory; }
+
+    static constexpr quint32 MaxChunkPoints = 65536;
+
+    // Chunks are read at least this many points at a time, growing in powers of two
+    static constexpr quint32 MinReadPoints = 1024;
+
+    // Reads in flight at once; further requests wait for a later frame
+    static constexpr int MaxPendingReads = 16;
+
+signals:
+    void chunkLoaded(int chunk);
+
+private:
+    struct ResidentChunk {
+        PointAttributes points;
+        quint32 pending = 0;        // Points asked for by the read in flight, 0 when idle
+        quint64 lastUsedFrame = 0;
+        bool failed = false;
+    };
+
+    void readFinished(int chunk, const PointAttributes &points);
+
+    QString m_filename;
+    qint64 m_pointCount = 0;
+    QVector3D m_boundsMin;
+    QVector3D m_boundsMax;
+    qint64 m_positionsOffset = 0;
+    qint64 m_colorsOffset = 0;
+    QVector<Chunk> m_chunks;
+
+    QHash<int, ResidentChunk> m_resident;
+    qint64 m_hostMemory = 0;
+    quint64 m_frame = 0;
+    int m_pendingReads = 0;
+    QThreadPool m_pool;
+};
+
+#endif // OUTOFCORECLOUD_H
@@ -0,0 +1,148 @@
+#include "overlayrenderer.h"
+#include <QOpenGLShader>
+#include <cstddef>
+
+OverlayRenderer::~OverlayRenderer()
+{
+    // Normally already released by the owner while its context was current
+    delete m_program;
+}
+
+void OverlayRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+
+    const char *vertexShaderSource = R"(
+        #version 330 core
+        layout (location = 0) in vec3 corner;
+        layout (location = 1) in vec3 boxMin;
+        layout (location = 2) in vec3 boxMax;
+        layout (location = 3) in vec4 color;
+
+        uniform mat4 modelViewProjection;
+
+        out vec3 lineColor;
+
+        void main()
+        {
+            gl_Position = modelViewProjection * vec4(mix(boxMin, boxMax, corner), 1.0);
+            lineColor = color.rgb;
+        }
+    )";
+
+    const char *fragmentShaderSource = R"(
+        #version 330 core
+        in vec3 lineColor;
+        out vec4 fragColor;
+
+        void main()
+        {
+            fragColor = vec4(lineColor, 1.0);
+        }
+    )";
+
+    m_program = new QOpenGLShaderProgram();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSource);
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSource);
+    m_program->link();
+
+    // Bottom face, top face, then the four vertical edges
+    static const float edges[24][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 },  { 1, 0, 0 }, { 1, 1, 0 },  { 1, 1, 0 }, { 0, 1, 0 },  { 0, 1, 0 }, { 0, 0, 0 },
+        { 0, 0, 1 }, { 1, 0, 1 },  { 1, 0, 1 }, { 1, 1, 1 },  { 1, 1, 1 }, { 0, 1, 1 },  { 0, 1, 1 }, { 0, 0, 1 },
+        { 0, 0, 0 }, { 0, 0, 1 },  { 1, 0, 0 }, { 1, 0, 1 },  { 1, 1, 0 }, { 1, 1, 1 },  { 0, 1, 0 }, { 0, 1, 1 }
+    };
+
+    m_vao.create();
+    m_vao.bind();
+
+    m_edgeVbo.create();
+    m_edgeVbo.bind();
+    m_edgeVbo.allocate(edges, int(sizeof(edges)));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
+
+    // Attribute pointers are set once the instance buffer first has storage
+    m_instanceVbo.create();
+    m_instanceVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+
+    m_vao.release();
+    m_edgeVbo.release();
+}
+
+void OverlayRenderer::release()
+{
+    delete m_program;
+    m_program = nullptr;
+    m_vao.destroy();
+    m_edgeVbo.destroy();
+    m_instanceVbo.destroy();
+    m_instanceCapacity = 0;
+    m_dirty = !m_instances.isEmpty();
+}
+
+void OverlayRenderer::clear()
+{
+    m_instances.clear();
+    m_dirty = true;
+}
+
+void OverlayRenderer::addBox(const QVector3D &boxMin, const QVector3D &boxMax, const PointColor &color)
+{
+    m_instances.append({ boxMin, boxMax, color });
+    m_dirty = true;
+}
+
+void OverlayRenderer::addSegment(const QVector3D &from, const QVector3D &to, const PointColor &color)
+{
+    // Eight of the box's edges collapse onto the segment and four to points, which draw nothing
+    addBox(from, to, color);
+}
+
+void OverlayRenderer::addAxes(const QVector3D &origin, float length)
+{
+    addSegment(origin, origin + QVector3D(length, 0.0f, 0.0f), { 255, 0, 0, 255 });
+    addSegment(origin, origin + QVector3D(0.0f, length, 0.0f), { 0, 255, 0, 255 });
+    addSegment(origin, origin + QVector3D(0.0f, 0.0f, length), { 0, 0, 255, 255 });
+}
+
+void OverlayRenderer::render(const QMatrix4x4 &modelViewProjection)
+{
+    if (!m_program || m_instances.isEmpty())
+        return;
+
+    m_vao.bind();
+
+    if (m_dirty) {
+        m_instanceVbo.bind();
+        const int bytes = m_instances.size() * int(sizeof(Instance));
+
+        // Doubling keeps reallocation rare as a selection grows one entity at a time
+        if (m_instances.size() > m_instanceCapacity) {
+            m_instanceCapacity = qMax(m_instances.size(), m_instanceCapacity * 2);
+            m_instanceVbo.allocate(m_instanceCapacity * int(sizeof(Instance)));
+
+            const GLsizei stride = sizeof(Instance);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(offsetof(Instance, boxMin)));
+            glVertexAttribDivisor(1, 1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(offsetof(Instance, boxMax)));
+            glVertexAttribDivisor(2, 1);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<void *>(offsetof(Instance, color)));
+            glVertexAttribDivisor(3, 1);
+        }
+
+        m_instanceVbo.write(0, m_instances.constData(), bytes);
+        m_instanceVbo.release();
+        m_dirty = false;
+    }
+
+    m_program->bind();
+    m_program->setUniformValue("modelViewProjection", modelViewProjection);
+    glDrawArraysInstanced(GL_LINES, 0, 24, m_instances.size());
+    m_program->release();
+
+    m_vao.release();
+}
@@ -0,0 +1,60 @@
+#ifndef OVERLAYRENDERER_H
+#define OVERLAYRENDERER_H
+
+#include <QOpenGLExtraFunctions>
+#include <QtOpenGL/QOpenGLBuffer>
+#include <QtOpenGL/QOpenGLVertexArrayObject>
+#include <QtOpenGL/QOpenGLShaderProgram>
+#include <QMatrix4x4>
+#include <QVector>
+#include <QVector3D>
+#include "pointcloud.h"
+
+// Line overlays drawn over the scene: bounding boxes, axes and selection
+// gizmos. Every overlay is an instance of the twelve edges of a unit cube,
+// stretched between two corners, so a segment is simply a box that is flat
+// along two axes. The instances live in one buffer that is only rewritten
+// when the overlays change and only reallocated when it has to grow, and the
+// whole set is drawn with a single instanced call however many there are.
+class OverlayRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    OverlayRenderer() = default;
+    ~OverlayRenderer();
+
+    // Both need the widget's context to be current
+    void initialize();
+    void release();
+
+    // Replaces the overlays in one go; they are uploaded on the next render()
+    void clear();
+    void addBox(const QVector3D &boxMin, const QVector3D &boxMax, const PointColor &color);
+    void addSegment(const QVector3D &from, const QVector3D &to, const PointColor &color);
+
+    // Red, green and blue segments along x, y and z
+    void addAxes(const QVector3D &origin, float length);
+
+    int instanceCount() const { return m_instances.size(); }
+    bool isEmpty() const { return m_instances.isEmpty(); }
+
+    // Draws every overlay; depth testing is left to the caller
+    void render(const QMatrix4x4 &modelViewProjection);
+
+private:
+    struct Instance {
+        QVector3D boxMin;
+        QVector3D boxMax;
+        PointColor color;
+    };
+
+    QVector<Instance> m_instances;
+    bool m_dirty = false;
+
+    QOpenGLShaderProgram *m_program = nullptr;
+    QOpenGLVertexArrayObject m_vao;
+    QOpenGLBuffer m_edgeVbo;        // The 24 corners of the unit cube's edges, shared by all instances
+    QOpenGLBuffer m_instanceVbo;
+    int m_instanceCapacity = 0;
+};
+
+#endif // OVERLAYRENDERER_H
@@ -0,0 +1,431 @@
+#include "plyformat.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QtEndian>
+
+namespace {
+
+enum class ScalarType {
+    Invalid,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64
+};
+
+ScalarType scalarType(const QByteArray &name)
+{
+    if (name == "char" || name == "int8")
+        return ScalarType::Int8;
+    if (name == "uchar" || name == "uint8")
+        return ScalarType::UInt8;
+    if (name == "short" || name == "int16")
+        return ScalarType::Int16;
+    if (name == "ushort" || name == "uint16")
+        return ScalarType::UInt16;
+    if (name == "int" || name == "int32")
+        return ScalarType::Int32;
+    if (name == "uint" || name == "uint32")
+        return ScalarType::UInt32;
+    if (name == "float" || name == "float32")
+        return ScalarType::Float32;
+    if (name == "double" || name == "float64")
+        return ScalarType::Float64;
+    return ScalarType::Invalid;
+}
+
+int scalarSize(ScalarType type)
+{
+    switch (type) {
+    case ScalarType::Int8:
+    case ScalarType::UInt8:
+        return 1;
+    case ScalarType::Int16:
+    case ScalarType::UInt16:
+        return 2;
+    case ScalarType::Int32:
+    case ScalarType::UInt32:
+    case ScalarType::Float32:
+        return 4;
+    case ScalarType::Float64:
+        return 8;
+    case ScalarType::Invalid:
+        break;
+    }
+    return 0;
+}
+
+template <typename T>
+inline T load(const uchar *data, bool bigEndian)
+{
+    return bigEndian ? qFromBigEndian<T>(data) : qFromLittleEndian<T>(data);
+}
+
+inline double readScalar(const uchar *data, ScalarType type, bool bigEndian)
+{
+    switch (type) {
+    case ScalarType::Int8:    return double(qint8(*data));
+    case ScalarType::UInt8:   return double(*data);
+    case ScalarType::Int16:   return double(load<qint16>(data, bigEndian));
+    case ScalarType::UInt16:  return double(load<quint16>(data, bigEndian));
+    case ScalarType::Int32:   return double(load<qint32>(data, bigEndian));
+    case ScalarType::UInt32:  return double(load<quint32>(data, bigEndian));
+    case ScalarType::Float32: return double(load<float>(data, bigEndian));
+    case ScalarType::Float64: return load<double>(data, bigEndian);
+    case ScalarType::Invalid: break;
+    }
+    return 0.0;
+}
+
+// Where a vertex property sits within a record
+struct Field {
+    int offset = -1;
+    ScalarType type = ScalarType::Invalid;
+
+    bool isValid() const { return offset >= 0; }
+};
+
+// Colour components come as 8 or 16-bit integers or as floats in [0, 1]
+double colorScale(ScalarType type)
+{
+    switch (type) {
+    case ScalarType::Float32:
+    case ScalarType::Float64:
+        return 255.0;
+    case ScalarType::Int16:
+    case ScalarType::UInt16:
+        return 1.0 / 257.0;
+    default:
+        return 1.0;
+    }
+}
+
+struct VertexLayout {
+    bool bigEndian = false;
+    qint64 count = 0;
+    qint64 offset = 0;          // Of the first vertex record from the start of the file
+    int recordSize = 0;
+    Field position[3];
+    Field color[3];
+    Field intensity;
+    bool hasFaces = false;      // A list element, such as faces, follows the vertices
+};
+
+bool parseHeader(const uchar *data, qint64 size, VertexLayout &layout, QString &error)
+{
+    static const QByteArray EndHeader = "end_header";
+    const QByteArray head = QByteArray::fromRawData(reinterpret_cast<const char *>(data), int(qMin<qint64>(size, 64 * 1024)));
+    const qsizetype endHeader = head.indexOf(EndHeader);
+    const qsizetype dataStart = endHeader < 0 ? -1 : head.indexOf('\n', endHeader) + 1;
+    if (!head.startsWith("ply") || dataStart <= 0) {
+        error = QStringLiteral("Not a PLY file");
+        return false;
+    }
+
+    bool inVertex = false;
+    bool seenVertex = false;
+    qint64 precedingBytes = 0;      // Elements stored before the vertices
+    qint64 elementCount = 0;
+    qint64 elementSize = 0;
+    bool elementHasList = false;
+
+    // False when an element before the vertices declares more bytes than the file holds
+    auto closeElement = [&]() {
+        if (inVertex) {
+            layout.recordSize = int(elementSize);
+            seenVertex = true;
+        } else if (!seenVertex) {
+            if (elementCount < 0 || (elementSize > 0 && elementCount > (size - precedingBytes) / elementSize))
+                return false;
+            precedingBytes += elementCount * elementSize;
+        } else if (elementHasList) {
+            layout.hasFaces = true;
+        }
+        return true;
+    };
+
+    const QList<QByteArray> lines = head.left(endHeader).split('\n');
+    for (const QByteArray &line : lines) {
+        const QList<QByteArray> tokens = line.simplified().split(' ');
+        const QByteArray &keyword = tokens.first();
+
+        if (keyword == "format") {
+            if (tokens.size() < 2 || tokens[1] == "ascii") {
+                error = QStringLiteral("ASCII PLY files are not supported by the built-in reader");
+                return false;
+            }
+            layout.bigEndian = tokens[1] == "binary_big_endian";
+        } else if (keyword == "element" && tokens.size() >= 3) {
+            if (!closeElement()) {
+                error = QStringLiteral("PLY file is shorter than its header declares");
+                return false;
+            }
+            if (!seenVertex && elementHasList) {
+                error = QStringLiteral("Elements with list properties before the vertices are not supported");
+                return false;
+            }
+            inVertex = tokens[1] == "vertex";
+            elementCount = tokens[2].toLongLong();
+            elementSize = 0;
+            elementHasList = false;
+            if (inVertex)
+                layout.count = elementCount;
+        } else if (keyword == "property" && tokens.size() >= 3) {
+            if (tokens[1] == "list") {
+                elementHasList = true;
+                if (inVertex) {
+                    error = QStringLiteral("Vertices with list properties are not supported");
+                    return false;
+                }
+                continue;
+            }
+
+            const ScalarType type = scalarType(tokens[1]);
+            if (type == ScalarType::Invalid) {
+                error = QStringLiteral("Unknown PLY property type %1").arg(QString::fromLatin1(tokens[1]));
+                return false;
+            }
+
+            if (inVertex) {
+                const QByteArray &name = tokens[2];
+                const Field field { int(elementSize), type };
+                if (name == "x")
+                    layout.position[0] = field;
+                else if (name == "y")
+                    layout.position[1] = field;
+                else if (name == "z")
+                    layout.position[2] = field;
+                else if (name == "red" || name == "r" || name == "diffuse_red")
+                    layout.color[0] = field;
+                else if (name == "green" || name == "g" || name == "diffuse_green")
+                    layout.color[1] = field;
+                else if (name == "blue" || name == "b" || name == "diffuse_blue")
+                    layout.color[2] = field;
+                else if (name == "intensity" || name == "scalar_intensity")
+                    layout.intensity = field;
+            }
+            elementSize += scalarSize(type);
+        }
+    }
+    if (!closeElement()) {
+        error = QStringLiteral("PLY file is shorter than its header declares");
+        return false;
+    }
+
+    if (!seenVertex || !layout.position[0].isValid() || !layout.position[1].isValid() || !layout.position[2].isValid()) {
+        error = QStringLiteral("PLY file has no vertex positions");
+        return false;
+    }
+
+    layout.offset = dataStart + precedingBytes;
+    if (layout.count < 0 || layout.recordSize <= 0 || layout.offset > size
+        || layout.count > (size - layout.offset) / layout.recordSize) {
+        error = QStringLiteral("PLY file is shorter than its header declares");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool PlyWriter::writeFile(const QString &filename, const PointAttributes &points,
+                          const ProgressCallback &progress, PtsWriteStats *stats, QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype pointCount = points.size();
+    const bool hasColors = points.colors.size() == pointCount;
+    const bool hasIntensities = points.intensities.size() == pointCount;
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    auto fail = [&](const QString &message) {
+        if (errorMessage)
+            *errorMessage = message;
+        file.cancelWriting();
+        return false;
+    };
+
+    QByteArray header = "ply\nformat binary_little_endian 1.0\n";
+    header += "element vertex " + QByteArray::number(qint64(pointCount)) + "\n";
+    header += "property float x\nproperty float y\nproperty float z\n";
+    if (hasColors)
+        header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    if (hasIntensities)
+        header += "property float intensity\n";
+    header += "end_header\n";
+
+    qint64 bytes = header.size();
+    if (file.write(header) != header.size())
+        return fail(file.errorString());
+
+    const qsizetype recordSize = 3 * qsizetype(sizeof(float))
+                               + (hasColors ? 3 : 0)
+                               + (hasIntensities ? qsizetype(sizeof(float)) : 0);
+    QByteArray block(qMin(pointCount, BlockPoints) * recordSize, Qt::Uninitialized);
+
+    for (qsizetype first = 0; first < pointCount; first += BlockPoints) {
+        if (progress && !progress(static_cast<int>(first * 100 / pointCount)))
+            return fail(QStringLiteral("Cancelled"));
+
+        const qsizetype count = qMin(BlockPoints, pointCount - first);
+        char *out = block.data();
+        for (qsizetype i = first; i < first + count; ++i) {
+            const QVector3D &point = points.points[i];
+            qToLittleEndian(point.x(), out);
+            qToLittleEndian(point.y(), out + 4);
+            qToLittleEndian(point.z(), out + 8);
+            out += 12;
+            if (hasColors) {
+                const PointColor &color = points.colors[i];
+                out[0] = char(color.r);
+                out[1] = char(color.g);
+                out[2] = char(color.b);
+                out += 3;
+            }
+            if (hasIntensities) {
+                qToLittleEndian(points.intensities[i], out);
+                out += 4;
+            }
+        }
+
+        const qint64 blockBytes = count * recordSize;
+        if (file.write(block.constData(), blockBytes) != blockBytes)
+            return fail(file.errorString());
+        bytes += blockBytes;
+    }
+
+    if (!file.commit())
+        return fail(file.errorString());
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = bytes;
+        stats->points = pointCount;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
+
+bool PlyReader::hasFaces(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0)
+        return false;
+
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return false;
+
+    VertexLayout layout;
+    QString error;
+    return parseHeader(data, file.size(), layout, error) && layout.hasFaces;
+}
+
+bool PlyReader::readFile(const QString &filename, PointAttributes &points,
+                         const ProgressCallback &progress, PtsParseStats *stats, QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    auto fail = [errorMessage](const QString &message) {
+        if (errorMessage)
+            *errorMessage = message;
+        return false;
+    };
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+
+    const qint64 fileSize = file.size();
+    const uchar *data = fileSize > 0 ? file.map(0, fileSize) : nullptr;
+    if (!data)
+        return fail(QStringLiteral("Cannot map %1").arg(filename));
+
+    VertexLayout layout;
+    QString error;
+    if (!parseHeader(data, fileSize, layout, error))
+        return fail(error);
+
+    const qsizetype count = qsizetype(layout.count);
+    const bool hasColors = layout.color[0].isValid() && layout.color[1].isValid() && layout.color[2].isValid();
+    const bool hasIntensities = layout.intensity.isValid();
+
+    points = PointAttributes();
+    points.points.resize(count);
+    points.colors.resize(count);        // White unless the file has colours
+    if (hasIntensities)
+        points.intensities.resize(count);
+
+    // Workers write disjoint ranges through raw pointers taken once, up front
+    QVector3D *positionsOut = points.points.data();
+    PointColor *colorsOut = hasColors ? points.colors.data() : nullptr;
+    float *intensitiesOut = hasIntensities ? points.intensities.data() : nullptr;
+    const uchar *records = data + layout.offset;
+    const double colorScales[3] = { colorScale(layout.color[0].type), colorScale(layout.color[1].type),
+                                    colorScale(layout.color[2].type) };
+
+    auto decode = [&](const QPair<qsizetype, qsizetype> &range) {
+        for (qsizetype i = range.first; i < range.first + range.second; ++i) {
+            const uchar *record = records + qint64(i) * layout.recordSize;
+            QVector3D &point = positionsOut[i];
+            for (int axis = 0; axis < 3; ++axis)
+                point[axis] = float(readScalar(record + layout.position[axis].offset, layout.position[axis].type, layout.bigEndian));
+
+            if (colorsOut) {
+                quint8 components[3];
+                for (int c = 0; c < 3; ++c) {
+                    const double value = readScalar(record + layout.color[c].offset, layout.color[c].type, layout.bigEndian);
+                    components[c] = quint8(qBound(0.0, value * colorScales[c] + 0.5, 255.0));
+                }
+                colorsOut[i].r = components[0];
+                colorsOut[i].g = components[1];
+                colorsOut[i].b = components[2];
+            }
+
+            if (intensitiesOut)
+                intensitiesOut[i] = float(readScalar(record + layout.intensity.offset, layout.intensity.type, layout.bigEndian));
+        }
+    };
+
+    QVector<QPair<qsizetype, qsizetype>> chunks;
+    for (qsizetype first = 0; first < count; first += ChunkPoints)
+        chunks.append(qMakePair(first, qMin(ChunkPoints, count - first)));
+
+    // Chunks are decoded in waves a few times wider than the pool so the job can be cancelled in between
+    const qsizetype waveSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * 2);
+    for (qsizetype first = 0; first < chunks.size(); first += waveSize) {
+        if (progress && !progress(static_cast<int>(first * 100 / chunks.size())))
+            return fail(QStringLiteral("Cancelled"));
+
+        QVector<QPair<qsizetype, qsizetype>> wave = chunks.mid(first, waveSize);
+        QtConcurrent::blockingMap(wave, decode);
+    }
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = fileSize;
+        stats->points = count;
+        stats->malformedLines = 0;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
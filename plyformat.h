@@ -0,0 +1,51 @@
+#ifndef PLYFORMAT_H
+#define PLYFORMAT_H
+
+#include <QString>
+#include "pointcloud.h"
+#include "ptsparser.h"
+#include "ptswriter.h"
+
+// Reader for binary .ply files of either byte order. Only the vertex element is
+// read: x, y and z, red, green and blue (or r, g and b) and an intensity
+// (or scalar_intensity) when present, from properties of any scalar type.
+// ASCII files and vertices with list properties are rejected. Faces and any
+// other elements after the vertices are skipped; hasFaces() tells such meshes apart.
+// Vertices without colours are read as white.
+class PlyReader
+{
+public:
+    using ProgressCallback = PtsParser::ProgressCallback;
+
+    // Sizes the arrays from the declared vertex count, then decodes the mapped
+    // records in parallel chunks straight into them
+    static bool readFile(const QString &filename, PointAttributes &points,
+                         const ProgressCallback &progress = ProgressCallback(),
+                         PtsParseStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // True for a binary file whose vertices are followed by an element with
+    // list properties, such as faces, which readFile() would drop
+    static bool hasFaces(const QString &filename);
+
+    // Records decoded by one worker at a time
+    static constexpr qsizetype ChunkPoints = 1 << 20;
+};
+
+// Writer for binary little-endian .ply files. Vertices carry float x, y and z,
+// then uchar red, green and blue and a float intensity when the cloud has them.
+class PlyWriter
+{
+public:
+    using ProgressCallback = PtsWriter::ProgressCallback;
+
+    // Packs records block by block into one reused buffer and writes through a
+    // temporary file, so a failed or cancelled export leaves no partial file
+    static bool writeFile(const QString &filename, const PointAttributes &points,
+                          const ProgressCallback &progress = ProgressCallback(),
+                          PtsWriteStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // Records packed between progress reports
+    static constexpr qsizetype BlockPoints = 65536;
+};
+
+#endif // PLYFORMAT_H
@@ -0,0 +1,174 @@
+#include "pointcache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+namespace {
+
+const char CacheMagic[8] = { 'P', 'T', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+enum AttributeFlag : quint32 {
+    HasColors = 0x1,
+    HasIntensities = 0x2
+};
+
+// Written as is; every field is naturally aligned so the layout has no padding
+struct CacheHeader {
+    char magic[8];
+    quint32 version;
+    quint32 attributes;
+    quint64 pointCount;
+    qint64 sourceSize;
+    qint64 sourceModified;      // Milliseconds since the epoch
+    float boundingBoxMin[3];
+    float boundingBoxMax[3];
+    char sourceFormat[16];
+    char reserved[48];
+};
+static_assert(sizeof(CacheHeader) == 128, "the cache header layout is part of the file format");
+
+struct SourceStamp {
+    qint64 size = -1;
+    qint64 modified = 0;
+};
+
+SourceStamp stampOf(const QString &sourceFile)
+{
+    SourceStamp stamp;
+    QFileInfo info(sourceFile);
+    if (info.exists()) {
+        stamp.size = info.size();
+        stamp.modified = info.lastModified().toMSecsSinceEpoch();
+    }
+    return stamp;
+}
+
+} // namespace
+
+QString PointCache::cachePath(const QString &sourceFile, const QString &suffix)
+{
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pointclouds";
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(sourceFile).absoluteFilePath().toUtf8(),
+                                                    QCryptographicHash::Sha1).toHex();
+    return directory + "/" + QString::fromLatin1(key) + "." + suffix;
+}
+
+bool PointCache::read(const QString &sourceFile, Contents &contents)
+{
+    const SourceStamp stamp = stampOf(sourceFile);
+    if (stamp.size < 0)
+        return false;
+
+    QFile file(cachePath(sourceFile));
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(CacheHeader)))
+        return false;
+
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return false;
+
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != FormatVersion)
+        return false;
+
+    // A source that changed since the cache was written invalidates it
+    if (header.sourceSize != stamp.size || header.sourceModified != stamp.modified)
+        return false;
+
+    const qint64 count = qint64(header.pointCount);
+    const bool hasColors = header.attributes & HasColors;
+    const bool hasIntensities = header.attributes & HasIntensities;
+    const qint64 expectedSize = qint64(sizeof(CacheHeader)) + count * qint64(sizeof(QVector3D))
+                              + (hasColors ? count * qint64(sizeof(PointColor)) : 0)
+                              + (hasIntensities ? count * qint64(sizeof(float)) : 0);
+    if (count <= 0 || file.size() != expectedSize)
+        return false;
+
+    const uchar *cursor = data + sizeof(CacheHeader);
+    auto readArray = [&cursor, count](auto &target) {
+        target.resize(count);
+        const size_t bytes = size_t(count) * sizeof(*target.data());
+        std::memcpy(target.data(), cursor, bytes);
+        cursor += bytes;
+    };
+
+    contents.points = PointAttributes();
+    readArray(contents.points.points);
+    if (hasColors)
+        readArray(contents.points.colors);
+    if (hasIntensities)
+        readArray(contents.points.intensities);
+
+    contents.boundingBoxMin = QVector3D(header.boundingBoxMin[0], header.boundingBoxMin[1], header.boundingBoxMin[2]);
+    contents.boundingBoxMax = QVector3D(header.boundingBoxMax[0], header.boundingBoxMax[1], header.boundingBoxMax[2]);
+    contents.sourceFormat = QString::fromLatin1(header.sourceFormat, int(qstrnlen(header.sourceFormat, sizeof(header.sourceFormat))));
+    contents.bytes = file.size();
+    return true;
+}
+
+bool PointCache::write(const QString &sourceFile, const QString &sourceFormat,
+                       const PointAttributes &points, const QVector3D &boundingBoxMin,
+                       const QVector3D &boundingBoxMax, QString *errorMessage)
+{
+    const SourceStamp stamp = stampOf(sourceFile);
+    if (stamp.size < 0 || points.size() == 0)
+        return false;
+
+    const QString path = cachePath(sourceFile);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        if (errorMessage)
+            *errorMessage = QString("Cannot create cache directory for %1").arg(path);
+        return false;
+    }
+
+    const bool hasColors = points.colors.size() == points.size();
+    const bool hasIntensities = points.intensities.size() == points.size();
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = FormatVersion;
+    header.attributes = (hasColors ? HasColors : 0) | (hasIntensities ? HasIntensities : 0);
+    header.pointCount = quint64(points.size());
+    header.sourceSize = stamp.size;
+    header.sourceModified = stamp.modified;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.boundingBoxMin[axis] = boundingBoxMin[axis];
+        header.boundingBoxMax[axis] = boundingBoxMax[axis];
+    }
+    const QByteArray format = sourceFormat.toLatin1().left(int(sizeof(header.sourceFormat)) - 1);
+    std::memcpy(header.sourceFormat, format.constData(), size_t(format.size()));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    auto writeBlock = [&file](const void *data, qint64 bytes) {
+        return file.write(static_cast<const char *>(data), bytes) == bytes;
+    };
+
+    bool ok = writeBlock(&header, sizeof(header))
+           && writeBlock(points.points.constData(), points.size() * qint64(sizeof(QVector3D)));
+    if (ok && hasColors)
+        ok = writeBlock(points.colors.constData(), points.size() * qint64(sizeof(PointColor)));
+    if (ok && hasIntensities)
+        ok = writeBlock(points.intensities.constData(), points.size() * qint64(sizeof(float)));
+
+    if (!ok || !file.commit()) {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef POINTCACHE_H
+#define POINTCACHE_H
+
+#include <QString>
+#include <QVector3D>
+#include "pointcloud.h"
+
+// Native binary copy of a loaded file, kept in the user's cache directory so
+// that reopening the same file skips parsing. A cache file is a fixed header
+// (point count, bounding box, attribute layout and the size and modification
+// time of its source) followed by the raw position, colour and intensity
+// arrays. It is only used while the source file is unchanged.
+class PointCache
+{
+public:
+    struct Contents {
+        PointAttributes points;
+        QVector3D boundingBoxMin;
+        QVector3D boundingBoxMax;
+        QString sourceFormat;
+        qint64 bytes = 0;   // Size of the cache file
+    };
+
+    // Where the cache of a source file lives, whether or not it exists yet; other
+    // derived files of the same source share the name with their own suffix
+    static QString cachePath(const QString &sourceFile, const QString &suffix = QStringLiteral("ptc"));
+
+    // Fills contents from a current cache of sourceFile; false if there is none or it is stale
+    static bool read(const QString &sourceFile, Contents &contents);
+
+    // Writes through a temporary file, so a crash never leaves a truncated cache behind
+    static bool write(const QString &sourceFile, const QString &sourceFormat,
+                      const PointAttributes &points, const QVector3D &boundingBoxMin,
+                      const QVector3D &boundingBoxMax, QString *errorMessage = nullptr);
+
+    // Bump whenever the layout below the header changes
+    static constexpr quint32 FormatVersion = 1;
+};
+
+#endif // POINTCACHE_H
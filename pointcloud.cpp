@@ -0,0 +1,76 @@
+#include "pointcloud.h"
+
+void PointAttributes::append(const PointAttributes &other)
+{
+    const qsizetype existing = points.size();
+
+    points.append(other.points);
+    colors.append(other.colors);
+
+    if (other.hasIntensities() || hasIntensities()) {
+        intensities.resize(existing);
+        if (other.hasIntensities())
+            intensities.append(other.intensities);
+        else
+            intensities.resize(existing + other.points.size());
+    }
+}
+
+PointAttributes PointAttributes::reordered(const QVector<quint32> &order) const
+{
+    auto gather = [&order](const auto &source, auto &target) {
+        if (source.isEmpty())
+            return;
+        target.resize(order.size());
+        const auto *in = source.constData();
+        auto *out = target.data();
+        for (qsizetype i = 0; i < order.size(); ++i)
+            out[i] = in[order[i]];
+    };
+
+    PointAttributes result;
+    gather(points, result.points);
+    gather(colors, result.colors);
+    gather(intensities, result.intensities);
+    return result;
+}
+
+void PrimitiveList::append(const QVector<QVector3D> &primitiveVertices, const QVector<PointColor> &primitiveColors)
+{
+    if (offsets.isEmpty())
+        offsets.append(0);
+
+    vertices.append(primitiveVertices);
+    if (primitiveColors.size() == primitiveVertices.size())
+        colors.append(primitiveColors);
+    else
+        colors.resize(vertices.size());
+    offsets.append(quint32(vertices.size()));
+}
+
+void PrimitiveList::clear()
+{
+    vertices.clear();
+    colors.clear();
+    offsets.clear();
+}
+
+qint64 PointCloud::pointMemoryUsage() const
+{
+    return static_cast<qint64>(points.capacity()) * sizeof(QVector3D)
+         + static_cast<qint64>(colors.capacity()) * sizeof(PointColor)
+         + static_cast<qint64>(intensities.capacity()) * sizeof(float);
+}
+
+double PointCloud::bytesPerPoint() const
+{
+    return points.isEmpty() ? 0.0 : static_cast<double>(pointMemoryUsage()) / points.size();
+}
+
+qint64 PointCloud::triangleCount() const
+{
+    qint64 triangles = 0;
+    for (const MeshPart &mesh : meshes)
+        triangles += mesh.triangleCount();
+    return triangles;
+}
@@ -0,0 +1,88 @@
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QColor>
+#include <QPair>
+#include <QString>
+
+// 8-bit RGBA colour, uploaded as a normalized unsigned byte vertex attribute
+struct PointColor {
+    quint8 r = 255;
+    quint8 g = 255;
+    quint8 b = 255;
+    quint8 a = 255;
+};
+Q_DECLARE_TYPEINFO(PointColor, Q_PRIMITIVE_TYPE);
+
+// Per-point data stored as parallel arrays. Optional attributes are either
+// empty or hold exactly one value per point.
+struct PointAttributes {
+    QVector<QVector3D> points;
+    QVector<PointColor> colors;
+    QVector<float> intensities;
+
+    qsizetype size() const { return points.size(); }
+    bool hasIntensities() const { return !intensities.isEmpty(); }
+
+    // Appends another run of points, padding optional attributes either side has not got
+    void append(const PointAttributes &other);
+
+    // Returns a copy holding the point at order[i] in place i
+    PointAttributes reordered(const QVector<quint32> &order) const;
+};
+
+// A run of points read from a file
+using PointBatch = PointAttributes;
+
+// Triangles of one imported mesh, indexed into its own vertices and drawn in one material
+struct MeshPart {
+    QVector<QVector3D> vertices;
+    QVector<QVector3D> normals;     // Empty, or one per vertex
+    QVector<quint32> indices;       // Three per triangle
+    QString materialName;
+    PointColor diffuse = { 204, 204, 204, 255 };
+
+    qsizetype triangleCount() const { return indices.size() / 3; }
+};
+
+// Polygons or polylines stored back to back in flat arrays: primitive i owns
+// the vertices [offsets[i], offsets[i + 1]), so adding one costs no allocation of its own
+struct PrimitiveList {
+    QVector<QVector3D> vertices;
+    QVector<PointColor> colors;     // One per vertex
+    QVector<quint32> offsets;       // count() + 1 entries once anything has been added
+
+    qsizetype count() const { return qMax<qsizetype>(0, offsets.size() - 1); }
+    bool isEmpty() const { return count() == 0; }
+    qsizetype vertexCount(qsizetype primitive) const { return offsets[primitive + 1] - offsets[primitive]; }
+
+    // Colours default to white when none are given
+    void append(const QVector<QVector3D> &primitiveVertices, const QVector<PointColor> &primitiveColors = QVector<PointColor>());
+    void clear();
+};
+
+// Structure to hold point cloud data with rendering properties
+struct PointCloud : PointAttributes {
+    QString sourceFormat;
+    bool isVisible = true;
+    float pointSize = 3.0f;
+    QColor tintColor = QColor(255, 255, 255);
+
+    QVector<MeshPart> meshes;
+    PrimitiveList polygons;     // Convex, drawn as triangle fans
+    PrimitiveList lines;        // Polylines through their vertices in order
+
+    QVector3D boundingBoxMin;
+    QVector3D boundingBoxMax;
+
+    // Host memory held by the point arrays, including reserved capacity
+    qint64 pointMemoryUsage() const;
+    double bytesPerPoint() const;
+
+    qint64 triangleCount() const;
+    bool hasGeometry() const { return !points.isEmpty() || !meshes.isEmpty(); }
+};
+
+#endif // POINTCLOUD_H
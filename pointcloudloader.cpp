@@ -0,0 +1,444 @@
+#include "pointcloudloader.h"
+#include "pointcache.h"
+#include "outofcorecloud.h"
+#include "plyformat.h"
+#include "lasformat.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QThread>
+#include <exception>
+
+#ifdef USE_ASSIMP
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#endif
+
+PointCloudLoader::PointCloudLoader(QObject *parent)
+    : QObject(parent)
+{
+    // Each job fans its parsing out to the global pool, so a couple of
+    // concurrent files are enough to keep the disk busy
+    m_pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount() / 4));
+}
+
+PointCloudLoader::~PointCloudLoader()
+{
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+bool PointCloudLoader::isAssimpFormat(const QString &extension)
+{
+#ifdef USE_ASSIMP
+    return extension == "obj" || extension == "fbx" || extension == "dae" ||
+           extension == "3ds" || extension == "ply" || extension == "stl" ||
+           extension == "gltf" || extension == "glb";
+#else
+    Q_UNUSED(extension);
+    return false;
+#endif
+}
+
+bool PointCloudLoader::isBinaryFormat(const QString &extension)
+{
+    return extension == "ply" || extension == "las";
+}
+
+int PointCloudLoader::load(const QString &filename)
+{
+    QSharedPointer<Job> job(new Job);
+    job->id = m_nextJobId++;
+    job->filename = filename;
+    job->downsampling = m_downsampling;
+    m_jobs.insert(job->id, job);
+
+    m_pool.start([this, job]() { runJob(job); });
+    return job->id;
+}
+
+int PointCloudLoader::loadOutOfCore(const QString &filename)
+{
+    QSharedPointer<Job> job(new Job);
+    job->id = m_nextJobId++;
+    job->filename = filename;
+    job->outOfCore = true;
+    m_jobs.insert(job->id, job);
+
+    m_pool.start([this, job]() { runJob(job); });
+    return job->id;
+}
+
+void PointCloudLoader::cancel(int jobId)
+{
+    QSharedPointer<Job> job = m_jobs.take(jobId);
+    if (!job)
+        return;
+
+    job->cancelled = true;
+    emit loadCancelled(jobId);
+}
+
+void PointCloudLoader::cancelAll()
+{
+    const QList<int> ids = m_jobs.keys();
+    for (int id : ids)
+        cancel(id);
+}
+
+bool PointCloudLoader::isLoading(int jobId) const
+{
+    return m_jobs.contains(jobId);
+}
+
+int PointCloudLoader::activeJobCount() const
+{
+    return m_jobs.size();
+}
+
+template <typename Function>
+void PointCloudLoader::postToOwner(int jobId, Function &&function)
+{
+    QMetaObject::invokeMethod(this, [this, jobId, function = std::forward<Function>(function)]() mutable {
+        if (m_jobs.contains(jobId))
+            function();
+    }, Qt::QueuedConnection);
+}
+
+void PointCloudLoader::runJob(const QSharedPointer<Job> &job)
+{
+    LoadSummary summary;
+    QString errorMessage;
+    bool success = false;
+
+    try
+    {
+        const QString extension = QFileInfo(job->filename).suffix().toLower();
+
+        // A binary PLY with faces is a mesh; the built-in reader would keep only its vertices
+        const bool plyMesh = extension == "ply" && PlyReader::hasFaces(job->filename);
+
+        // The cache holds points only, so models that Assimp alone reads never use it
+        const bool cacheable = !plyMesh && (isBinaryFormat(extension) || !isAssimpFormat(extension));
+        summary.cacheable = cacheable && !job->outOfCore;
+
+        if (job->outOfCore)
+        {
+            success = loadOutOfCore(job, summary, errorMessage);
+        }
+        else if (cacheable && loadCached(job, summary))
+        {
+            success = true;
+        }
+#ifdef USE_ASSIMP
+        else if (plyMesh)
+        {
+            success = loadAssimp(job, summary, errorMessage);
+        }
+#endif
+        else if (isBinaryFormat(extension))
+        {
+            success = loadBinary(job, summary, errorMessage);
+#ifdef USE_ASSIMP
+            // ASCII PLY and anything else the built-in readers turn down still goes through Assimp
+            if (!success && !job->cancelled && isAssimpFormat(extension))
+                success = loadAssimp(job, summary, errorMessage);
+#endif
+        }
+        else if (isAssimpFormat(extension))
+        {
+#ifdef USE_ASSIMP
+            success = loadAssimp(job, summary, errorMessage);
+#endif
+        }
+        else
+        {
+            success = loadPts(job, summary, errorMessage);
+#ifdef USE_ASSIMP
+            // Unknown extensions fall back to Assimp when they hold no text points
+            if (extension != "pts" && !job->cancelled && (!success || summary.stats.points == 0))
+                success = loadAssimp(job, summary, errorMessage);
+#endif
+        }
+
+        if (success && !job->cancelled && !job->collected.points.isEmpty())
+            deliverDownsampled(job, summary);
+    }
+    catch (const std::exception &e)
+    {
+        success = false;
+        errorMessage = QString::fromLocal8Bit(e.what());
+    }
+
+    if (job->cancelled)
+        return;
+
+    const int jobId = job->id;
+    if (success) {
+        postToOwner(jobId, [this, jobId, summary]() {
+            m_jobs.remove(jobId);
+            emit loadFinished(jobId, summary);
+        });
+    } else {
+        postToOwner(jobId, [this, jobId, errorMessage]() {
+            m_jobs.remove(jobId);
+            emit loadFailed(jobId, errorMessage);
+        });
+    }
+}
+
+void PointCloudLoader::deliverBatch(const QSharedPointer<Job> &job, PointBatch &&batch)
+{
+    if (job->downsampling.isEnabled()) {
+        job->collected.append(batch);
+        return;
+    }
+
+    const int jobId = job->id;
+    postToOwner(jobId, [this, jobId, batch = std::move(batch)]() {
+        emit batchReady(jobId, batch);
+    });
+}
+
+void PointCloudLoader::deliverDownsampled(const QSharedPointer<Job> &job, LoadSummary &summary)
+{
+    // Cells need the whole cloud, so this runs once every batch has been parsed
+    PointBatch batch = VoxelGrid::downsample(job->collected, job->downsampling, &summary.downsampling);
+    job->collected = PointBatch();
+
+    const int jobId = job->id;
+    postToOwner(jobId, [this, jobId, batch = std::move(batch)]() {
+        emit batchReady(jobId, batch);
+    });
+}
+
+bool PointCloudLoader::loadCached(const QSharedPointer<Job> &job, LoadSummary &summary)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    PointCache::Contents contents;
+    if (!PointCache::read(job->filename, contents))
+        return false;
+
+    summary.sourceFormat = contents.sourceFormat;
+    summary.fromCache = true;
+    summary.stats.bytes = contents.bytes;
+    summary.stats.points = contents.points.size();
+    summary.stats.elapsedMs = qMax<qint64>(1, timer.elapsed());
+
+    // The whole cloud goes over as one batch; it is already in memory
+    const int jobId = job->id;
+    deliverBatch(job, std::move(contents.points));
+    postToOwner(jobId, [this, jobId]() {
+        emit progressChanged(jobId, 100);
+    });
+    return true;
+}
+
+void PointCloudLoader::storeInCache(const QString &filename, const QString &sourceFormat, const PointAttributes &points,
+                                    const QVector3D &boundingBoxMin, const QVector3D &boundingBoxMax)
+{
+    m_pool.start([filename, sourceFormat, points, boundingBoxMin, boundingBoxMax]() {
+        QString errorMessage;
+        if (!PointCache::write(filename, sourceFormat, points, boundingBoxMin, boundingBoxMax, &errorMessage))
+            qDebug() << "Could not cache" << filename << errorMessage;
+    });
+}
+
+bool PointCloudLoader::loadOutOfCore(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int jobId = job->id;
+    int lastPercent = -1;
+    auto onProgress = [this, job, jobId, &lastPercent](int percent) {
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            postToOwner(jobId, [this, jobId, percent]() {
+                emit progressChanged(jobId, percent);
+            });
+        }
+        return !job->cancelled;
+    };
+
+    const QString chunkFile = OutOfCoreCloud::chunkFilePath(job->filename);
+    if (!OutOfCoreCloud::isCurrent(job->filename, chunkFile)
+        && !OutOfCoreCloud::build(job->filename, chunkFile, onProgress, &errorMessage))
+        return false;
+
+    summary.sourceFormat = "PTS";
+    summary.chunkFile = chunkFile;
+    summary.stats.bytes = QFileInfo(job->filename).size();
+    summary.stats.elapsedMs = qMax<qint64>(1, timer.elapsed());
+    return true;
+}
+
+bool PointCloudLoader::loadPts(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage)
+{
+    const int jobId = job->id;
+    int lastPercent = -1;
+
+    auto onBatch = [this, job](PointBatch &&batch) {
+        deliverBatch(job, std::move(batch));
+    };
+
+    auto onProgress = [this, job, jobId, &lastPercent](int percent) {
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            postToOwner(jobId, [this, jobId, percent]() {
+                emit progressChanged(jobId, percent);
+            });
+        }
+        return !job->cancelled;
+    };
+
+    summary.sourceFormat = "PTS";
+    return PtsParser::parseFile(job->filename, onBatch, onProgress, &summary.stats, &errorMessage);
+}
+
+bool PointCloudLoader::loadBinary(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage)
+{
+    const int jobId = job->id;
+    int lastPercent = -1;
+
+    auto onProgress = [this, job, jobId, &lastPercent](int percent) {
+        if (percent != lastPercent) {
+            lastPercent = percent;
+            postToOwner(jobId, [this, jobId, percent]() {
+                emit progressChanged(jobId, percent);
+            });
+        }
+        return !job->cancelled;
+    };
+
+    const QString extension = QFileInfo(job->filename).suffix().toLower();
+    PointBatch batch;
+    const bool success = extension == "las"
+        ? LasReader::readFile(job->filename, batch, onProgress, &summary.stats, &errorMessage)
+        : PlyReader::readFile(job->filename, batch, onProgress, &summary.stats, &errorMessage);
+    if (!success)
+        return false;
+
+    // The records are decoded straight into one allocation, so the cloud goes over as a single batch
+    summary.sourceFormat = extension.toUpper();
+    deliverBatch(job, std::move(batch));
+    return true;
+}
+
+#ifdef USE_ASSIMP
+bool PointCloudLoader::loadAssimp(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Assimp::Importer importer;
+    // Node transforms are baked in, so every mesh arrives in scene coordinates
+    unsigned int flags = aiProcess_Triangulate |
+                         aiProcess_JoinIdenticalVertices |
+                         aiProcess_SortByPType |
+                         aiProcess_GenNormals |
+                         aiProcess_PreTransformVertices;
+
+    const int jobId = job->id;
+    postToOwner(jobId, [this, jobId]() { emit progressChanged(jobId, 10); });
+
+    const aiScene* scene = importer.ReadFile(job->filename.toStdString(), flags);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        errorMessage = QString::fromLocal8Bit(importer.GetErrorString());
+        return false;
+    }
+
+    unsigned int totalVertices = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+        totalVertices += scene->mMeshes[i]->mNumVertices;
+    }
+
+    unsigned int processedVertices = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        if (job->cancelled)
+            return false;
+
+        const aiMesh* mesh = scene->mMeshes[i];
+        aiColor4D diffuse(0.8f, 0.8f, 0.8f, 1.0f);
+        QString materialName;
+        if (mesh->mMaterialIndex < scene->mNumMaterials) {
+            const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+            materialName = QString::fromUtf8(material->GetName().C_Str());
+        }
+
+        processedVertices += mesh->mNumVertices;
+        const int percent = 50 + static_cast<int>(50.0 * processedVertices / qMax(1u, totalVertices));
+
+        // Triangulated meshes keep their faces; only meshes of bare vertices become points
+        if (mesh->HasFaces() && (mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE))
+        {
+            MeshPart part;
+            part.materialName = materialName;
+            part.diffuse.r = static_cast<quint8>(qBound(0, qRound(diffuse.r * 255), 255));
+            part.diffuse.g = static_cast<quint8>(qBound(0, qRound(diffuse.g * 255), 255));
+            part.diffuse.b = static_cast<quint8>(qBound(0, qRound(diffuse.b * 255), 255));
+            part.diffuse.a = static_cast<quint8>(qBound(0, qRound(diffuse.a * 255), 255));
+
+            part.vertices.resize(mesh->mNumVertices);
+            for (unsigned int j = 0; j < mesh->mNumVertices; j++)
+                part.vertices[j] = QVector3D(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
+
+            if (mesh->HasNormals()) {
+                part.normals.resize(mesh->mNumVertices);
+                for (unsigned int j = 0; j < mesh->mNumVertices; j++)
+                    part.normals[j] = QVector3D(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z);
+            }
+
+            // SortByPType leaves triangles alone in this mesh; stray lines or points are skipped
+            part.indices.reserve(qsizetype(mesh->mNumFaces) * 3);
+            for (unsigned int j = 0; j < mesh->mNumFaces; j++) {
+                const aiFace& face = mesh->mFaces[j];
+                if (face.mNumIndices == 3)
+                    part.indices.append({ face.mIndices[0], face.mIndices[1], face.mIndices[2] });
+            }
+
+            summary.triangles += part.triangleCount();
+            postToOwner(jobId, [this, jobId, percent, part = std::move(part)]() {
+                emit meshReady(jobId, part);
+                emit progressChanged(jobId, percent);
+            });
+            continue;
+        }
+
+        PointBatch batch;
+        batch.points.reserve(mesh->mNumVertices);
+        batch.colors.reserve(mesh->mNumVertices);
+
+        for (unsigned int j = 0; j < mesh->mNumVertices; j++)
+        {
+            const aiVector3D& pos = mesh->mVertices[j];
+            batch.points.append(QVector3D(pos.x, pos.y, pos.z));
+
+            const aiColor4D& color = mesh->HasVertexColors(0) ? mesh->mColors[0][j] : diffuse;
+            PointColor packed;
+            packed.r = static_cast<quint8>(qBound(0, qRound(color.r * 255), 255));
+            packed.g = static_cast<quint8>(qBound(0, qRound(color.g * 255), 255));
+            packed.b = static_cast<quint8>(qBound(0, qRound(color.b * 255), 255));
+            batch.colors.append(packed);
+        }
+
+        deliverBatch(job, std::move(batch));
+        postToOwner(jobId, [this, jobId, percent]() {
+            emit progressChanged(jobId, percent);
+        });
+    }
+
+    summary.sourceFormat = QFileInfo(job->filename).suffix().toUpper();
+    summary.stats.points = processedVertices;
+    summary.stats.bytes = QFileInfo(job->filename).size();
+    summary.stats.elapsedMs = qMax<qint64>(1, timer.elapsed());
+    return true;
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef POINTCLOUDLOADER_H
+#define POINTCLOUDLOADER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <atomic>
+#include "ptsparser.h"
+#include "voxelgrid.h"
+
+// Reported once a file has been read completely
+struct LoadSummary {
+    QString sourceFormat;
+    PtsParseStats stats;
+    bool fromCache = false;     // Read from the binary cache rather than the file itself
+    bool cacheable = false;     // Later loads of the file would read a cache written for it
+    QString chunkFile;          // Set for out-of-core loads, which deliver no batches
+    qint64 triangles = 0;       // Of the meshes delivered through meshReady()
+    VoxelGrid::Stats downsampling;  // inputPoints is 0 unless the points were downsampled on load
+};
+
+Q_DECLARE_METATYPE(PointBatch)
+Q_DECLARE_METATYPE(MeshPart)
+Q_DECLARE_METATYPE(LoadSummary)
+
+// Reads point cloud files on a background pool and streams them to the GUI
+// thread in batches. All signals are emitted on the thread that owns the loader.
+class PointCloudLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PointCloudLoader(QObject *parent = nullptr);
+    ~PointCloudLoader();
+
+    // Queues a file and returns the id used by the signals below
+    int load(const QString &filename);
+
+    // Queues the conversion of a .pts file into a chunked file for out-of-core
+    // viewing, reusing an earlier conversion while the file is unchanged
+    int loadOutOfCore(const QString &filename);
+
+    // Downsampling applied to the points of every file queued from now on, before
+    // any of them are delivered; out-of-core loads are never downsampled
+    void setDownsampling(const VoxelGrid::Options &options) { m_downsampling = options; }
+    VoxelGrid::Options downsampling() const { return m_downsampling; }
+
+    // Returns immediately; the worker stops at its next batch boundary
+    void cancel(int jobId);
+    void cancelAll();
+
+    bool isLoading(int jobId) const;
+    int activeJobCount() const;
+
+    static bool isAssimpFormat(const QString &extension);
+
+    // Binary PLY and uncompressed LAS, read by the built-in readers with or without Assimp
+    static bool isBinaryFormat(const QString &extension);
+
+    // Writes the binary cache of a loaded file in the background; later loads of the unchanged file read it instead
+    void storeInCache(const QString &filename, const QString &sourceFormat, const PointAttributes &points,
+                      const QVector3D &boundingBoxMin, const QVector3D &boundingBoxMax);
+
+signals:
+    void progressChanged(int jobId, int percent);
+    void batchReady(int jobId, const PointBatch &batch);
+    void meshReady(int jobId, const MeshPart &mesh);
+    void loadFinished(int jobId, const LoadSummary &summary);
+    void loadFailed(int jobId, const QString &errorMessage);
+    void loadCancelled(int jobId);
+
+private:
+    struct Job {
+        int id = 0;
+        QString filename;
+        bool outOfCore = false;
+        std::atomic_bool cancelled { false };
+        VoxelGrid::Options downsampling;
+        PointBatch collected;       // Held back for downsampling instead of being delivered
+    };
+
+    void runJob(const QSharedPointer<Job> &job);
+
+    // Hands a batch to the owner, or keeps it back when the job downsamples
+    void deliverBatch(const QSharedPointer<Job> &job, PointBatch &&batch);
+    void deliverDownsampled(const QSharedPointer<Job> &job, LoadSummary &summary);
+    bool loadCached(const QSharedPointer<Job> &job, LoadSummary &summary);
+    bool loadOutOfCore(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage);
+    bool loadPts(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage);
+    bool loadBinary(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage);
+#ifdef USE_ASSIMP
+    bool loadAssimp(const QSharedPointer<Job> &job, LoadSummary &summary, QString &errorMessage);
+#endif
+
+    // Queues a call onto the loader's thread, dropped if the job was cancelled meanwhile
+    template <typename Function>
+    void postToOwner(int jobId, Function &&function);
+
+    QThreadPool m_pool;
+    QHash<int, QSharedPointer<Job>> m_jobs;
+    int m_nextJobId = 1;
+    VoxelGrid::Options m_downsampling;
+};
+
+#endif // POINTCLOUDLOADER_H
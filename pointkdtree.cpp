@@ -0,0 +1,271 @@
+#include "pointkdtree.h"
+#include "pointstatistics.h"
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+// A pending range of the tree: the node that splits it and its cell
+struct Range {
+    int node = 0;
+    int level = 0;
+    quint32 first = 0;
+    quint32 count = 0;
+    QVector3D boundsMin;
+    QVector3D boundsMax;
+};
+
+// A subtree still to visit and the squared distance from the query to its cell
+struct Pending {
+    int node;
+    int level;
+    quint32 first;
+    quint32 count;
+    float distanceSquared;
+};
+
+} // namespace
+
+struct PointKdTree::Builder
+{
+    struct Entry {
+        QVector3D position;
+        quint32 index;
+    };
+
+    PointKdTree &tree;
+    std::vector<Entry> entries;
+
+    void split(const Range &range, Range &left, Range &right);
+    void buildSubtree(const Range &range);
+};
+
+void PointKdTree::Builder::split(const Range &range, Range &left, Range &right)
+{
+    const QVector3D extent = range.boundsMax - range.boundsMin;
+    int axis = extent.y() > extent.x() ? 1 : 0;
+    if (extent.z() > extent[axis])
+        axis = 2;
+
+    // The lower half takes the floor of the count, so sizes follow from the count alone
+    const quint32 half = range.count / 2;
+    const auto begin = entries.begin() + range.first;
+    std::nth_element(begin, begin + half, begin + range.count, [axis](const Entry &a, const Entry &b) {
+        return a.position[axis] < b.position[axis];
+    });
+
+    const float splitValue = entries[range.first + half].position[axis];
+    tree.m_nodes[range.node] = { splitValue, axis };
+
+    left = range;
+    left.node = 2 * range.node + 1;
+    left.level = range.level + 1;
+    left.count = half;
+    left.boundsMax[axis] = splitValue;
+
+    right = range;
+    right.node = 2 * range.node + 2;
+    right.level = range.level + 1;
+    right.first = range.first + half;
+    right.count = range.count - half;
+    right.boundsMin[axis] = splitValue;
+}
+
+void PointKdTree::Builder::buildSubtree(const Range &range)
+{
+    if (range.level >= tree.m_depth)
+        return;
+
+    Range left;
+    Range right;
+    split(range, left, right);
+    buildSubtree(left);
+    buildSubtree(right);
+}
+
+PointKdTree PointKdTree::build(const QVector<QVector3D> &points)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    PointKdTree tree;
+    const quint32 pointCount = quint32(points.size());
+    if (pointCount == 0)
+        return tree;
+
+    // Deep enough that the largest range at the bottom fits in a leaf
+    while ((qint64(pointCount) + (qint64(1) << tree.m_depth) - 1) >> tree.m_depth > LeafCapacity)
+        ++tree.m_depth;
+    tree.m_nodes.resize((1 << tree.m_depth) - 1);
+
+    Builder builder { tree, std::vector<Builder::Entry>(pointCount) };
+    Range root;
+    root.count = pointCount;
+    root.boundsMin = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    root.boundsMax = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    for (quint32 i = 0; i < pointCount; ++i)
+        builder.entries[i] = { points[i], i };
+    PointStatistics::growBounds(points.constData(), pointCount, root.boundsMin, root.boundsMax);
+
+    // The top levels split all their ranges at once, one worker per range, until
+    // there are enough independent subtrees to keep the pool busy on their own
+    const int enoughSubtrees = 4 * QThreadPool::globalInstance()->maxThreadCount();
+    QVector<Range> level = { root };
+    while (level.size() < enoughSubtrees && level.first().level < tree.m_depth && level.first().count > ParallelGrain) {
+        QVector<Range> next(level.size() * 2);
+        QVector<int> slots(level.size());
+        std::iota(slots.begin(), slots.end(), 0);
+        QtConcurrent::blockingMap(slots, [&builder, &level, &next](int slot) {
+            builder.split(level[slot], next[2 * slot], next[2 * slot + 1]);
+        });
+        level = std::move(next);
+    }
+
+    QtConcurrent::blockingMap(level, [&builder](const Range &range) {
+        builder.buildSubtree(range);
+    });
+
+    tree.m_points.resize(pointCount);
+    tree.m_indices.resize(pointCount);
+    QVector3D *positionsOut = tree.m_points.data();
+    quint32 *indicesOut = tree.m_indices.data();
+    for (quint32 i = 0; i < pointCount; ++i) {
+        positionsOut[i] = builder.entries[i].position;
+        indicesOut[i] = builder.entries[i].index;
+    }
+
+    tree.m_buildTimeMs = qMax<qint64>(1, timer.elapsed());
+    return tree;
+}
+
+template <typename Bound, typename Visit>
+void PointKdTree::search(const QVector3D &query, Bound &&bound, Visit &&visit) const
+{
+    if (m_points.isEmpty())
+        return;
+
+    // One pending sibling per level at most, plus the subtree being descended into
+    Pending stack[64];
+    int top = 0;
+    stack[top++] = { 0, 0, 0, quint32(m_points.size()), 0.0f };
+
+    while (top > 0) {
+        const Pending pending = stack[--top];
+        if (pending.distanceSquared > bound())
+            continue;
+
+        if (pending.level >= m_depth) {
+            const QVector3D *points = m_points.constData();
+            for (quint32 i = pending.first; i < pending.first + pending.count; ++i)
+                visit(i, (points[i] - query).lengthSquared());
+            continue;
+        }
+
+        const Node &node = m_nodes[pending.node];
+        const float offset = query[node.axis] - node.split;
+        const quint32 half = pending.count / 2;
+        const Pending left { 2 * pending.node + 1, pending.level + 1, pending.first, half, pending.distanceSquared };
+        const Pending right { 2 * pending.node + 2, pending.level + 1, pending.first + half, pending.count - half, pending.distanceSquared };
+
+        // The far side is at least the distance to the splitting plane away
+        Pending nearSide = offset < 0.0f ? left : right;
+        Pending farSide = offset < 0.0f ? right : left;
+        farSide.distanceSquared = qMax(farSide.distanceSquared, offset * offset);
+
+        stack[top++] = farSide;
+        stack[top++] = nearSide;
+    }
+}
+
+QVector<PointKdTree::Neighbour> PointKdTree::nearest(const QVector3D &query, int k) const
+{
+    QVector<Neighbour> heap;
+    nearest(query, k, heap);
+    return heap;
+}
+
+void PointKdTree::nearest(const QVector3D &query, int k, QVector<Neighbour> &heap) const
+{
+    heap.clear();
+    if (k <= 0)
+        return;
+    heap.reserve(qMin<qsizetype>(k, m_points.size()));
+
+    // A max-heap on distance holding the best k so far
+    auto farther = [](const Neighbour &a, const Neighbour &b) { return a.distanceSquared < b.distanceSquared; };
+    auto bound = [&heap, k]() {
+        return heap.size() < k ? std::numeric_limits<float>::max() : heap.first().distanceSquared;
+    };
+
+    search(query, bound, [&](quint32 i, float distanceSquared) {
+        if (heap.size() < k) {
+            heap.append({ m_indices[i], distanceSquared });
+            std::push_heap(heap.begin(), heap.end(), farther);
+        } else if (distanceSquared < heap.first().distanceSquared) {
+            std::pop_heap(heap.begin(), heap.end(), farther);
+            heap.last() = { m_indices[i], distanceSquared };
+            std::push_heap(heap.begin(), heap.end(), farther);
+        }
+    });
+
+    std::sort_heap(heap.begin(), heap.end(), farther);
+}
+
+QVector<PointKdTree::Neighbour> PointKdTree::withinRadius(const QVector3D &query, float radius) const
+{
+    QVector<Neighbour> found;
+    const float radiusSquared = radius * radius;
+
+    search(query, [radiusSquared]() { return radiusSquared; }, [&](quint32 i, float distanceSquared) {
+        if (distanceSquared <= radiusSquared)
+            found.append({ m_indices[i], distanceSquared });
+    });
+    return found;
+}
+
+QVector<quint32> PointKdTree::insideBox(const QVector3D &boxMin, const QVector3D &boxMax) const
+{
+    QVector<quint32> found;
+    if (m_points.isEmpty())
+        return found;
+
+    Pending stack[64];
+    int top = 0;
+    stack[top++] = { 0, 0, 0, quint32(m_points.size()), 0.0f };
+
+    while (top > 0) {
+        const Pending pending = stack[--top];
+
+        if (pending.level >= m_depth) {
+            for (quint32 i = pending.first; i < pending.first + pending.count; ++i) {
+                const QVector3D &point = m_points[i];
+                if (point.x() >= boxMin.x() && point.x() <= boxMax.x() &&
+                    point.y() >= boxMin.y() && point.y() <= boxMax.y() &&
+                    point.z() >= boxMin.z() && point.z() <= boxMax.z())
+                    found.append(m_indices[i]);
+            }
+            continue;
+        }
+
+        // Points equal to the split value can fall on either side
+        const Node &node = m_nodes[pending.node];
+        const quint32 half = pending.count / 2;
+        if (boxMax[node.axis] >= node.split)
+            stack[top++] = { 2 * pending.node + 2, pending.level + 1, pending.first + half, pending.count - half, 0.0f };
+        if (boxMin[node.axis] <= node.split)
+            stack[top++] = { 2 * pending.node + 1, pending.level + 1, pending.first, half, 0.0f };
+    }
+    return found;
+}
+
+qint64 PointKdTree::memoryUsage() const
+{
+    return static_cast<qint64>(m_points.capacity()) * sizeof(QVector3D)
+         + static_cast<qint64>(m_indices.capacity()) * sizeof(quint32)
+         + static_cast<qint64>(m_nodes.capacity()) * sizeof(Node);
+}
@@ -0,0 +1,70 @@
+#ifndef POINTKDTREE_H
+#define POINTKDTREE_H
+
+#include <QVector>
+#include <QVector3D>
+
+// Balanced k-d tree over the positions of one cloud for nearest-neighbour,
+// radius and box queries. Nodes split their range at the median along its
+// widest axis, so the shape depends on the point count alone and the nodes
+// sit in an implicit heap layout with no child links. The positions are kept
+// in tree order next to their source indices, making every leaf a contiguous
+// run scanned straight through.
+class PointKdTree
+{
+public:
+    struct Neighbour {
+        quint32 index;              // Into the arrays the tree was built from
+        float distanceSquared;
+    };
+
+    // Subtrees below this size are built by a single worker
+    static constexpr quint32 ParallelGrain = 1 << 16;
+
+    // Ranges of at most this many points become leaves
+    static constexpr quint32 LeafCapacity = 32;
+
+    // Splits the positions recursively, fanning subtrees out to the global thread pool
+    static PointKdTree build(const QVector<QVector3D> &points);
+
+    bool isEmpty() const { return m_points.isEmpty(); }
+    qsizetype size() const { return m_points.size(); }
+    int depth() const { return m_depth; }
+
+    // The k nearest points, closest first; fewer when the cloud is smaller
+    QVector<Neighbour> nearest(const QVector3D &query, int k) const;
+
+    // As above, but into a caller's array so batches of queries allocate once
+    void nearest(const QVector3D &query, int k, QVector<Neighbour> &heap) const;
+
+    // Every point no further than radius from the query, in no particular order
+    QVector<Neighbour> withinRadius(const QVector3D &query, float radius) const;
+
+    // Indices of the points inside the closed box
+    QVector<quint32> insideBox(const QVector3D &boxMin, const QVector3D &boxMax) const;
+
+    // Host memory held by the tree, including reserved capacity
+    qint64 memoryUsage() const;
+    qint64 buildTimeMs() const { return m_buildTimeMs; }
+
+private:
+    struct Node {
+        float split = 0.0f;
+        int axis = 0;
+    };
+
+    struct Builder;
+
+    // Walks the tree depth first, nearer child first, skipping subtrees whose
+    // cell lies further from the query than bound() allows at that moment
+    template <typename Bound, typename Visit>
+    void search(const QVector3D &query, Bound &&bound, Visit &&visit) const;
+
+    QVector<QVector3D> m_points;    // In tree order
+    QVector<quint32> m_indices;     // Source index of each point in tree order
+    QVector<Node> m_nodes;          // Node i has children 2i + 1 and 2i + 2
+    int m_depth = 0;                // Levels of inner nodes; leaves lie below the last
+    qint64 m_buildTimeMs = 0;
+};
+
+#endif // POINTKDTREE_H
@@ -0,0 +1,121 @@
+#include "pointoctree.h"
+#include "pointstatistics.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+struct PointOctree::Builder
+{
+    const QVector<QVector3D> &points;
+    QVector<quint32> &order;
+    PointOctree &tree;
+
+    // Scratch space reused by every node
+    std::vector<quint8> takenCells = std::vector<quint8>(SampleGrid * SampleGrid * SampleGrid);
+    std::vector<quint32> scratch;
+
+    int buildNode(quint32 begin, quint32 end, const QVector3D &boundsMin, float size, int depth);
+};
+
+int PointOctree::Builder::buildNode(quint32 begin, quint32 end, const QVector3D &boundsMin, float size, int depth)
+{
+    const int nodeIndex = tree.m_nodes.size();
+    tree.m_nodes.append(Node());
+    tree.m_depth = qMax(tree.m_depth, depth);
+
+    Node node;
+    node.boundsMin = boundsMin;
+    node.boundsMax = boundsMin + QVector3D(size, size, size);
+    node.first = begin;
+    node.subtreeCount = end - begin;
+    node.depth = depth;
+
+    if (end - begin <= LeafCapacity || depth >= MaxDepth || size <= 0.0f) {
+        node.count = end - begin;
+        tree.m_nodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    // Keep the first point falling into each cell of a coarse grid; these move
+    // to the front of the range and become the node's own subsample
+    std::fill(takenCells.begin(), takenCells.end(), 0);
+    const float cellScale = SampleGrid / size;
+    quint32 owned = begin;
+    for (quint32 i = begin; i < end; ++i) {
+        const QVector3D local = (points[order[i]] - boundsMin) * cellScale;
+        const int cx = qBound(0, int(local.x()), SampleGrid - 1);
+        const int cy = qBound(0, int(local.y()), SampleGrid - 1);
+        const int cz = qBound(0, int(local.z()), SampleGrid - 1);
+        quint8 &taken = takenCells[(cz * SampleGrid + cy) * SampleGrid + cx];
+        if (!taken) {
+            taken = 1;
+            std::swap(order[owned++], order[i]);
+        }
+    }
+    node.count = owned - begin;
+
+    // Distribute the remaining points over the octants with a counting sort
+    const float half = size * 0.5f;
+    const QVector3D center = boundsMin + QVector3D(half, half, half);
+    auto octantOf = [&](quint32 index) {
+        const QVector3D &p = points[index];
+        return (p.x() >= center.x() ? 1 : 0) | (p.y() >= center.y() ? 2 : 0) | (p.z() >= center.z() ? 4 : 0);
+    };
+
+    std::array<quint32, 9> offsets {};
+    for (quint32 i = owned; i < end; ++i)
+        ++offsets[octantOf(order[i]) + 1];
+    for (int octant = 0; octant < 8; ++octant)
+        offsets[octant + 1] += offsets[octant];
+
+    scratch.resize(end - owned);
+    std::array<quint32, 8> cursor;
+    std::copy(offsets.begin(), offsets.begin() + 8, cursor.begin());
+    for (quint32 i = owned; i < end; ++i) {
+        const quint32 index = order[i];
+        scratch[cursor[octantOf(index)]++] = index;
+    }
+    std::copy(scratch.begin(), scratch.end(), order.begin() + owned);
+
+    for (int octant = 0; octant < 8; ++octant) {
+        const quint32 childBegin = owned + offsets[octant];
+        const quint32 childEnd = owned + offsets[octant + 1];
+        if (childBegin == childEnd)
+            continue;
+
+        const QVector3D childMin(octant & 1 ? center.x() : boundsMin.x(),
+                                 octant & 2 ? center.y() : boundsMin.y(),
+                                 octant & 4 ? center.z() : boundsMin.z());
+        node.children[octant] = buildNode(childBegin, childEnd, childMin, half, depth + 1);
+    }
+
+    tree.m_nodes[nodeIndex] = node;
+    return nodeIndex;
+}
+
+PointOctree PointOctree::build(const QVector<QVector3D> &points, QVector<quint32> &order)
+{
+    PointOctree tree;
+
+    const quint32 pointCount = quint32(points.size());
+    order.resize(pointCount);
+    for (quint32 i = 0; i < pointCount; ++i)
+        order[i] = i;
+
+    if (pointCount == 0)
+        return tree;
+
+    QVector3D boundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    QVector3D boundsMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    PointStatistics::growBounds(points.constData(), points.size(), boundsMin, boundsMax);
+
+    // Cubic nodes keep the sampling grid equally fine along every axis
+    const QVector3D extent = boundsMax - boundsMin;
+    const float size = qMax(qMax(extent.x(), extent.y()), extent.z());
+
+    tree.m_nodes.reserve(int(pointCount / LeafCapacity) * 2 + 1);
+    Builder builder { points, order, tree };
+    builder.buildNode(0, pointCount, boundsMin, size, 0);
+    return tree;
+}
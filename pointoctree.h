@@ -0,0 +1,51 @@
+#ifndef POINTOCTREE_H
+#define POINTOCTREE_H
+
+#include <QVector>
+#include <QVector3D>
+
+// Level-of-detail hierarchy over the points of one cloud. Every node owns an
+// evenly spread subsample of the points inside it and its children hold the
+// rest, so drawing a node together with its ancestors gives a progressively
+// denser picture of that region. Points are expected in octree order: the
+// points a node owns, and the whole subtree below it, are contiguous ranges.
+class PointOctree
+{
+public:
+    struct Node {
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        quint32 first = 0;          // First point owned by this node
+        quint32 count = 0;          // Points owned by this node
+        quint32 subtreeCount = 0;   // Points owned by this node and its descendants
+        qint32 children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+        int depth = 0;
+
+        QVector3D center() const { return (boundsMin + boundsMax) * 0.5f; }
+    };
+
+    // Cells per axis of the grid an inner node picks its subsample on
+    static constexpr int SampleGrid = 16;
+
+    // Nodes with at most this many points are not split any further
+    static constexpr quint32 LeafCapacity = 8192;
+    static constexpr int MaxDepth = 16;
+
+    // Builds the hierarchy over the given positions. order receives, for each
+    // point in octree order, its index in the source arrays.
+    static PointOctree build(const QVector<QVector3D> &points, QVector<quint32> &order);
+
+    bool isEmpty() const { return m_nodes.isEmpty(); }
+    const QVector<Node> &nodes() const { return m_nodes; }
+    const Node &root() const { return m_nodes.first(); }
+
+    int depth() const { return m_depth; }
+
+private:
+    struct Builder;
+
+    QVector<Node> m_nodes;
+    int m_depth = 0;
+};
+
+#endif // POINTOCTREE_H
@@ -0,0 +1,505 @@
+#include "pointselection.h"
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+using Words = std::array<quint64, PointSelection::ContainerWords>;
+
+qsizetype containerCount(qsizetype size)
+{
+    return (size + PointSelection::ContainerPoints - 1) >> PointSelection::ContainerBits;
+}
+
+// Runs a function for every container index on the global pool; each call owns its container
+template <typename Function>
+void forEachContainer(qsizetype count, Function &&function)
+{
+    QVector<qsizetype> indices(count);
+    std::iota(indices.begin(), indices.end(), qsizetype(0));
+    QtConcurrent::blockingMap(indices, [&function](qsizetype index) {
+        function(index);
+    });
+}
+
+// Clears the bits at and past span
+void clearTail(quint64 *words, int span)
+{
+    const int fullWords = span / 64;
+    if (span % 64)
+        words[fullWords] &= (quint64(1) << (span % 64)) - 1;
+    const int firstCleared = (span + 63) / 64;
+    std::fill(words + firstCleared, words + PointSelection::ContainerWords, quint64(0));
+}
+
+} // namespace
+
+PointSelection::PointSelection(qsizetype size)
+    : m_containers(containerCount(size))
+    , m_size(size)
+{
+}
+
+int PointSelection::span(qsizetype container) const
+{
+    return int(qMin(ContainerPoints, m_size - (container << ContainerBits)));
+}
+
+void PointSelection::toWords(const Container &container, int span, quint64 *words)
+{
+    switch (container.kind) {
+    case Container::Empty:
+        std::fill(words, words + ContainerWords, quint64(0));
+        break;
+    case Container::Full:
+        std::fill(words, words + ContainerWords, ~quint64(0));
+        clearTail(words, span);
+        break;
+    case Container::Array:
+        std::fill(words, words + ContainerWords, quint64(0));
+        for (quint16 offset : container.values)
+            words[offset >> 6] |= quint64(1) << (offset & 63);
+        break;
+    case Container::Bitmap:
+        std::copy(container.bits.constBegin(), container.bits.constEnd(), words);
+        break;
+    }
+}
+
+PointSelection::Container PointSelection::fromWords(const quint64 *words, int span)
+{
+    Container container;
+    const int usedWords = (span + 63) / 64;
+    for (int i = 0; i < usedWords; ++i)
+        container.cardinality += quint32(std::bitset<64>(words[i]).count());
+
+    if (container.cardinality == 0) {
+        container.kind = Container::Empty;
+    } else if (container.cardinality == quint32(span)) {
+        container.kind = Container::Full;
+    } else if (container.cardinality <= quint32(MaxArrayValues)) {
+        container.kind = Container::Array;
+        container.values.reserve(container.cardinality);
+        for (int i = 0; i < usedWords; ++i) {
+            for (quint64 word = words[i]; word; word &= word - 1)
+                container.values.append(quint16(i * 64 + qCountTrailingZeroBits(word)));
+        }
+    } else {
+        container.kind = Container::Bitmap;
+        container.bits = QVector<quint64>(words, words + ContainerWords);
+    }
+    return container;
+}
+
+template <typename Visit>
+void PointSelection::forEachSelected(const Container &container, int span, Visit &&visit)
+{
+    switch (container.kind) {
+    case Container::Empty:
+        break;
+    case Container::Full:
+        for (int offset = 0; offset < span; ++offset)
+            visit(offset);
+        break;
+    case Container::Array:
+        for (quint16 offset : container.values)
+            visit(int(offset));
+        break;
+    case Container::Bitmap:
+        for (int i = 0; i < ContainerWords; ++i) {
+            for (quint64 word = container.bits[i]; word; word &= word - 1)
+                visit(i * 64 + qCountTrailingZeroBits(word));
+        }
+        break;
+    }
+}
+
+qsizetype PointSelection::count() const
+{
+    qsizetype total = 0;
+    for (const Container &container : m_containers)
+        total += container.cardinality;
+    return total;
+}
+
+bool PointSelection::contains(qsizetype point) const
+{
+    if (point < 0 || point >= m_size)
+        return false;
+
+    const Container &container = m_containers[point >> ContainerBits];
+    const int offset = int(point & (ContainerPoints - 1));
+    switch (container.kind) {
+    case Container::Empty:
+        return false;
+    case Container::Full:
+        return true;
+    case Container::Array:
+        return std::binary_search(container.values.constBegin(), container.values.constEnd(), quint16(offset));
+    case Container::Bitmap:
+        return (container.bits[offset >> 6] >> (offset & 63)) & 1;
+    }
+    return false;
+}
+
+void PointSelection::set(qsizetype point, bool selected)
+{
+    if (point >= m_size)
+        resize(point + 1);
+
+    const qsizetype index = point >> ContainerBits;
+    const int offset = int(point & (ContainerPoints - 1));
+    Words words;
+    toWords(m_containers[index], span(index), words.data());
+    if (selected)
+        words[offset >> 6] |= quint64(1) << (offset & 63);
+    else
+        words[offset >> 6] &= ~(quint64(1) << (offset & 63));
+    m_containers[index] = fromWords(words.data(), span(index));
+}
+
+void PointSelection::resize(qsizetype size)
+{
+    // The one container kept under both sizes whose span changes is the last of
+    // the shorter; it is unpacked under its old span and repacked under the new
+    const qsizetype boundary = qMin(m_containers.size(), containerCount(size)) - 1;
+    Words words;
+    if (boundary >= 0)
+        toWords(m_containers[boundary], span(boundary), words.data());
+
+    m_size = size;
+    m_containers.resize(containerCount(size));
+
+    if (boundary >= 0) {
+        clearTail(words.data(), span(boundary));
+        m_containers[boundary] = fromWords(words.data(), span(boundary));
+    }
+}
+
+void PointSelection::combine(const PointSelection &other, Combine mode)
+{
+    if (mode == Combine::Replace) {
+        *this = other;
+        return;
+    }
+
+    if (other.m_size > m_size)
+        resize(other.m_size);
+
+    Container *containers = m_containers.data();
+    const Container none;
+
+    forEachContainer(m_containers.size(), [&](qsizetype i) {
+        Container &a = containers[i];
+        const bool inOther = i < other.m_containers.size();
+        const Container &b = inOther ? other.m_containers[i] : none;
+        const int spanA = span(i);
+        const int spanB = inOther ? other.span(i) : 0;
+
+        // Empty and full containers settle most of a large selection without unpacking
+        if (b.kind == Container::Empty) {
+            if (mode == Combine::Intersect)
+                a = Container();
+            return;
+        }
+        if (a.kind == Container::Empty && mode != Combine::Add)
+            return;
+        if (spanA == spanB) {
+            if (a.kind == Container::Empty) {
+                a = b;
+                return;
+            }
+            if (b.kind == Container::Full) {
+                if (mode == Combine::Add)
+                    a = b;
+                else if (mode == Combine::Subtract)
+                    a = Container();
+                return;
+            }
+        }
+
+        Words wordsA;
+        Words wordsB;
+        toWords(a, spanA, wordsA.data());
+        toWords(b, spanB, wordsB.data());
+        for (int w = 0; w < ContainerWords; ++w) {
+            switch (mode) {
+            case Combine::Add:
+                wordsA[w] |= wordsB[w];
+                break;
+            case Combine::Intersect:
+                wordsA[w] &= wordsB[w];
+                break;
+            case Combine::Subtract:
+                wordsA[w] &= ~wordsB[w];
+                break;
+            case Combine::Replace:
+                break;
+            }
+        }
+        a = fromWords(wordsA.data(), spanA);
+    });
+}
+
+void PointSelection::invert()
+{
+    Container *containers = m_containers.data();
+
+    forEachContainer(m_containers.size(), [&](qsizetype i) {
+        Container &container = containers[i];
+        const int containerSpan = span(i);
+        if (container.kind == Container::Empty) {
+            container.kind = Container::Full;
+            container.cardinality = quint32(containerSpan);
+        } else if (container.kind == Container::Full) {
+            container = Container();
+        } else {
+            Words words;
+            toWords(container, containerSpan, words.data());
+            for (quint64 &word : words)
+                word = ~word;
+            clearTail(words.data(), containerSpan);
+            container = fromWords(words.data(), containerSpan);
+        }
+    });
+}
+
+PointSelection PointSelection::reordered(const QVector<quint32> &order) const
+{
+    PointSelection result(order.size());
+    if (isEmpty())
+        return result;
+
+    // Gathering from a flat bitmap keeps each lookup to one load
+    QVector<quint64> flat(m_containers.size() * ContainerWords);
+    quint64 *flatWords = flat.data();
+    forEachContainer(m_containers.size(), [&](qsizetype i) {
+        toWords(m_containers[i], span(i), flatWords + i * ContainerWords);
+    });
+
+    Container *containers = result.m_containers.data();
+    forEachContainer(result.m_containers.size(), [&](qsizetype i) {
+        Words words {};
+        const qsizetype first = i << ContainerBits;
+        const int containerSpan = result.span(i);
+        for (int offset = 0; offset < containerSpan; ++offset) {
+            const quint32 source = order[first + offset];
+            if (source < m_size && (flatWords[source >> 6] >> (source & 63)) & 1)
+                words[offset >> 6] |= quint64(1) << (offset & 63);
+        }
+        containers[i] = fromWords(words.data(), containerSpan);
+    });
+    return result;
+}
+
+PointAttributes PointSelection::extract(const PointAttributes &source) const
+{
+    // Flags past the end of the source would throw the output offsets off
+    if (m_size != source.size()) {
+        PointSelection clipped = *this;
+        clipped.resize(source.size());
+        return clipped.extract(source);
+    }
+
+    // Each container writes its points at the running total of those before it
+    QVector<qsizetype> offsets(m_containers.size() + 1, 0);
+    for (qsizetype i = 0; i < m_containers.size(); ++i)
+        offsets[i + 1] = offsets[i] + m_containers[i].cardinality;
+
+    const qsizetype total = offsets.last();
+    const bool hasColors = source.colors.size() == source.size();
+    const bool hasIntensities = source.intensities.size() == source.size();
+
+    PointAttributes result;
+    result.points.resize(total);
+    if (hasColors)
+        result.colors.resize(total);
+    if (hasIntensities)
+        result.intensities.resize(total);
+
+    QVector3D *pointsOut = result.points.data();
+    PointColor *colorsOut = hasColors ? result.colors.data() : nullptr;
+    float *intensitiesOut = hasIntensities ? result.intensities.data() : nullptr;
+
+    forEachContainer(m_containers.size(), [&](qsizetype i) {
+        const qsizetype base = i << ContainerBits;
+        qsizetype out = offsets[i];
+        forEachSelected(m_containers[i], span(i), [&](int offset) {
+            const qsizetype in = base + offset;
+            pointsOut[out] = source.points[in];
+            if (colorsOut)
+                colorsOut[out] = source.colors[in];
+            if (intensitiesOut)
+                intensitiesOut[out] = source.intensities[in];
+            ++out;
+        });
+    });
+    return result;
+}
+
+void PointSelection::expand(qsizetype first, qsizetype end, char *out) const
+{
+    std::memset(out, 0, size_t(end - first));
+    end = qMin(end, m_size);
+
+    for (qsizetype point = first; point < end;) {
+        const qsizetype index = point >> ContainerBits;
+        const qsizetype base = index << ContainerBits;
+        const qsizetype containerEnd = qMin(end, base + ContainerPoints);
+        const Container &container = m_containers[index];
+
+        if (container.kind == Container::Full) {
+            std::memset(out + (point - first), 0xFF, size_t(containerEnd - point));
+        } else if (container.kind != Container::Empty) {
+            const qsizetype low = point - base;
+            const qsizetype high = containerEnd - base;
+            forEachSelected(container, span(index), [&](int offset) {
+                if (offset >= low && offset < high)
+                    out[base + offset - first] = char(0xFF);
+            });
+        }
+        point = containerEnd;
+    }
+}
+
+void PointSelection::difference(const PointSelection &a, const PointSelection &b, qsizetype &first, qsizetype &count)
+{
+    const qsizetype containers = qMax(a.m_containers.size(), b.m_containers.size());
+    const Container none;
+
+    auto containerOf = [&none](const PointSelection &selection, qsizetype i) -> const Container & {
+        return i < selection.m_containers.size() ? selection.m_containers[i] : none;
+    };
+    auto spanOf = [](const PointSelection &selection, qsizetype i) {
+        return i < selection.m_containers.size() ? selection.span(i) : 0;
+    };
+    auto same = [&](qsizetype i) {
+        const Container &x = containerOf(a, i);
+        const Container &y = containerOf(b, i);
+        if (x.kind != y.kind || x.cardinality != y.cardinality)
+            return false;
+        switch (x.kind) {
+        case Container::Empty:
+            return true;
+        case Container::Full:
+            return spanOf(a, i) == spanOf(b, i);
+        case Container::Array:
+            return x.values == y.values;
+        case Container::Bitmap:
+            return x.bits == y.bits;
+        }
+        return false;
+    };
+
+    // Differing containers are unpacked to narrow the range down to words
+    auto differingWords = [&](qsizetype i, int &firstWord, int &lastWord) {
+        Words x;
+        Words y;
+        toWords(containerOf(a, i), spanOf(a, i), x.data());
+        toWords(containerOf(b, i), spanOf(b, i), y.data());
+        firstWord = 0;
+        while (firstWord < ContainerWords - 1 && x[firstWord] == y[firstWord])
+            ++firstWord;
+        lastWord = ContainerWords - 1;
+        while (lastWord > firstWord && x[lastWord] == y[lastWord])
+            --lastWord;
+    };
+
+    qsizetype begin = 0;
+    while (begin < containers && same(begin))
+        ++begin;
+    if (begin == containers) {
+        first = 0;
+        count = 0;
+        return;
+    }
+
+    qsizetype last = containers - 1;
+    while (last > begin && same(last))
+        --last;
+
+    int firstWord = 0;
+    int lastWord = 0;
+    int unused = 0;
+    differingWords(begin, firstWord, lastWord);
+    if (last != begin)
+        differingWords(last, unused, lastWord);
+
+    first = (begin << ContainerBits) + firstWord * 64;
+    count = (last << ContainerBits) + (lastWord + 1) * 64 - first;
+}
+
+PointSelection PointSelection::inRegion(const QVector<QVector3D> &points, const QMatrix4x4 &modelViewProjection, const QImage &mask)
+{
+    PointSelection result(points.size());
+    if (points.isEmpty() || mask.isNull())
+        return result;
+
+    // Only the x, y and w rows of the matrix are needed; constData() is column-major
+    const float *m = modelViewProjection.constData();
+    const float width = float(mask.width());
+    const float height = float(mask.height());
+    const uchar *pixels = mask.constBits();
+    const qsizetype bytesPerLine = mask.bytesPerLine();
+    const QVector3D *positions = points.constData();
+    Container *containers = result.m_containers.data();
+
+    forEachContainer(result.m_containers.size(), [&](qsizetype index) {
+        Words words {};
+        const qsizetype base = index << ContainerBits;
+        const int containerSpan = result.span(index);
+
+        for (int offset = 0; offset < containerSpan; ++offset) {
+            const QVector3D &p = positions[base + offset];
+            const float w = m[3] * p.x() + m[7] * p.y() + m[11] * p.z() + m[15];
+            if (w <= 0.0f)
+                continue;
+
+            const float x = (m[0] * p.x() + m[4] * p.y() + m[8] * p.z() + m[12]) / w;
+            const float y = (m[1] * p.x() + m[5] * p.y() + m[9] * p.z() + m[13]) / w;
+            const float column = (x + 1.0f) * 0.5f * width;
+            const float row = (1.0f - y) * 0.5f * height;
+            if (column < 0.0f || row < 0.0f || column >= width || row >= height)
+                continue;
+
+            if (pixels[qsizetype(row) * bytesPerLine + qsizetype(column)])
+                words[offset >> 6] |= quint64(1) << (offset & 63);
+        }
+
+        containers[index] = fromWords(words.data(), containerSpan);
+    });
+
+    return result;
+}
+
+PointSelection PointSelection::fromFlags(const char *flags, qsizetype size)
+{
+    PointSelection result(size);
+    Container *containers = result.m_containers.data();
+
+    forEachContainer(result.m_containers.size(), [&](qsizetype index) {
+        Words words {};
+        const char *containerFlags = flags + (index << ContainerBits);
+        const int containerSpan = result.span(index);
+        for (int offset = 0; offset < containerSpan; ++offset) {
+            if (containerFlags[offset])
+                words[offset >> 6] |= quint64(1) << (offset & 63);
+        }
+        containers[index] = fromWords(words.data(), containerSpan);
+    });
+
+    return result;
+}
+
+qint64 PointSelection::memoryUsage() const
+{
+    qint64 bytes = qint64(m_containers.capacity()) * qint64(sizeof(Container));
+    for (const Container &container : m_containers)
+        bytes += qint64(container.values.capacity()) * qint64(sizeof(quint16))
+               + qint64(container.bits.capacity()) * qint64(sizeof(quint64));
+    return bytes;
+}
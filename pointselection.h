@@ -0,0 +1,103 @@
+#ifndef POINTSELECTION_H
+#define POINTSELECTION_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QImage>
+#include "pointcloud.h"
+
+// One flag per point of a cloud, compressed in the manner of roaring bitmaps:
+// the points are split into containers of 65536, each stored as nothing when
+// none is selected or all are, as a sorted list of offsets when few are, and
+// as a plain bitmap otherwise. Large sparse or dense selections therefore cost
+// little more than their boundaries. Points past size() count as unselected.
+// Whole-selection operations run container by container on the global thread pool.
+class PointSelection
+{
+public:
+    enum class Combine {
+        Replace,
+        Add,
+        Intersect,
+        Subtract
+    };
+
+    PointSelection() = default;
+    explicit PointSelection(qsizetype size);
+
+    qsizetype size() const { return m_size; }
+    qsizetype count() const;
+    bool isEmpty() const { return count() == 0; }
+    bool contains(qsizetype point) const;
+
+    void set(qsizetype point, bool selected);
+    void resize(qsizetype size);
+
+    // Applies another selection over the same points to this one
+    void combine(const PointSelection &other, Combine mode);
+
+    // Selects exactly the points that were not selected
+    void invert();
+
+    // Returns a copy holding the flag of point order[i] in place i
+    PointSelection reordered(const QVector<quint32> &order) const;
+
+    // Copies the selected points, in order, into new arrays sized up front
+    PointAttributes extract(const PointAttributes &source) const;
+
+    // Writes 0xFF for each selected and 0 for each unselected point in [first, end)
+    void expand(qsizetype first, qsizetype end, char *out) const;
+
+    // The range of points whose flags differ between two selections, as
+    // [first, first + count), widened to whole words; count is 0 when equal
+    static void difference(const PointSelection &a, const PointSelection &b, qsizetype &first, qsizetype &count);
+
+    // Selects the points whose projection lands on a non-zero pixel of an
+    // 8-bit mask the size of the viewport, evaluated in parallel chunks
+    static PointSelection inRegion(const QVector<QVector3D> &points, const QMatrix4x4 &modelViewProjection, const QImage &mask);
+
+    // Selects the points whose byte in flags is non-zero; the inverse of expand()
+    static PointSelection fromFlags(const char *flags, qsizetype size);
+
+    // Host memory held by the containers, including reserved capacity
+    qint64 memoryUsage() const;
+
+    static constexpr int ContainerBits = 16;
+    static constexpr qsizetype ContainerPoints = qsizetype(1) << ContainerBits;
+    static constexpr int ContainerWords = int(ContainerPoints / 64);
+
+    // Containers holding more offsets than this switch to a bitmap, which is then smaller
+    static constexpr int MaxArrayValues = 4096;
+
+private:
+    struct Container {
+        enum Kind : quint8 {
+            Empty,
+            Array,
+            Bitmap,
+            Full
+        };
+
+        Kind kind = Empty;
+        quint32 cardinality = 0;
+        QVector<quint16> values;    // Array: sorted offsets of the selected points
+        QVector<quint64> bits;      // Bitmap: ContainerWords words
+    };
+
+    // Points covered by a container; only the last one can be partial
+    int span(qsizetype container) const;
+
+    // Unpacks a container into ContainerWords words, and packs words back into the smallest form
+    static void toWords(const Container &container, int span, quint64 *words);
+    static Container fromWords(const quint64 *words, int span);
+
+    // Calls visit(offset) for every selected point of a container, in order
+    template <typename Visit>
+    static void forEachSelected(const Container &container, int span, Visit &&visit);
+
+    QVector<Container> m_containers;
+    qsizetype m_size = 0;
+};
+
+#endif // POINTSELECTION_H
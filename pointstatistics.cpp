@@ -0,0 +1,227 @@
+#include "pointstatistics.h"
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define POINTSTATISTICS_SSE2
+#endif
+
+namespace {
+
+// Float sums are flushed into doubles this often, which bounds their rounding error
+constexpr qsizetype BlockPoints = 4096;
+
+// Sums of one chunk, taken relative to its first point
+struct Moments {
+    qsizetype count = 0;
+    double shift[3] = { 0.0, 0.0, 0.0 };
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    double sumSquares[3] = { 0.0, 0.0, 0.0 };
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+#ifdef POINTSTATISTICS_SSE2
+// Four packed points fill three registers whose lanes hold the axes
+// x y z x | y z x y | z x y z; this folds lanes of one axis together
+void foldLanes(const __m128 registers[3], float out[3], float (*fold)(float, float))
+{
+    alignas(16) float lanes[12];
+    _mm_store_ps(lanes, registers[0]);
+    _mm_store_ps(lanes + 4, registers[1]);
+    _mm_store_ps(lanes + 8, registers[2]);
+    for (int lane = 0; lane < 12; ++lane)
+        out[lane % 3] = fold(out[lane % 3], lanes[lane]);
+}
+#endif
+
+void accumulateBounds(const float *xyz, qsizetype count, float boundsMin[3], float boundsMax[3])
+{
+    qsizetype i = 0;
+
+#ifdef POINTSTATISTICS_SSE2
+    if (count >= 4) {
+        __m128 lo[3] = { _mm_loadu_ps(xyz), _mm_loadu_ps(xyz + 4), _mm_loadu_ps(xyz + 8) };
+        __m128 hi[3] = { lo[0], lo[1], lo[2] };
+        for (; i + 4 <= count; i += 4) {
+            const float *p = xyz + 3 * i;
+            for (int r = 0; r < 3; ++r) {
+                const __m128 v = _mm_loadu_ps(p + 4 * r);
+                lo[r] = _mm_min_ps(lo[r], v);
+                hi[r] = _mm_max_ps(hi[r], v);
+            }
+        }
+        foldLanes(lo, boundsMin, [](float a, float b) { return std::min(a, b); });
+        foldLanes(hi, boundsMax, [](float a, float b) { return std::max(a, b); });
+    }
+#endif
+
+    for (; i < count; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            boundsMin[axis] = std::min(boundsMin[axis], xyz[3 * i + axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], xyz[3 * i + axis]);
+        }
+    }
+}
+
+// Adds the offsets from shift and their squares of one block into float accumulators
+void accumulateBlock(const float *xyz, qsizetype count, const float shift[3], float sum[3], float sumSquares[3])
+{
+    qsizetype i = 0;
+
+#ifdef POINTSTATISTICS_SSE2
+    if (count >= 4) {
+        const __m128 shifts[3] = {
+            _mm_setr_ps(shift[0], shift[1], shift[2], shift[0]),
+            _mm_setr_ps(shift[1], shift[2], shift[0], shift[1]),
+            _mm_setr_ps(shift[2], shift[0], shift[1], shift[2])
+        };
+        __m128 sums[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        __m128 squares[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        for (; i + 4 <= count; i += 4) {
+            const float *p = xyz + 3 * i;
+            for (int r = 0; r < 3; ++r) {
+                const __m128 d = _mm_sub_ps(_mm_loadu_ps(p + 4 * r), shifts[r]);
+                sums[r] = _mm_add_ps(sums[r], d);
+                squares[r] = _mm_add_ps(squares[r], _mm_mul_ps(d, d));
+            }
+        }
+        foldLanes(sums, sum, [](float a, float b) { return a + b; });
+        foldLanes(squares, sumSquares, [](float a, float b) { return a + b; });
+    }
+#endif
+
+    for (; i < count; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            const float d = xyz[3 * i + axis] - shift[axis];
+            sum[axis] += d;
+            sumSquares[axis] += d * d;
+        }
+    }
+}
+
+Moments chunkMoments(const float *xyz, qsizetype count)
+{
+    Moments moments;
+    moments.count = count;
+    const float shift[3] = { xyz[0], xyz[1], xyz[2] };
+    for (int axis = 0; axis < 3; ++axis) {
+        moments.shift[axis] = shift[axis];
+        moments.boundsMin[axis] = moments.boundsMax[axis] = shift[axis];
+    }
+
+    accumulateBounds(xyz, count, moments.boundsMin, moments.boundsMax);
+
+    for (qsizetype first = 0; first < count; first += BlockPoints) {
+        float sum[3] = { 0.0f, 0.0f, 0.0f };
+        float sumSquares[3] = { 0.0f, 0.0f, 0.0f };
+        accumulateBlock(xyz + 3 * first, std::min(BlockPoints, count - first), shift, sum, sumSquares);
+        for (int axis = 0; axis < 3; ++axis) {
+            moments.sum[axis] += sum[axis];
+            moments.sumSquares[axis] += sumSquares[axis];
+        }
+    }
+    return moments;
+}
+
+} // namespace
+
+QVector3D PointStatistics::standardDeviation() const
+{
+    return QVector3D(std::sqrt(variance.x()), std::sqrt(variance.y()), std::sqrt(variance.z()));
+}
+
+PointStatistics PointStatistics::compute(const QVector<QVector3D> &points)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    PointStatistics statistics;
+    statistics.count = points.size();
+    if (points.isEmpty())
+        return statistics;
+
+    // QVector3D is three packed floats, so the array can be walked as one run of them
+    static_assert(sizeof(QVector3D) == 3 * sizeof(float), "QVector3D must be packed");
+    const float *xyz = reinterpret_cast<const float *>(points.constData());
+
+    const qsizetype chunkCount = (points.size() + ChunkPoints - 1) / ChunkPoints;
+    QVector<Moments> chunks(chunkCount);
+    Moments *chunkMomentsOut = chunks.data();
+    QVector<qsizetype> indices(chunkCount);
+    std::iota(indices.begin(), indices.end(), qsizetype(0));
+    QtConcurrent::blockingMap(indices, [&](qsizetype chunk) {
+        const qsizetype first = chunk * ChunkPoints;
+        chunkMomentsOut[chunk] = chunkMoments(xyz + 3 * first, std::min(ChunkPoints, points.size() - first));
+    });
+
+    // Chunk means and squared deviations are merged pairwise, which stays exact in the shift
+    double mean[3] = { 0.0, 0.0, 0.0 };
+    double m2[3] = { 0.0, 0.0, 0.0 };
+    double total = 0.0;
+    float boundsMin[3] = { chunks[0].boundsMin[0], chunks[0].boundsMin[1], chunks[0].boundsMin[2] };
+    float boundsMax[3] = { chunks[0].boundsMax[0], chunks[0].boundsMax[1], chunks[0].boundsMax[2] };
+
+    for (const Moments &chunk : chunks) {
+        const double n = double(chunk.count);
+        for (int axis = 0; axis < 3; ++axis) {
+            const double chunkMean = chunk.shift[axis] + chunk.sum[axis] / n;
+            const double chunkM2 = std::max(0.0, chunk.sumSquares[axis] - chunk.sum[axis] * chunk.sum[axis] / n);
+            const double delta = chunkMean - mean[axis];
+            mean[axis] += delta * n / (total + n);
+            m2[axis] += chunkM2 + delta * delta * total * n / (total + n);
+            boundsMin[axis] = std::min(boundsMin[axis], chunk.boundsMin[axis]);
+            boundsMax[axis] = std::max(boundsMax[axis], chunk.boundsMax[axis]);
+        }
+        total += n;
+    }
+
+    statistics.boundsMin = QVector3D(boundsMin[0], boundsMin[1], boundsMin[2]);
+    statistics.boundsMax = QVector3D(boundsMax[0], boundsMax[1], boundsMax[2]);
+    statistics.centroid = QVector3D(float(mean[0]), float(mean[1]), float(mean[2]));
+    statistics.variance = QVector3D(float(m2[0] / total), float(m2[1] / total), float(m2[2] / total));
+    statistics.computeTimeMs = timer.elapsed();
+    return statistics;
+}
+
+void PointStatistics::growBounds(const QVector3D *points, qsizetype count, QVector3D &boundsMin, QVector3D &boundsMax)
+{
+    if (count <= 0)
+        return;
+
+    const float *xyz = reinterpret_cast<const float *>(points);
+    float lo[3] = { boundsMin.x(), boundsMin.y(), boundsMin.z() };
+    float hi[3] = { boundsMax.x(), boundsMax.y(), boundsMax.z() };
+
+    // Streamed batches are mostly small; only large ones are worth the pool
+    if (count <= ChunkPoints) {
+        accumulateBounds(xyz, count, lo, hi);
+    } else {
+        const qsizetype chunkCount = (count + ChunkPoints - 1) / ChunkPoints;
+        QVector<std::array<float, 6>> chunks(chunkCount);
+        std::array<float, 6> *chunkBounds = chunks.data();
+        QVector<qsizetype> indices(chunkCount);
+        std::iota(indices.begin(), indices.end(), qsizetype(0));
+        QtConcurrent::blockingMap(indices, [&](qsizetype chunk) {
+            const qsizetype first = chunk * ChunkPoints;
+            float *bounds = chunkBounds[chunk].data();
+            std::copy(lo, lo + 3, bounds);
+            std::copy(hi, hi + 3, bounds + 3);
+            accumulateBounds(xyz + 3 * first, std::min(ChunkPoints, count - first), bounds, bounds + 3);
+        });
+        for (const auto &bounds : chunks) {
+            for (int axis = 0; axis < 3; ++axis) {
+                lo[axis] = std::min(lo[axis], bounds[axis]);
+                hi[axis] = std::max(hi[axis], bounds[axis + 3]);
+            }
+        }
+    }
+
+    boundsMin = QVector3D(lo[0], lo[1], lo[2]);
+    boundsMax = QVector3D(hi[0], hi[1], hi[2]);
+}
@@ -0,0 +1,32 @@
+#ifndef POINTSTATISTICS_H
+#define POINTSTATISTICS_H
+
+#include <QVector>
+#include <QVector3D>
+
+// Per-axis summary of a set of positions. The kernels walk the packed
+// x, y, z floats four points at a time with SSE2 where it is available, and
+// large arrays are split into chunks summed on the global thread pool, each
+// around its own first point so the variance keeps its precision far from the origin.
+struct PointStatistics {
+    qsizetype count = 0;
+    QVector3D boundsMin;
+    QVector3D boundsMax;
+    QVector3D centroid;
+    QVector3D variance;             // Population variance along each axis
+    qint64 computeTimeMs = 0;
+
+    bool isEmpty() const { return count == 0; }
+    QVector3D standardDeviation() const;
+
+    // Points handled by one worker
+    static constexpr qsizetype ChunkPoints = 1 << 20;
+
+    static PointStatistics compute(const QVector<QVector3D> &points);
+
+    // Bounds only, for callers that grow a box over every new batch; min and
+    // max are widened, not reset, so a running box can be passed in
+    static void growBounds(const QVector3D *points, qsizetype count, QVector3D &boundsMin, QVector3D &boundsMax);
+};
+
+#endif // POINTSTATISTICS_H
@@ -0,0 +1,246 @@
+#include "ptsparser.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+struct ParseChunk {
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    PointBatch batch;
+    qint64 malformedLines = 0;
+};
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// std::from_chars is locale independent and does not allocate, but rejects a leading '+'
+inline bool parseFloatToken(const char *begin, const char *end, float &value)
+{
+    if (begin < end && *begin == '+')
+        ++begin;
+    const auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+inline bool parseIntToken(const char *begin, const char *end, int &value)
+{
+    if (begin < end && *begin == '+')
+        ++begin;
+    const auto result = std::from_chars(begin, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// Splits a [begin, end) range into blocks of roughly ChunkSize that start right after a newline
+QVector<ParseChunk> splitIntoChunks(const char *begin, const char *end)
+{
+    QVector<ParseChunk> chunks;
+    const char *chunkBegin = begin;
+    while (chunkBegin < end) {
+        const char *chunkEnd = end;
+        if (end - chunkBegin > PtsParser::ChunkSize) {
+            const char *newline = static_cast<const char *>(
+                std::memchr(chunkBegin + PtsParser::ChunkSize, '\n', end - chunkBegin - PtsParser::ChunkSize));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+
+        ParseChunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.append(chunk);
+        chunkBegin = chunkEnd;
+    }
+    return chunks;
+}
+
+} // namespace
+
+double PtsParseStats::megabytesPerSecond() const
+{
+    return elapsedMs > 0 ? (bytes / (1024.0 * 1024.0)) / (elapsedMs / 1000.0) : 0.0;
+}
+
+double PtsParseStats::pointsPerSecond() const
+{
+    return elapsedMs > 0 ? points / (elapsedMs / 1000.0) : 0.0;
+}
+
+void PtsParser::parseLines(const char *begin, const char *end,
+                           PointAttributes &out, qint64 &malformedLines)
+{
+    // Guess from a typical "x y z i r g b" line so most chunks never reallocate
+    const qsizetype estimate = (end - begin) / 40;
+    out.points.reserve(out.points.size() + estimate);
+    out.colors.reserve(out.colors.size() + estimate);
+
+    const char *tokenBegin[7];
+    const char *tokenEnd[7];
+
+    const char *line = begin;
+    while (line < end) {
+        const char *newline = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        const char *lineEnd = newline ? newline : end;
+
+        int tokenCount = 0;
+        const char *p = line;
+        while (p < lineEnd && tokenCount < 7) {
+            while (p < lineEnd && isBlank(*p))
+                ++p;
+            if (p == lineEnd)
+                break;
+            tokenBegin[tokenCount] = p;
+            while (p < lineEnd && !isBlank(*p))
+                ++p;
+            tokenEnd[tokenCount] = p;
+            ++tokenCount;
+        }
+
+        line = lineEnd + 1;
+
+        if (tokenCount < 3)
+            continue;
+
+        float x, y, z;
+        if (!parseFloatToken(tokenBegin[0], tokenEnd[0], x) ||
+            !parseFloatToken(tokenBegin[1], tokenEnd[1], y) ||
+            !parseFloatToken(tokenBegin[2], tokenEnd[2], z))
+        {
+            ++malformedLines;
+            continue;
+        }
+
+        out.points.append(QVector3D(x, y, z));
+
+        // Six values carry a colour; four, five or seven lead with an intensity
+        const bool hasIntensity = tokenCount == 4 || tokenCount == 5 || tokenCount == 7;
+        const int colorToken = tokenCount == 7 ? 4 : 3;
+
+        if (hasIntensity) {
+            float intensity = 0.0f;
+            if (!parseFloatToken(tokenBegin[3], tokenEnd[3], intensity))
+                ++malformedLines;
+            // Intensities start at the first point that has one; earlier points read as zero
+            out.intensities.resize(out.points.size() - 1);
+            out.intensities.append(intensity);
+        }
+
+        PointColor color;
+        if (tokenCount >= 6) {
+            int r, g, b;
+            if (parseIntToken(tokenBegin[colorToken], tokenEnd[colorToken], r) &&
+                parseIntToken(tokenBegin[colorToken + 1], tokenEnd[colorToken + 1], g) &&
+                parseIntToken(tokenBegin[colorToken + 2], tokenEnd[colorToken + 2], b))
+            {
+                color.r = static_cast<quint8>(qBound(0, r, 255));
+                color.g = static_cast<quint8>(qBound(0, g, 255));
+                color.b = static_cast<quint8>(qBound(0, b, 255));
+            }
+            else
+            {
+                ++malformedLines;
+            }
+        }
+        out.colors.append(color);
+    }
+
+    if (out.hasIntensities())
+        out.intensities.resize(out.points.size());
+}
+
+bool PtsParser::parseFile(const QString &filename, const BatchCallback &onBatch,
+                          const ProgressCallback &progress, PtsParseStats *stats,
+                          QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    const qint64 fileSize = file.size();
+    QByteArray fallback;
+    const char *data = nullptr;
+    if (fileSize > 0) {
+        data = reinterpret_cast<const char *>(file.map(0, fileSize));
+        if (!data) {
+            // Some devices cannot be mapped; read them into memory instead
+            fallback = file.readAll();
+            data = fallback.constData();
+        }
+    }
+
+    const QVector<ParseChunk> chunks = splitIntoChunks(data, data + fileSize);
+
+    // Chunks are parsed in waves a few times wider than the pool so batches
+    // can be handed over in file order while the next wave is still small
+    const qsizetype waveSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * 2);
+
+    qint64 points = 0;
+    qint64 malformed = 0;
+    for (qsizetype first = 0; first < chunks.size(); first += waveSize) {
+        if (progress && !progress(static_cast<int>(first * 100 / chunks.size())))
+        {
+            if (errorMessage)
+                *errorMessage = QStringLiteral("Cancelled");
+            return false;
+        }
+
+        QVector<ParseChunk> wave = chunks.mid(first, waveSize);
+        QtConcurrent::blockingMap(wave, [](ParseChunk &chunk) {
+            parseLines(chunk.begin, chunk.end, chunk.batch, chunk.malformedLines);
+        });
+
+        for (ParseChunk &chunk : wave) {
+            points += chunk.batch.size();
+            malformed += chunk.malformedLines;
+            if (chunk.batch.size() > 0)
+                onBatch(std::move(chunk.batch));
+        }
+    }
+
+    file.close();
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = fileSize;
+        stats->points = points;
+        stats->malformedLines = malformed;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
+
+bool PtsParser::parseFile(const QString &filename, Result &result,
+                          const ProgressCallback &progress, QString *errorMessage)
+{
+    const qint64 chunksInFile = qMax<qint64>(1, (QFileInfo(filename).size() + ChunkSize - 1) / ChunkSize);
+
+    auto append = [&](PointBatch &&batch) {
+        if (result.points.isEmpty()) {
+            // Size the output once from the density of the first chunk
+            const qsizetype expected = static_cast<qsizetype>(batch.size() * chunksInFile * 21 / 20);
+            result.points.reserve(expected);
+            result.colors.reserve(expected);
+            if (batch.hasIntensities())
+                result.intensities.reserve(expected);
+        }
+        result.append(batch);
+    };
+
+    return parseFile(filename, append, progress, &result.stats, errorMessage);
+}
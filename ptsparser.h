@@ -0,0 +1,55 @@
+#ifndef PTSPARSER_H
+#define PTSPARSER_H
+
+#include <QString>
+#include <functional>
+#include "pointcloud.h"
+
+// Throughput figures of a finished parse
+struct PtsParseStats {
+    qint64 bytes = 0;
+    qint64 points = 0;
+    qint64 malformedLines = 0;
+    qint64 elapsedMs = 0;
+
+    double megabytesPerSecond() const;
+    double pointsPerSecond() const;
+};
+
+// Memory-mapped, multithreaded reader for ASCII .pts files.
+// Lines hold "x y z", "x y z i", "x y z r g b" or "x y z i r g b"; lines with
+// fewer than three values (such as the point count header) are skipped and
+// colour components are clamped to 0-255.
+class PtsParser
+{
+public:
+    struct Result : PointAttributes {
+        PtsParseStats stats;
+    };
+
+    // Called on the parsing thread between waves of chunks with a 0-100
+    // percentage; returning false cancels the parse
+    using ProgressCallback = std::function<bool(int percent)>;
+
+    // Receives consecutive runs of points in file order on the parsing thread
+    using BatchCallback = std::function<void(PointBatch &&batch)>;
+
+    // Streams the file as batches, one per parsed chunk, so callers can display it while it loads
+    static bool parseFile(const QString &filename, const BatchCallback &onBatch,
+                          const ProgressCallback &progress = ProgressCallback(),
+                          PtsParseStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // Collects the whole file into a single result
+    static bool parseFile(const QString &filename, Result &result,
+                          const ProgressCallback &progress = ProgressCallback(),
+                          QString *errorMessage = nullptr);
+
+    // Parses whole lines in [begin, end); exposed so other loaders can reuse the line grammar
+    static void parseLines(const char *begin, const char *end,
+                           PointAttributes &out, qint64 &malformedLines);
+
+    // Target size of the newline-aligned blocks handed to worker threads
+    static constexpr qint64 ChunkSize = 4 * 1024 * 1024;
+};
+
+#endif // PTSPARSER_H
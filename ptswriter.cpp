@@ -0,0 +1,197 @@
+#include "ptswriter.h"
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <charconv>
+
+namespace {
+
+// Longest line either format can produce: three floats printed in full with six
+// decimals, or four in shortest form, three colour components and separators
+constexpr qsizetype MaxLineLength = 160;
+
+// Typical line length used to size a block's buffer before it is formatted
+constexpr qsizetype ExpectedLineLength = 48;
+
+struct WriteBlock {
+    qsizetype first = 0;
+    qsizetype count = 0;
+    QByteArray text;
+};
+
+inline char *writeFixed(char *out, char *end, float value)
+{
+    // QString::arg(double, 0, 'f', 6) as used by the old exporter: the float widened to double
+    return std::to_chars(out, end, double(value), std::chars_format::fixed, 6).ptr;
+}
+
+inline char *writeShortest(char *out, char *end, float value)
+{
+    return std::to_chars(out, end, value).ptr;
+}
+
+inline char *writeInt(char *out, char *end, int value)
+{
+    return std::to_chars(out, end, value).ptr;
+}
+
+void formatBlock(WriteBlock &block, const PointAttributes &points, PtsWriter::Format format)
+{
+    const bool legacy = format == PtsWriter::Format::Legacy;
+    const bool hasColors = points.colors.size() == points.size();
+    const bool hasIntensities = !legacy && points.intensities.size() == points.size();
+
+    // The old exporter wrote through a text mode QFile, which translates newlines on Windows
+#ifdef Q_OS_WIN
+    const bool crlf = legacy;
+#else
+    const bool crlf = false;
+#endif
+
+    QByteArray &text = block.text;
+    text.resize(block.count * ExpectedLineLength + MaxLineLength);
+    char *out = text.data();
+    char *end = out + text.size();
+
+    const PointColor white;
+    for (qsizetype i = block.first; i < block.first + block.count; ++i) {
+        if (end - out < MaxLineLength) {
+            const qsizetype used = out - text.data();
+            text.resize(text.size() * 2);
+            out = text.data() + used;
+            end = text.data() + text.size();
+        }
+
+        const QVector3D &point = points.points[i];
+        if (legacy) {
+            out = writeFixed(out, end, point.x());
+            *out++ = ' ';
+            out = writeFixed(out, end, point.y());
+            *out++ = ' ';
+            out = writeFixed(out, end, point.z());
+        } else {
+            out = writeShortest(out, end, point.x());
+            *out++ = ' ';
+            out = writeShortest(out, end, point.y());
+            *out++ = ' ';
+            out = writeShortest(out, end, point.z());
+            if (hasIntensities) {
+                *out++ = ' ';
+                out = writeShortest(out, end, points.intensities[i]);
+            }
+        }
+
+        // Legacy lines always have a colour; white is what a cloud without one displays as
+        if (hasColors || legacy) {
+            const PointColor &color = hasColors ? points.colors[i] : white;
+            *out++ = ' ';
+            out = writeInt(out, end, color.r);
+            *out++ = ' ';
+            out = writeInt(out, end, color.g);
+            *out++ = ' ';
+            out = writeInt(out, end, color.b);
+        }
+
+        if (crlf)
+            *out++ = '\r';
+        *out++ = '\n';
+    }
+
+    text.resize(out - text.data());
+}
+
+} // namespace
+
+double PtsWriteStats::megabytesPerSecond() const
+{
+    return elapsedMs > 0 ? (bytes / (1024.0 * 1024.0)) / (elapsedMs / 1000.0) : 0.0;
+}
+
+double PtsWriteStats::pointsPerSecond() const
+{
+    return elapsedMs > 0 ? points / (elapsedMs / 1000.0) : 0.0;
+}
+
+bool PtsWriter::writeFile(const QString &filename, const PointAttributes &points, Format format,
+                          const ProgressCallback &progress, PtsWriteStats *stats, QString *errorMessage)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    auto fail = [&](const QString &message) {
+        if (errorMessage)
+            *errorMessage = message;
+        file.cancelWriting();
+        return false;
+    };
+
+    qint64 bytes = 0;
+    auto writeText = [&](const QByteArray &text) {
+        bytes += text.size();
+        return file.write(text) == text.size();
+    };
+
+    if (format == Format::Compact && !writeText(QByteArray::number(qint64(points.size())) + '\n'))
+        return fail(file.errorString());
+
+    // Blocks are formatted in waves a few times wider than the pool; while one
+    // wave is written out the next is already being formatted
+    const qsizetype pointCount = points.size();
+    const qsizetype waveSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount() * 2);
+    const qsizetype wavePoints = waveSize * BlockPoints;
+
+    auto makeWave = [&](qsizetype first) {
+        QVector<WriteBlock> wave;
+        for (qsizetype begin = first; begin < qMin(pointCount, first + wavePoints); begin += BlockPoints) {
+            WriteBlock block;
+            block.first = begin;
+            block.count = qMin(BlockPoints, pointCount - begin);
+            wave.append(block);
+        }
+        return wave;
+    };
+    auto formatInto = [&points, format](WriteBlock &block) { formatBlock(block, points, format); };
+
+    QVector<WriteBlock> current = makeWave(0);
+    QtConcurrent::blockingMap(current, formatInto);
+
+    for (qsizetype first = 0; first < pointCount; first += wavePoints) {
+        if (progress && !progress(static_cast<int>(first * 100 / pointCount)))
+            return fail(QStringLiteral("Cancelled"));
+
+        QVector<WriteBlock> next = makeWave(first + wavePoints);
+        QFuture<void> formatting = QtConcurrent::map(next, formatInto);
+
+        bool ok = true;
+        for (const WriteBlock &block : std::as_const(current)) {
+            if (!(ok = writeText(block.text)))
+                break;
+        }
+
+        formatting.waitForFinished();
+        if (!ok)
+            return fail(file.errorString());
+        current = std::move(next);
+    }
+
+    if (!file.commit())
+        return fail(file.errorString());
+
+    if (progress)
+        progress(100);
+
+    if (stats) {
+        stats->bytes = bytes;
+        stats->points = pointCount;
+        stats->elapsedMs = qMax<qint64>(1, timer.elapsed());
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef PTSWRITER_H
+#define PTSWRITER_H
+
+#include <QString>
+#include <functional>
+#include "pointcloud.h"
+
+// Throughput figures of a finished export
+struct PtsWriteStats {
+    qint64 bytes = 0;
+    qint64 points = 0;
+    qint64 elapsedMs = 0;
+
+    double megabytesPerSecond() const;
+    double pointsPerSecond() const;
+};
+
+// Multithreaded writer for ASCII .pts files. Points are formatted in blocks
+// on worker threads with std::to_chars, which neither allocates nor depends
+// on the locale, and the blocks are written to the file in order.
+class PtsWriter
+{
+public:
+    enum class Format {
+        // Point count header, then "x y z [i] r g b" with the shortest
+        // digits that read back to the same float
+        Compact,
+        // "x y z r g b" with six decimals and no header, byte for byte what
+        // earlier versions exported
+        Legacy
+    };
+
+    // Called on the calling thread between waves of blocks with a 0-100
+    // percentage; returning false cancels the export
+    using ProgressCallback = std::function<bool(int percent)>;
+
+    // Writes through a temporary file, so a failed or cancelled export leaves
+    // any existing file untouched
+    static bool writeFile(const QString &filename, const PointAttributes &points,
+                          Format format = Format::Compact,
+                          const ProgressCallback &progress = ProgressCallback(),
+                          PtsWriteStats *stats = nullptr, QString *errorMessage = nullptr);
+
+    // Points formatted by one worker at a time
+    static constexpr qsizetype BlockPoints = 65536;
+};
+
+#endif // PTSWRITER_H
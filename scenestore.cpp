@@ -0,0 +1,286 @@
+#include "scenestore.h"
+#include <QMetaObject>
+#include <limits>
+
+SceneStore::SceneStore(QObject *parent)
+    : QObject(parent)
+{
+    // One build at a time leaves the global pool to the parsers
+    m_lodPool.setMaxThreadCount(1);
+}
+
+SceneStore::~SceneStore()
+{
+    m_lodPool.clear();
+    m_lodPool.waitForDone();
+}
+
+EntityId SceneStore::addEntity(const QString &name, const PointCloud &cloud)
+{
+    const EntityId id = m_nextId++;
+
+    Entity entity;
+    entity.name = name;
+    entity.cloud = QSharedPointer<PointCloud>::create(cloud);
+    m_entities.insert(id, entity);
+    m_order.append(id);
+
+    emit entityAdded(id);
+    return id;
+}
+
+void SceneStore::removeEntity(EntityId id)
+{
+    if (!m_entities.remove(id))
+        return;
+
+    m_order.removeOne(id);
+    emit entityRemoved(id);
+}
+
+QString SceneStore::name(EntityId id) const
+{
+    return m_entities.value(id).name;
+}
+
+bool SceneStore::containsName(const QString &name) const
+{
+    for (const Entity &entity : m_entities) {
+        if (entity.name == name)
+            return true;
+    }
+    return false;
+}
+
+QSharedPointer<const PointCloud> SceneStore::cloud(EntityId id) const
+{
+    return m_entities.value(id).cloud;
+}
+
+PointCloud *SceneStore::editCloud(EntityId id)
+{
+    auto it = m_entities.find(id);
+    return it == m_entities.end() ? nullptr : it->cloud.data();
+}
+
+void SceneStore::notifyDataChanged(EntityId id)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end())
+        return;
+
+    ++it->revision;
+    it->spatialIndex.reset();
+    const bool hadLevelOfDetail = !it->lod.isNull();
+    it->lod.reset();
+    emit dataChanged(id);
+
+    if (hadLevelOfDetail)
+        buildLevelOfDetail(id);
+}
+
+void SceneStore::buildLevelOfDetail(EntityId id)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || it->cloud->points.isEmpty())
+        return;
+
+    // A shallow copy: the store detaches from it if the points change during the build
+    const PointAttributes source = *it->cloud;
+    const quint64 revision = it->revision;
+
+    m_lodPool.start([this, id, revision, source]() {
+        QVector<quint32> order;
+        QSharedPointer<const PointOctree> lod(new PointOctree(PointOctree::build(source.points, order)));
+        PointAttributes ordered = source.reordered(order);
+
+        QMetaObject::invokeMethod(this, [this, id, revision, lod, ordered, order]() mutable {
+            applyLevelOfDetail(id, revision, lod, std::move(ordered), order);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SceneStore::applyLevelOfDetail(EntityId id, quint64 revision, const QSharedPointer<const PointOctree> &lod,
+                                    PointAttributes &&ordered, const QVector<quint32> &order)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || it->revision != revision)
+        return;
+
+    // The octree ranges index the points in their new order
+    static_cast<PointAttributes &>(*it->cloud) = std::move(ordered);
+    it->lod = lod;
+    it->spatialIndex.reset();
+    if (!it->selection.isEmpty())
+        it->selection = it->selection.reordered(order);
+
+    // Statistics do not depend on the order, so current ones stay current
+    const bool statisticsCurrent = it->statisticsRevision == it->revision;
+    ++it->revision;
+    if (statisticsCurrent)
+        it->statisticsRevision = it->revision;
+    emit dataChanged(id);
+}
+
+QSharedPointer<const PointOctree> SceneStore::levelOfDetail(EntityId id) const
+{
+    return m_entities.value(id).lod;
+}
+
+QSharedPointer<const PointKdTree> SceneStore::spatialIndex(EntityId id)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || it->outOfCore || it->cloud->points.isEmpty())
+        return QSharedPointer<const PointKdTree>();
+
+    if (!it->spatialIndex || it->spatialIndexRevision != it->revision) {
+        it->spatialIndex.reset(new PointKdTree(PointKdTree::build(it->cloud->points)));
+        it->spatialIndexRevision = it->revision;
+    }
+    return it->spatialIndex;
+}
+
+QSharedPointer<const PointKdTree> SceneStore::builtSpatialIndex(EntityId id) const
+{
+    auto it = m_entities.constFind(id);
+    if (it == m_entities.constEnd() || it->spatialIndexRevision != it->revision)
+        return QSharedPointer<const PointKdTree>();
+    return it->spatialIndex;
+}
+
+PointStatistics SceneStore::statistics(EntityId id)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || it->cloud->points.isEmpty())
+        return PointStatistics();
+
+    if (it->statistics.isEmpty() || it->statisticsRevision != it->revision) {
+        it->statistics = PointStatistics::compute(it->cloud->points);
+        it->statisticsRevision = it->revision;
+    }
+    return it->statistics;
+}
+
+PointSelection SceneStore::selection(EntityId id) const
+{
+    return m_entities.value(id).selection;
+}
+
+void SceneStore::setSelection(EntityId id, const PointSelection &selection)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end())
+        return;
+
+    qsizetype first = 0;
+    qsizetype count = 0;
+    PointSelection::difference(it->selection, selection, first, count);
+    it->selection = selection;
+    it->selection.resize(it->cloud->points.size());
+
+    if (count > 0)
+        emit selectionChanged(id, first, qMin(count, it->cloud->points.size() - first));
+}
+
+void SceneStore::clearSelection(EntityId id)
+{
+    setSelection(id, PointSelection());
+}
+
+void SceneStore::setOutOfCore(EntityId id, const QSharedPointer<OutOfCoreCloud> &cloud)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end())
+        return;
+
+    it->outOfCore = cloud;
+    if (cloud) {
+        it->cloud->boundingBoxMin = cloud->boundingBoxMin();
+        it->cloud->boundingBoxMax = cloud->boundingBoxMax();
+    }
+    ++it->revision;
+    emit dataChanged(id);
+}
+
+QSharedPointer<OutOfCoreCloud> SceneStore::outOfCore(EntityId id) const
+{
+    return m_entities.value(id).outOfCore;
+}
+
+void SceneStore::setVisible(EntityId id, bool visible)
+{
+    PointCloud *pc = editCloud(id);
+    if (!pc || pc->isVisible == visible)
+        return;
+
+    pc->isVisible = visible;
+    emit visibilityChanged(id, visible);
+}
+
+void SceneStore::setTintColor(EntityId id, const QColor &color)
+{
+    PointCloud *pc = editCloud(id);
+    if (!pc || pc->tintColor == color)
+        return;
+
+    pc->tintColor = color;
+    emit tintColorChanged(id, color);
+}
+
+void SceneStore::setPointSize(EntityId id, float size)
+{
+    PointCloud *pc = editCloud(id);
+    if (!pc || pc->pointSize == size)
+        return;
+
+    pc->pointSize = size;
+    emit pointSizeChanged(id, size);
+}
+
+void SceneStore::setSourceFormat(EntityId id, const QString &format)
+{
+    if (PointCloud *pc = editCloud(id))
+        pc->sourceFormat = format;
+}
+
+void SceneStore::appendPoints(EntityId id, const PointBatch &batch)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || batch.size() == 0)
+        return;
+
+    PointCloud *pc = it->cloud.data();
+    ++it->revision;
+    it->lod.reset();
+    it->spatialIndex.reset();
+
+    const qsizetype firstNew = pc->points.size();
+    growBoundingBox(pc, batch.points);
+    pc->append(batch);
+
+    emit pointsAppended(id, firstNew);
+}
+
+void SceneStore::appendMesh(EntityId id, const MeshPart &mesh)
+{
+    auto it = m_entities.find(id);
+    if (it == m_entities.end() || mesh.indices.isEmpty())
+        return;
+
+    // Meshes are drawn as they are, so the point structures stay valid
+    PointCloud *pc = it->cloud.data();
+    growBoundingBox(pc, mesh.vertices);
+    pc->meshes.append(mesh);
+
+    emit meshAppended(id, pc->meshes.size() - 1);
+}
+
+void SceneStore::growBoundingBox(PointCloud *pc, const QVector<QVector3D> &vertices)
+{
+    if (!pc->hasGeometry()) {
+        pc->boundingBoxMin = QVector3D(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        pc->boundingBoxMax = QVector3D(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    }
+
+    PointStatistics::growBounds(vertices.constData(), vertices.size(), pc->boundingBoxMin, pc->boundingBoxMax);
+}
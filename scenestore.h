@@ -0,0 +1,129 @@
+#ifndef SCENESTORE_H
+#define SCENESTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QColor>
+#include "pointcloud.h"
+#include "pointoctree.h"
+#include "pointkdtree.h"
+#include "pointselection.h"
+#include "pointstatistics.h"
+#include "outofcorecloud.h"
+
+// Stable handle of an entity in a SceneStore; 0 never names an entity
+using EntityId = quint32;
+
+// The one place point clouds live. Readers share the data through
+// reference-counted pointers and react to the change signals instead of
+// taking copies; all mutation goes through the store so every view hears about it.
+class SceneStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SceneStore(QObject *parent = nullptr);
+    ~SceneStore();
+
+    EntityId addEntity(const QString &name, const PointCloud &cloud);
+    void removeEntity(EntityId id);
+
+    bool contains(EntityId id) const { return m_entities.contains(id); }
+    bool isEmpty() const { return m_entities.isEmpty(); }
+    int count() const { return m_entities.size(); }
+
+    // Ids in insertion order, which is also the draw order
+    const QVector<EntityId> &entityIds() const { return m_order; }
+
+    QString name(EntityId id) const;
+    bool containsName(const QString &name) const;
+
+    // Shared, read-only view of an entity; null for unknown ids
+    QSharedPointer<const PointCloud> cloud(EntityId id) const;
+
+    void setVisible(EntityId id, bool visible);
+    void setTintColor(EntityId id, const QColor &color);
+    void setPointSize(EntityId id, float size);
+    void setSourceFormat(EntityId id, const QString &format);
+
+    // Appends streamed points and grows the bounding box over them
+    void appendPoints(EntityId id, const PointBatch &batch);
+
+    // Adds an imported mesh and grows the bounding box over its vertices
+    void appendMesh(EntityId id, const MeshPart &mesh);
+
+    // Gives write access for bulk edits; callers must follow up with notifyDataChanged()
+    PointCloud *editCloud(EntityId id);
+    void notifyDataChanged(EntityId id);
+
+    // Builds the octree of an entity in the background. When it is done the
+    // points are put into octree order and dataChanged() is emitted; any edit
+    // made in the meantime discards the result.
+    void buildLevelOfDetail(EntityId id);
+
+    // Null until buildLevelOfDetail() has finished for the current data
+    QSharedPointer<const PointOctree> levelOfDetail(EntityId id) const;
+
+    // The k-d tree over an entity's current points, built on the first call after
+    // every change to them; null for unknown, empty or out-of-core entities
+    QSharedPointer<const PointKdTree> spatialIndex(EntityId id);
+
+    // The tree if it has already been built for the current points, without building it
+    QSharedPointer<const PointKdTree> builtSpatialIndex(EntityId id) const;
+
+    // Bounds, centroid and spread of an entity's points, computed on the first
+    // call after every change to them; the reordering into octree order keeps them
+    PointStatistics statistics(EntityId id);
+
+    // Points of an entity picked out by region selection; empty until something is selected
+    PointSelection selection(EntityId id) const;
+
+    // Replaces the selection and reports the range of points whose flags changed
+    void setSelection(EntityId id, const PointSelection &selection);
+    void clearSelection(EntityId id);
+
+    // Makes an entity draw from a chunked file instead of its point arrays,
+    // which stay empty; the bounding box is taken from the file
+    void setOutOfCore(EntityId id, const QSharedPointer<OutOfCoreCloud> &cloud);
+    QSharedPointer<OutOfCoreCloud> outOfCore(EntityId id) const;
+
+signals:
+    void entityAdded(EntityId id);
+    void entityRemoved(EntityId id);
+    void visibilityChanged(EntityId id, bool visible);
+    void tintColorChanged(EntityId id, const QColor &color);
+    void pointSizeChanged(EntityId id, float size);
+    void pointsAppended(EntityId id, qsizetype firstNewPoint);
+    void meshAppended(EntityId id, int meshIndex);
+    void dataChanged(EntityId id);
+    void selectionChanged(EntityId id, qsizetype firstPoint, qsizetype pointCount);
+
+private:
+    struct Entity {
+        QString name;
+        QSharedPointer<PointCloud> cloud;
+        QSharedPointer<const PointOctree> lod;
+        QSharedPointer<OutOfCoreCloud> outOfCore;
+        PointSelection selection;
+        QSharedPointer<const PointKdTree> spatialIndex;
+        quint64 spatialIndexRevision = 0;
+        PointStatistics statistics;
+        quint64 statisticsRevision = 0;
+        quint64 revision = 0;   // Bumped on every change to the point data
+    };
+
+    // Grows the bounding box over new vertices, starting it afresh while the entity has no geometry
+    static void growBoundingBox(PointCloud *pc, const QVector<QVector3D> &vertices);
+
+    void applyLevelOfDetail(EntityId id, quint64 revision, const QSharedPointer<const PointOctree> &lod,
+                            PointAttributes &&ordered, const QVector<quint32> &order);
+
+    QHash<EntityId, Entity> m_entities;
+    QVector<EntityId> m_order;
+    EntityId m_nextId = 1;
+    QThreadPool m_lodPool;
+};
+
+#endif // SCENESTORE_H
@@ -0,0 +1,39 @@
+#include "viewfrustum.h"
+
+ViewFrustum::ViewFrustum(const QMatrix4x4 &modelViewProjection)
+{
+    // Gribb/Hartmann: each plane is the last row plus or minus one of the others
+    const QVector4D rowX = modelViewProjection.row(0);
+    const QVector4D rowY = modelViewProjection.row(1);
+    const QVector4D rowZ = modelViewProjection.row(2);
+    const QVector4D rowW = modelViewProjection.row(3);
+
+    m_planes[0] = rowW + rowX;  // Left
+    m_planes[1] = rowW - rowX;  // Right
+    m_planes[2] = rowW + rowY;  // Bottom
+    m_planes[3] = rowW - rowY;  // Top
+    m_planes[4] = rowW + rowZ;  // Near
+    m_planes[5] = rowW - rowZ;  // Far
+}
+
+ViewFrustum::Containment ViewFrustum::classify(const QVector3D &boxMin, const QVector3D &boxMax) const
+{
+    Containment result = Inside;
+
+    for (const QVector4D &plane : m_planes) {
+        // The corners furthest along and against the plane normal
+        const QVector3D positive(plane.x() >= 0.0f ? boxMax.x() : boxMin.x(),
+                                 plane.y() >= 0.0f ? boxMax.y() : boxMin.y(),
+                                 plane.z() >= 0.0f ? boxMax.z() : boxMin.z());
+        const QVector3D negative(plane.x() >= 0.0f ? boxMin.x() : boxMax.x(),
+                                 plane.y() >= 0.0f ? boxMin.y() : boxMax.y(),
+                                 plane.z() >= 0.0f ? boxMin.z() : boxMax.z());
+
+        if (QVector3D::dotProduct(plane.toVector3D(), positive) + plane.w() < 0.0f)
+            return Outside;
+        if (QVector3D::dotProduct(plane.toVector3D(), negative) + plane.w() < 0.0f)
+            result = Intersecting;
+    }
+
+    return result;
+}
@@ -0,0 +1,28 @@
+#ifndef VIEWFRUSTUM_H
+#define VIEWFRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+// The six clip planes of a model-view-projection matrix, used to skip
+// geometry that cannot appear on screen
+class ViewFrustum
+{
+public:
+    enum Containment {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    explicit ViewFrustum(const QMatrix4x4 &modelViewProjection);
+
+    // Classifies an axis-aligned box given in model coordinates
+    Containment classify(const QVector3D &boxMin, const QVector3D &boxMax) const;
+
+private:
+    QVector4D m_planes[6];
+};
+
+#endif // VIEWFRUSTUM_H
@@ -21,6 +21,19 @@ void ViewportObject::setParameters(const ViewportParameters& params)
     m_params = params;
 }
 
+ViewportObject::ViewportParameters ViewportObject::capture(const PointCloudGLWidget* glWidget)
+{
+    ViewportParameters params {};
+    params.modelMatrix = glWidget->getModelMatrix();
+    params.viewMatrix = glWidget->getViewMatrix();
+    params.cameraDistance = glWidget->getCameraDistance();
+    params.xRot = glWidget->getXRotation();
+    params.yRot = glWidget->getYRotation();
+    params.focalDistance = glWidget->getFocalDistance();
+    params.fov = glWidget->getFOV();
+    return params;
+}
+
 void ViewportObject::applyViewport(PointCloudGLWidget* glWidget)
 {
     if (glWidget) {
@@ -25,8 +25,12 @@ public:
 
     QString getName() const;
     void setParameters(const ViewportParameters& params);
+    const ViewportParameters& parameters() const { return m_params; }
     void applyViewport(PointCloudGLWidget* glWidget);
 
+    // The camera a widget shows right now; the model centre is left at the origin
+    static ViewportParameters capture(const PointCloudGLWidget* glWidget);
+
 private:
     QString m_name;
     ViewportParameters m_params;
@@ -0,0 +1,207 @@
+#include "voxelgrid.h"
+#include "pointstatistics.h"
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+struct Entry {
+    quint64 key;
+    quint32 index;
+};
+
+int bucketOf(quint64 key)
+{
+    // Neighbouring cells differ in their low bits only; the multiply spreads them over the top byte
+    return int((key * 0x9E3779B97F4A7C15ull) >> 56) % VoxelGrid::BucketCount;
+}
+
+template <typename Function>
+void forEachIndex(qsizetype count, Function &&function)
+{
+    QVector<qsizetype> indices(count);
+    std::iota(indices.begin(), indices.end(), qsizetype(0));
+    QtConcurrent::blockingMap(indices, [&function](qsizetype index) {
+        function(index);
+    });
+}
+
+} // namespace
+
+PointAttributes VoxelGrid::downsample(const PointAttributes &source, const Options &options, Stats *stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qsizetype pointCount = source.size();
+    if (!options.isEnabled() || pointCount == 0 || pointCount > qsizetype(std::numeric_limits<quint32>::max())) {
+        if (stats) {
+            *stats = Stats();
+            stats->inputPoints = stats->outputPoints = pointCount;
+        }
+        return source;
+    }
+
+    QVector3D boundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    QVector3D boundsMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    PointStatistics::growBounds(source.points.constData(), pointCount, boundsMin, boundsMax);
+
+    // Cells are keyed by AxisBits bits per axis; a voxel too small for the extent is grown to fit
+    const QVector3D extent = boundsMax - boundsMin;
+    const float largestExtent = qMax(qMax(extent.x(), extent.y()), extent.z());
+    const quint64 maxCell = (quint64(1) << AxisBits) - 1;
+    const float cellsPerAxis = float(maxCell);
+    const float voxelSize = qMax(options.voxelSize, largestExtent / cellsPerAxis);
+    const float inverseSize = 1.0f / voxelSize;
+
+    const QVector3D *points = source.points.constData();
+    const qsizetype chunkCount = (pointCount + ChunkPoints - 1) / ChunkPoints;
+
+    // Pass 1: the key of every point and how many of each chunk land in each bucket
+    QVector<quint64> keys(pointCount);
+    QVector<qsizetype> chunkCounts(chunkCount * BucketCount, 0);
+    quint64 *keyOut = keys.data();
+    qsizetype *countOut = chunkCounts.data();
+    forEachIndex(chunkCount, [&](qsizetype chunk) {
+        qsizetype *counts = countOut + chunk * BucketCount;
+        const qsizetype end = qMin(pointCount, (chunk + 1) * ChunkPoints);
+        for (qsizetype i = chunk * ChunkPoints; i < end; ++i) {
+            const QVector3D cell = (points[i] - boundsMin) * inverseSize;
+            const quint64 x = qMin(quint64(cell.x()), maxCell);
+            const quint64 y = qMin(quint64(cell.y()), maxCell);
+            const quint64 z = qMin(quint64(cell.z()), maxCell);
+            const quint64 key = (x << (2 * AxisBits)) | (y << AxisBits) | z;
+            keyOut[i] = key;
+            ++counts[bucketOf(key)];
+        }
+    });
+
+    // Every chunk writes each bucket's entries into its own slice, so the scatter needs no locking
+    QVector<qsizetype> bucketStart(BucketCount + 1, 0);
+    QVector<qsizetype> chunkOffsets(chunkCount * BucketCount);
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        qsizetype offset = bucketStart[bucket];
+        for (qsizetype chunk = 0; chunk < chunkCount; ++chunk) {
+            chunkOffsets[chunk * BucketCount + bucket] = offset;
+            offset += chunkCounts[chunk * BucketCount + bucket];
+        }
+        bucketStart[bucket + 1] = offset;
+    }
+
+    // Pass 2: scatter the entries into their buckets, keeping input order within each chunk
+    QVector<Entry> entries(pointCount);
+    Entry *entryOut = entries.data();
+    qsizetype *offsetOut = chunkOffsets.data();
+    forEachIndex(chunkCount, [&](qsizetype chunk) {
+        qsizetype *offsets = offsetOut + chunk * BucketCount;
+        const qsizetype end = qMin(pointCount, (chunk + 1) * ChunkPoints);
+        for (qsizetype i = chunk * ChunkPoints; i < end; ++i) {
+            const quint64 key = keyOut[i];
+            entryOut[offsets[bucketOf(key)]++] = { key, quint32(i) };
+        }
+    });
+    keys = QVector<quint64>();
+
+    // Pass 3: sort each bucket by cell, then input index, and count its cells
+    QVector<qsizetype> cellCounts(BucketCount, 0);
+    qsizetype *cellCountOut = cellCounts.data();
+    forEachIndex(BucketCount, [&](qsizetype bucket) {
+        Entry *begin = entryOut + bucketStart[bucket];
+        Entry *end = entryOut + bucketStart[bucket + 1];
+        std::sort(begin, end, [](const Entry &a, const Entry &b) {
+            return a.key != b.key ? a.key < b.key : a.index < b.index;
+        });
+        qsizetype cells = 0;
+        for (Entry *entry = begin; entry != end; ++entry)
+            cells += entry == begin || entry->key != entry[-1].key;
+        cellCountOut[bucket] = cells;
+    });
+
+    QVector<qsizetype> outputStart(BucketCount + 1, 0);
+    for (int bucket = 0; bucket < BucketCount; ++bucket)
+        outputStart[bucket + 1] = outputStart[bucket] + cellCounts[bucket];
+
+    const qsizetype outputCount = outputStart[BucketCount];
+    const bool hasColors = source.colors.size() == pointCount;
+    const bool hasIntensities = source.intensities.size() == pointCount;
+
+    PointAttributes result;
+    result.points.resize(outputCount);
+    if (hasColors)
+        result.colors.resize(outputCount);
+    if (hasIntensities)
+        result.intensities.resize(outputCount);
+
+    QVector3D *pointsOut = result.points.data();
+    PointColor *colorsOut = hasColors ? result.colors.data() : nullptr;
+    float *intensitiesOut = hasIntensities ? result.intensities.data() : nullptr;
+
+    // Pass 4: collapse each run of equal keys into one output point
+    forEachIndex(BucketCount, [&](qsizetype bucket) {
+        const Entry *entry = entryOut + bucketStart[bucket];
+        const Entry *end = entryOut + bucketStart[bucket + 1];
+        qsizetype out = outputStart[bucket];
+
+        while (entry != end) {
+            const Entry *runEnd = entry + 1;
+            while (runEnd != end && runEnd->key == entry->key)
+                ++runEnd;
+
+            if (options.policy == Policy::FirstPoint) {
+                pointsOut[out] = points[entry->index];
+                if (colorsOut)
+                    colorsOut[out] = source.colors[entry->index];
+                if (intensitiesOut)
+                    intensitiesOut[out] = source.intensities[entry->index];
+            } else {
+                // Sums are taken relative to the first point, which keeps float positions exact far from the origin
+                const QVector3D origin = points[entry->index];
+                double offset[3] = { 0.0, 0.0, 0.0 };
+                quint64 color[4] = { 0, 0, 0, 0 };
+                double intensity = 0.0;
+                for (const Entry *member = entry; member != runEnd; ++member) {
+                    const QVector3D d = points[member->index] - origin;
+                    offset[0] += d.x();
+                    offset[1] += d.y();
+                    offset[2] += d.z();
+                    if (colorsOut) {
+                        const PointColor &c = source.colors[member->index];
+                        color[0] += c.r;
+                        color[1] += c.g;
+                        color[2] += c.b;
+                        color[3] += c.a;
+                    }
+                    if (intensitiesOut)
+                        intensity += source.intensities[member->index];
+                }
+
+                const qsizetype n = runEnd - entry;
+                pointsOut[out] = origin + QVector3D(float(offset[0] / n), float(offset[1] / n), float(offset[2] / n));
+                if (colorsOut) {
+                    PointColor &c = colorsOut[out];
+                    c.r = quint8((color[0] + n / 2) / n);
+                    c.g = quint8((color[1] + n / 2) / n);
+                    c.b = quint8((color[2] + n / 2) / n);
+                    c.a = quint8((color[3] + n / 2) / n);
+                }
+                if (intensitiesOut)
+                    intensitiesOut[out] = float(intensity / n);
+            }
+
+            ++out;
+            entry = runEnd;
+        }
+    });
+
+    if (stats) {
+        stats->inputPoints = pointCount;
+        stats->outputPoints = outputCount;
+        stats->voxelSize = voxelSize;
+        stats->elapsedMs = timer.elapsed();
+    }
+    return result;
+}
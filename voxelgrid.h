@@ -0,0 +1,49 @@
+#ifndef VOXELGRID_H
+#define VOXELGRID_H
+
+#include <QVector>
+#include <QVector3D>
+#include "pointcloud.h"
+
+// Reduces a cloud to at most one point per cell of a regular grid. Points are
+// keyed by their cell and scattered into hash buckets chunk by chunk on the
+// global thread pool; every bucket is then sorted and collapsed on its own, so
+// no step runs over the whole cloud on one core. The output is grouped by
+// bucket, not in input order, which the octree rebuilds anyway.
+class VoxelGrid
+{
+public:
+    enum class Policy {
+        Average,        // Mean position, colour and intensity of the cell
+        FirstPoint      // The point of the cell that came first in the input
+    };
+
+    struct Options {
+        float voxelSize = 0.0f;     // Edge length of a cell; 0 or less turns downsampling off
+        Policy policy = Policy::Average;
+
+        bool isEnabled() const { return voxelSize > 0.0f; }
+    };
+
+    struct Stats {
+        qsizetype inputPoints = 0;
+        qsizetype outputPoints = 0;
+        float voxelSize = 0.0f;     // As used; grown when the requested one would overflow the cell keys
+        qint64 elapsedMs = 0;
+
+        double reductionRatio() const { return inputPoints > 0 ? double(outputPoints) / double(inputPoints) : 1.0; }
+    };
+
+    static PointAttributes downsample(const PointAttributes &source, const Options &options, Stats *stats = nullptr);
+
+    // Points keyed by one worker
+    static constexpr qsizetype ChunkPoints = 1 << 20;
+
+    // Buckets the cells are hashed into; far more than there are cores, so they balance out
+    static constexpr int BucketCount = 256;
+
+    // Bits of a cell key per axis
+    static constexpr int AxisBits = 21;
+};
+
+#endif // VOXELGRID_H